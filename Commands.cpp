@@ -1,902 +1,5532 @@
-#include <unistd.h>
-#include <string.h>
-#include <iostream>
-#include <vector>
-#include <sstream>
-#include <sys/wait.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <signal.h>
-#include <iomanip>
-#include <fcntl.h>
-#include "Commands.h"
-#include <algorithm>
-
-using namespace std;
-const std::string WHITESPACE = " \n\r\t\f\v";
-
-// #define DBUG
-
-#if defined(DBUG)
-#define FUNC_ENTRY()  \
-  func_entry_c __func(__PRETTY_FUNCTION__);
-#else
-#define FUNC_ENTRY()
-#endif
-
-class func_entry_c {
-    const char* _func;
-public:
-    func_entry_c(const char* func): _func(func) {
-        cerr << _func << " --> " << endl;
-    }
-    ~func_entry_c() {
-        cerr << _func << " <-- " << endl;
-    }
-};
-
-string _ltrim(const std::string& s)
-{
-  size_t start = s.find_first_not_of(WHITESPACE);
-  return (start == std::string::npos) ? "" : s.substr(start);
-}
-
-string _rtrim(const std::string& s)
-{
-  size_t end = s.find_last_not_of(WHITESPACE);
-  return (end == std::string::npos) ? "" : s.substr(0, end + 1);
-}
-
-string _trim(const std::string& s)
-{
-  return _rtrim(_ltrim(s));
-}
-
-int _parseCommandLine(const char* cmd_line, char** args) {
-//   FUNC_ENTRY()
-  int i = 0;
-  std::istringstream iss(_trim(string(cmd_line)).c_str());
-  for(std::string s; iss >> s; ) {
-    args[i] = (char*)malloc(s.length()+1);
-    memset(args[i], 0, s.length()+1);
-    strcpy(args[i], s.c_str());
-    args[++i] = NULL;
-  }
-  return i;
-}
-
-bool _isBackgroundComamnd(const char* cmd_line) {
-  const string str(cmd_line);
-  return str[str.find_last_not_of(WHITESPACE)] == '&';
-}
-
-void _removeBackgroundSign(char* cmd_line) {
-  const string str(cmd_line);
-  // find last character other than spaces
-  unsigned int idx = str.find_last_not_of(WHITESPACE);
-  // if all characters are spaces then return
-  if (idx == string::npos) {
-    return;
-  }
-  // if the command line does not end with & then return
-  if (cmd_line[idx] != '&') {
-    return;
-  }
-  // replace the & (background sign) with space and then remove all tailing spaces.
-  cmd_line[idx] = ' ';
-  // truncate the command line string up to the last non-space character
-  cmd_line[str.find_last_not_of(WHITESPACE, idx) + 1] = 0;
-}
-
-void _removeBackgroundSign(string& cmd_line) {
-    // find last character other than spaces
-    unsigned int idx = cmd_line.find_last_not_of(WHITESPACE);
-    // if all characters are spaces then return
-    if (idx == string::npos) {
-        return;
-    }
-    // if the command line does not end with & then return
-    if (cmd_line[idx] != '&') {
-        return;
-    }
-    // replace the & (background sign) with space and then remove all tailing spaces.
-    cmd_line[idx] = ' ';
-    // truncate the command line string up to the last non-space character
-    cmd_line[cmd_line.find_last_not_of(WHITESPACE, idx) + 1] = 0;
-}
-
-bool _isComplex(const std::string& s) {
-    FUNC_ENTRY()
-    char ch1 = '*';
-    char ch2 = '?';
-    size_t pos1 = s.find(ch1);
-    size_t pos2 = s.find(ch2);
-    return pos1 != std::string::npos || pos2 != std::string::npos;
-}
-
-bool _isNumber(const std::string& s) {
-    if (s.empty()) {
-        return false;
-    }
-
-    // Check for a leading '-' character if present
-    size_t start = 0;
-    if (s[0] == '-') {
-        if (s.length() == 1) {
-            // The string contains only a '-' character
-            return false;
-        }
-        start = 1;
-    }
-
-    // Check if all remaining characters are digits
-    return std::all_of(s.begin() + start, s.end(),
-                       [](unsigned char c) { return std::isdigit(c); });
-}
-
-bool _isNumber(const char* s) {
-    return _isNumber(string(s));
-}
-
-bool _isRegularRedirection(const std::string& s) {
-    char ch = '>';
-    size_t pos = s.find(ch);
-    return pos != std::string::npos;
-}
-
-bool _isAppendRedirection(const std::string& s) {
-    std::string ch = ">>";
-    size_t pos = s.find(ch);
-    return pos != std::string::npos;
-}
-
-bool _isRedirectionCommand(const char* cmd_line) {
-    string s(cmd_line);
-    return _isRegularRedirection(s) || _isAppendRedirection(s);
-}
-
-bool _isRegularPipe(const std::string& s) {
-    char ch = '|';
-    size_t pos = s.find(ch);
-    return pos != std::string::npos;
-}
-
-bool _isStderrPipe(const std::string& s) {
-    std::string ch = "|&";
-    size_t pos = s.find(ch);
-    return pos != std::string::npos;
-}
-
-bool _isPipeCommand(const char* cmd_line) {
-    string s(cmd_line);
-    return _isRegularPipe(s) || _isStderrPipe(s);
-}
-
-/* -------------- Command -------------- */
-
-Command::Command(const char* cmd_line) {
-    _smash = &SmallShell::getInstance();
-    _cmd_line = new char[COMMAND_ARGS_MAX_LENGTH];
-    strcpy(_cmd_line, cmd_line);
-    _jid = -1;
-}
-
-const char *Command::cmd_line() {
-    return _cmd_line;
-}
-
-int Command::pid() {
-    return _pid;
-}
-
-/* -------------- Command::CommandError -------------- */
-
-Command::CommandError::CommandError(const std::string& message) {
-    _message = message;
-}
-
-const std::string& Command::CommandError::what() const {
-    return _message;
-}
-
-/* -------------- SmallShell -------------- */
-SmallShell::SmallShell():
-    _name("smash> ") {
-    _cwd = new char[COMMAND_ARGS_MAX_LENGTH];
-    _cd_called = false;
-    _running_cmd = nullptr;
-}
-
-SmallShell &SmallShell::getInstance() {
-    static SmallShell instance;
-    return instance;
-}
-
-Command *SmallShell::CreateCommand(const char* cmd_line) {
-
-    if (_isPipeCommand(cmd_line)) {
-        return new PipeCommand(cmd_line);
-    } else if (_isRedirectionCommand(cmd_line)) {
-        return new RedirectionCommand(cmd_line);
-    }
-
-    char* args[COMMAND_MAX_ARGS];
-    _parseCommandLine(cmd_line, args);
-    string firstWord(args[0]);
-    if (firstWord.back() == '&') {
-        firstWord.pop_back();
-    }
-
-    if (firstWord.compare("chprompt") == 0) {
-        return new ChpromptCommand(cmd_line, args);
-    } else if (firstWord.compare("showpid") == 0) {
-        return new ShowPidCommand(cmd_line, args);
-    } else if (firstWord.compare("pwd") == 0) {
-        return new GetCurrDirCommand(cmd_line, args);
-    } else if (firstWord.compare("cd") == 0) {
-        return new ChangeDirCommand(cmd_line, args);
-    } else if (firstWord.compare("jobs") == 0) {
-        return new JobsCommand(cmd_line, &_job_list);
-    } else if (firstWord.compare("fg") == 0) {
-        return new ForegroundCommand(cmd_line, args, &_job_list);
-    } else if (firstWord.compare("bg") == 0) {
-        return new BackgroundCommand(cmd_line, args, &_job_list);
-    } else if (firstWord.compare("quit") == 0) {
-        return new QuitCommand(cmd_line, args, &_job_list);
-    } else if (firstWord.compare("kill") == 0) {
-        return new KillCommand(cmd_line, args, &_job_list);
-    } else if (firstWord.compare("getfileinfo") == 0) {
-        return new GetFileTypeCommand(cmd_line, args);
-    } else if (firstWord.compare("chmod") == 0) {
-        return new ChmodCommand(cmd_line, args);
-    } else if (firstWord.compare("setcore") == 0) {
-        return new SetcoreCommand(cmd_line, args, &_job_list);
-    }
-    return new ExternalCommand(cmd_line);
-}
-
-bool SmallShell::executeCommand(const char *cmd_line) {
-    _job_list.removeFinishedJobs();
-    try {
-        Command* cmd = CreateCommand(cmd_line);
-        cmd->execute();
-
-        if (dynamic_cast<QuitCommand *>(cmd)) {
-            return false;
-        }
-    } catch (const Command::CommandError& e) {
-        cerr << "smash error: " << e.what() << endl;
-    }
-    return true;
-}
-
-const std::string& SmallShell::name() const {
-    return _name;
-}
-
-void SmallShell::handle_ctrl_z(int sig_num) {
-	cout << "smash: got ctrl-Z" << endl;
-    if (_running_cmd) {
-		pid_t pid = _running_cmd->pid();
-        kill(pid, sig_num);
-        _job_list.addJob(_running_cmd, true);
-        _running_cmd = nullptr;
-        cout << "smash: process " << pid << " was stopped" << endl;
-    }
-}
-
-void SmallShell::handle_ctrl_c(int sig_num) {
-	cout << "smash: got ctrl-C" << endl;
-    if (_running_cmd) {
-	    int pid = _running_cmd->pid();
-        kill(_running_cmd->pid(), sig_num);
-        _running_cmd = nullptr;
-        cout << "smash: process " << pid << " was killed" << endl;
-    }
-}
-
-
-/* -------------- BuiltInCommand -------------- */
-
-BuiltInCommand::BuiltInCommand(const char* cmd_line):
-    Command(cmd_line) {
-    _pid = getpid();
-}
-
-std::string& BuiltInCommand::smash_name() {
-    return _smash->_name;
-}
-
-char *BuiltInCommand::smash_cwd() {
-    return _smash->_cwd;
-}
-
-bool &BuiltInCommand::smash_cd_called() {
-    return _smash->_cd_called;
-}
-
-Command* &BuiltInCommand::smash_running_cmd() {
-    return _smash->_running_cmd;
-}
-
-/* -------------- ExternalCommand -------------- */
-
-ExternalCommand::ExternalCommand(const char* cmd_line):
-    Command(cmd_line),
-    _background_cmd(false) {
-	FUNC_ENTRY()
-    _command = new char[COMMAND_ARGS_MAX_LENGTH];
-    _args = new char*[COMMAND_MAX_ARGS + 2];
-    strcpy(_command, cmd_line);
-
-    if (_isBackgroundComamnd(cmd_line)) {
-        _background_cmd = true;
-        _removeBackgroundSign(_command);
-	    _smash->_job_list.addJob(this);
-    }
-    if (_isComplex(cmd_line)) {
-        _parseCommandLine("/bin/bash -c ", _args);
-        _args[2] = _command;
-    } else {
-        _parseCommandLine(_command, _args);
-    }
-}
-
-void ExternalCommand::execute() {
-	FUNC_ENTRY()
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("smash error: fork failed");
-    } else if (pid == 0) {
-        execvp(_args[0], _args);
-        perror("smash error: execvp failed");
-    } else {
-        _pid = pid;
-        if (!_background_cmd) {
-            _smash->_running_cmd = this;
-            if (waitpid(pid, nullptr, WUNTRACED) < 0) {
-                perror("smash error: waitpid failed");
-            }
-            _smash->_running_cmd = nullptr;
-        }
-    }
-}
-
-/* -------------- ChpromptCommand -------------- */
-
-ChpromptCommand::ChpromptCommand(const char* cmd_line, char* args[]):
-    BuiltInCommand(cmd_line) {
-    _new_name = "smash";
-    if (args[1]) {
-        _new_name = args[1];
-    }
-    _new_name.append("> ");
-}
-
-void ChpromptCommand::execute() {
-    smash_name() = _new_name;
-}
-
-/* -------------- ShowPidCommand -------------- */
-
-ShowPidCommand::ShowPidCommand(const char* cmd_line, char* args[]):
-    BuiltInCommand(cmd_line) {}
-
-void ShowPidCommand::execute() {
-    cout << "smash pid is " << _pid << endl;
-}
-
-/* -------------- GetCurrDirCommand -------------- */
-
-GetCurrDirCommand::GetCurrDirCommand(const char* cmd_line, char* args[]):
-    BuiltInCommand(cmd_line) {}
-
-void GetCurrDirCommand::execute() {
-    char cwd[COMMAND_ARGS_MAX_LENGTH];
-    cout << getcwd(cwd, sizeof(cwd)) << endl;
-}
-
-/* -------------- ChangeDirCommand -------------- */
-
-ChangeDirCommand::ChangeDirCommand(const char* cmd_line, char* args[]):
-    BuiltInCommand(cmd_line) {
-    if (args[2]) {
-        throw Command::CommandError("cd: too many arguments");
-    }
-    _new_dir = args[1];
-    if (strcmp(args[1], "-") == 0) {
-        if (!smash_cd_called()) {
-            throw Command::CommandError("cd: OLDPWD not set");
-        }
-        strcpy(_new_dir, smash_cwd());
-    }
-}
-
-void ChangeDirCommand::execute() {
-    char cwd[COMMAND_ARGS_MAX_LENGTH];
-    getcwd(cwd, sizeof(cwd));
-
-    if (chdir(_new_dir) != 0) {
-        perror("smash error: chdir failed");
-        return;
-    }
-    strcpy(smash_cwd(), cwd);
-    smash_cd_called() = true;
-}
-
-/* -------------- JobsList::JobEntry -------------- */
-
-JobsList::JobEntry::JobEntry(Command *cmd, bool stopped) {
-    _start = time(nullptr);
-    _cmd = cmd;
-    _pid = cmd->pid();
-    _stopped = stopped;
-}
-
-Command *JobsList::JobEntry::cmd() {
-    return _cmd;
-}
-
-bool &JobsList::JobEntry::stopped() {
-    return _stopped;
-}
-
-pid_t JobsList::JobEntry::pid() const {
-    return _pid;
-}
-
-/* -------------- JobsList -------------- */
-
-JobsList::JobsList() {
-    FUNC_ENTRY()
-    _next_jid = 1;
-}
-
-void JobsList::addJob(Command* cmd, bool stopped) {
-    FUNC_ENTRY()
-    removeFinishedJobs();
-    JobEntry *job = new JobEntry(cmd, stopped);
-
-    if (cmd->_jid == -1){
-        //JobEntry *job = new JobEntry(cmd, stopped);
-        job->_jid = _next_jid++;
-        cmd->_jid = job->_jid;
-        _jobs.push_back(job);
-    }
-
-    else{
-        //JobEntry *job = new JobEntry(cmd, stopped);
-        job->_jid = cmd->_jid;
-
-        auto it = _jobs.begin();
-        for (; it != _jobs.end(); ++it){
-            auto job2 = *it;
-            if (job2->_jid > job->_jid){
-                break;
-            }
-        }
-        _jobs.insert(it, job);
-
-        //  _jobs.push_back(job);
-    }
-
-}
-
-void JobsList::removeJobById(int jid) {
-    FUNC_ENTRY()
-    if (_jobs.empty()) {
-        return;
-    }
-    for (std::list<JobEntry *>::iterator it = _jobs.begin(); it != _jobs.end();) {
-        if ((*it)->_jid == jid) {
-            it = _jobs.erase(it);
-        } else {
-            ++it;
-        }
-    }
-}
-
-void JobsList::removeFinishedJobs() {
-    FUNC_ENTRY()
-    if (_jobs.empty()) {
-		_next_jid = 1;
-		return;
-	}
-    for (std::list<JobEntry *>::iterator it = _jobs.begin(); it != _jobs.end();) {
-        if (waitpid((*it)->cmd()->pid(), nullptr, WNOHANG) > 0) {
-            it = _jobs.erase(it);
-        } else {
-            ++it;
-        }
-    }
-
-    if (_jobs.empty()) {
-		_next_jid = 1;
-		return;
-	}
-    _next_jid = _jobs.back()->_jid + 1;
-}
-
-void JobsList::printJobsList() {
-    FUNC_ENTRY()
-    removeFinishedJobs();
-    for (const JobEntry *job : _jobs) {
-        cout << "[" << job->_jid << "] " << job->_cmd->cmd_line();
-        cout << " : " << job->_cmd->pid() << " ";
-        cout << difftime(time(nullptr), job->_start) << " secs";
-        if (job->_stopped) {
-            cout << " (stopped)";
-        }
-        cout << endl;
-    }
-}
-
-void JobsList::killAllJobs() {
-    FUNC_ENTRY()
-    cout << "smash: sending SIGKILL signal to " << _jobs.size() << " jobs:" << endl;
-    for (const JobEntry *job : _jobs) {
-        cout << job->_cmd->pid() << ": " << job->_cmd->cmd_line() << endl;
-        kill(job->_cmd->pid(), SIGKILL);
-    }
-
-    for (std::list<JobEntry *>::iterator it = _jobs.begin(); it != _jobs.end();) {
-        it = _jobs.erase(it);
-    }
-}
-
-JobsList::JobEntry *JobsList::getJobById(int jid) {
-    FUNC_ENTRY()
-    for (JobEntry *job : _jobs) {
-        if (job->_jid == jid) {
-            return job;
-        }
-    }
-    throw Command::CommandError("job-id " + to_string(jid) + " does not exist");
-}
-
-JobsList::JobEntry *JobsList::getLastJob(int* lastJobId) {
-    FUNC_ENTRY()
-    if (_jobs.empty()) {
-        throw Command::CommandError("jobs list is empty");
-    }
-    JobEntry *ret = _jobs.back();
-    _jobs.pop_back();
-    if (lastJobId) {
-        *lastJobId = ret->_jid;
-    }
-    return ret;
-}
-
-JobsList::JobEntry *JobsList::getLastStoppedJob(int* lastJobId) {
-    FUNC_ENTRY()
-    if (_jobs.empty()) {
-        throw Command::CommandError("there is no stopped jobs to resume");
-    }
-    for (auto it = _jobs.rbegin(); it != _jobs.rend(); ++it) {
-        if ((*it)->_stopped) {
-            JobEntry *ret = *it;
-            if (lastJobId) {
-                *lastJobId = ret->_jid;
-            }
-            return ret;
-        }
-    }
-    throw Command::CommandError("there is no stopped jobs to resume");
-}
-
-/* -------------- JobsCommand -------------- */
-
-JobsCommand::JobsCommand(const char* cmd_line, JobsList* jobs):
-    BuiltInCommand(cmd_line) {
-    _jobs = jobs;
-}
-
-void JobsCommand::execute() {
-    _jobs->printJobsList();
-}
-
-/* -------------- ForegroundCommand -------------- */
-
-ForegroundCommand::ForegroundCommand(const char* cmd_line, char* args[], JobsList* jobs):
-    BuiltInCommand(cmd_line) {
-
-    int jid;
-    JobsList::JobEntry *job;
-	if (!args[1]) {
-		try {
-		 job = jobs->getLastJob(&jid);
-		} catch (Command::CommandError& e) {
-			throw Command::CommandError("fg: " + e.what());
-        }
-	} else {
-        if (!_isNumber(string(args[1])) || args[2]) {
-            throw Command::CommandError("fg: invalid arguments");
-        }
-
-        jid = stoi(args[1]);
-        try {
-            job = jobs->getJobById(jid);
-        } catch (Command::CommandError& e) {
-            throw Command::CommandError("fg: " + e.what());
-        }
-    }
-    jobs->removeJobById(jid);
-    _cmd = job->cmd();
-}
-
-void ForegroundCommand::execute() {
-    cout << _cmd->cmd_line() << " : " << _cmd->pid() << endl;
-    kill(_cmd->pid(), SIGCONT);
-    smash_running_cmd() = _cmd;
-    waitpid(_cmd->pid(), nullptr, WUNTRACED);
-    smash_running_cmd() = nullptr;
-}
-
-/* -------------- BackgroundCommand -------------- */
-
-BackgroundCommand::BackgroundCommand(const char* cmd_line, char* args[], JobsList* jobs):
-    BuiltInCommand(cmd_line) {
-    FUNC_ENTRY()
-
-    int jid;
-    JobsList::JobEntry *job;
-	if (!args[1]) {
-		try {
-		 job = jobs->getLastStoppedJob(&jid);
-		} catch (Command::CommandError& e) {
-			throw Command::CommandError("bg: " + e.what());
-        }
-	} else {
-        if (!_isNumber(string(args[1])) || args[2]) {
-            throw Command::CommandError("bg: invalid arguments");
-        }
-
-        jid = stoi(args[1]);
-        try {
-            job = jobs->getJobById(jid);
-        } catch (Command::CommandError& e) {
-            throw Command::CommandError("bg: " + e.what());
-        }
-        if (!job->stopped()) {
-            throw Command::CommandError("bg: job-id " + to_string(jid)
-            + " is already running in the background");
-        }
-    }
-    job->stopped() = false;
-    _cmd = job->cmd();
-}
-
-void BackgroundCommand::execute() {
-    cout << _cmd->cmd_line() << " : " << _cmd->pid() << endl;
-    kill(_cmd->pid(), SIGCONT);
-}
-
-/* -------------- QuitCommand -------------- */
-
-QuitCommand::QuitCommand(const char* cmd_line, char* args[], JobsList* jobs):
-    BuiltInCommand(cmd_line) {
-    _kill = false;
-    _jobs = jobs;
-    if (args[1] && strcmp(args[1], "kill") == 0) {
-        _kill = true;
-    }
-}
-
-void QuitCommand::execute() {
-    if (_kill) {
-        _jobs->killAllJobs();
-    }
-}
-
-/* -------------- KillCommand -------------- */
-
-KillCommand::KillCommand(const char* cmd_line, char* args[], JobsList* jobs):
-    BuiltInCommand(cmd_line) {
-    FUNC_ENTRY()
-
-    if (!args[1] || !args[2] || args[1][0] != '-' || !_isNumber(string(args[1] + 1))
-    || !_isNumber(string(args[2])) || args[3]) {
-        throw Command::CommandError("kill: invalid arguments");
-    }
-
-    try {
-        _pid = jobs->getJobById(stoi(args[2]))->cmd()->pid();
-    } catch (const CommandError& e) {
-        throw CommandError("kill: " + e.what());
-    }
-    _signum = stoi(args[1] + 1);
-    if (_signum > 31 || _signum < 1){
-        throw Command::CommandError("kill: invalid arguments");
-    }
-}
-
-void KillCommand::execute() {
-    FUNC_ENTRY()
-    cout << "signal number " << _signum << " was sent to pid " << _pid << endl;
-    kill(_pid, _signum);
-}
-
-/* -------------- RedirectionCommand -------------- */
-
-RedirectionCommand::RedirectionCommand(const char* cmd_line):
-    Command(cmd_line) {
-    FUNC_ENTRY()
-    size_t pos;
-    string _cmd_line(cmd_line);
-    _removeBackgroundSign(_cmd_line);
-    _append = _isAppendRedirection(_cmd_line);
-    if (!_append) {
-        pos = _cmd_line.find('>');
-        _filename = _cmd_line.substr(pos + 1, _cmd_line.length());
-    } else {
-        pos = _cmd_line.find(">>");
-        _filename = _cmd_line.substr(pos + 2, _cmd_line.length());
-    }
-    _cmd = _smash->CreateCommand(_trim(_cmd_line.substr(0, pos)).c_str());
-    _filename = _trim(_filename);
-}
-
-void RedirectionCommand::execute() {
-    FUNC_ENTRY()
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("smash error: fork failed");
-    } else if (pid == 0) {
-        close(1);
-        if (_append) {
-            open(_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
-        } else {
-            open(_filename.c_str(), O_WRONLY | O_CREAT, 0666);
-        }
-        _cmd->execute();
-        exit(0);
-    } else {
-        if (waitpid(pid, nullptr, WUNTRACED) < 0) {
-            perror("smash error: waitpid failed");
-        }
-    }
-}
-
-/* -------------- PipeCommand -------------- */
-
-PipeCommand::PipeCommand(const char* cmd_line):
-    Command(cmd_line) {
-    FUNC_ENTRY()
-
-    size_t pos;
-    string _cmd_line_2;
-    string _cmd_line(cmd_line);
-    _removeBackgroundSign(_cmd_line);
-    if (_isRegularPipe(_cmd_line)) {
-        pos = _cmd_line.find('|');
-        _cmd_line_2 = _cmd_line.substr(pos + 1, _cmd_line.length());
-    } else {
-        pos = _cmd_line.find("|&");
-        _cmd_line_2 = _cmd_line.substr(pos + 2, _cmd_line.length());
-    }
-    _cmds[0] = _smash->CreateCommand(_trim(_cmd_line.substr(0, pos)).c_str());
-    _cmds[1] = _smash->CreateCommand(_trim(_cmd_line_2).c_str());
-}
-
-void PipeCommand::execute() {
-    FUNC_ENTRY()
-
-    int _pipe[2];
-    pipe(_pipe);
-    int _out = _isRegularPipe(cmd_line()) ? 1 : 2;
-    pid_t pid_1 = fork();
-    if (pid_1 < 0) {
-        perror("smash error: fork failed");
-    } else if (pid_1 == 0) {
-        dup2(_pipe[1], _out);
-        close(_pipe[0]);
-        close(_pipe[1]);
-        _cmds[0]->execute();
-        exit(0);
-    }
-    pid_t pid_2 = fork();
-    if (pid_2 < 0) {
-        perror("smash error: fork failed");
-    } else if (pid_2 == 0) {
-        dup2(_pipe[0], 0);
-        close(_pipe[0]);
-        close(_pipe[1]);
-        _cmds[1]->execute();
-        exit(0);
-    }
-    close(_pipe[0]);
-    close(_pipe[1]);
-    if (waitpid(pid_1, nullptr, WUNTRACED) < 0) {
-        perror("smash error: waitpid failed");
-    }
-    if (waitpid(pid_2, nullptr, WUNTRACED) < 0) {
-        perror("smash error: waitpid failed");
-    }
-}
-
-/* -------------- GetFileTypeCommand -------------- */
-
-GetFileTypeCommand::GetFileTypeCommand(const char* cmd_line, char* args[]):
-    BuiltInCommand(cmd_line) {
-    FUNC_ENTRY()
-    if (args[2]) {
-        throw Command::CommandError("gettype: invalid arguments");
-    }
-    _path = args[1];
-}
-
-void GetFileTypeCommand::execute() {
-    FUNC_ENTRY()
-    struct stat stats;
-    stat(_path, &stats);
-    std::string type;
-
-    if (S_ISREG(stats.st_mode)) {
-        type = "\"regular file\"";
-    } else if (S_ISDIR(stats.st_mode)) {
-        type = "\"directory\"";
-    } else if (S_ISCHR(stats.st_mode)) {
-        type = "\"character device\"";
-    } else if (S_ISBLK(stats.st_mode)) {
-        type = "\"block device\"";
-    } else if (S_ISFIFO(stats.st_mode)) {
-        type = "\"FIFO\"";
-    } else if (S_ISLNK(stats.st_mode)) {
-        type = "\"symbolic link\"";
-    } else if (S_ISSOCK(stats.st_mode)) {
-        type = "\"socket\"";
-    } else {
-        throw Command::CommandError("gettype: invalid arguments");
-    }
-    cout << _path << "'s type is " << type;
-    cout << " and takes up " << stats.st_size << " bytes" << endl;
-}
-
-/* -------------- ChmodCommand -------------- */
-
-ChmodCommand::ChmodCommand(const char *cmd_line, char* args[]):
-    BuiltInCommand(cmd_line) {
-    FUNC_ENTRY()
-    if (args[3] || !_isNumber(string(args[1]))) {
-        throw Command::CommandError("chmod: invalid arguments");
-    }
-    try {
-        _new_mode = stoi(args[1], 0 , 8);
-    } catch (...) {
-        throw Command::CommandError("chmod: invalid arguments");
-    }
-    _path = args[2];
-}
-
-void ChmodCommand::execute() {
-    FUNC_ENTRY()
-    if (chmod(_path, _new_mode) < 0) {
-        perror("smash error: chmod failed");
-    }
-}
-
-/* -------------- SetcoreCommand -------------- */
-
-SetcoreCommand::SetcoreCommand(const char *cmd_line, char* args[], JobsList* jobs):
-    BuiltInCommand(cmd_line) {
-    FUNC_ENTRY()
-    if (args[3] || !_isNumber(args[1]) || !_isNumber(args[2])) {
-        throw Command::CommandError("setcore: invalid arguments");
-    }
-    _core = stoi(args[2]);
-    try {
-        _pid = jobs->getJobById(stoi(args[1]))->pid();
-
-    } catch (const CommandError& e) {
-        throw CommandError("setcore: " + e.what());
-    }
-}
-
-void SetcoreCommand::execute(){
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(_core, &cpuset);
-    if (sched_setaffinity(_pid, sizeof(cpuset), &cpuset) == -1){
-        throw Command::CommandError("setcore: invalid core number");
-    }
-}
\ No newline at end of file
+#include <unistd.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <sstream>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <iomanip>
+#include <fcntl.h>
+#include <poll.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sys/file.h>
+#include <sched.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <glob.h>
+#include <fstream>
+#include <climits>
+#include "Commands.h"
+#include "signals.h"
+#include "textscan.h"
+#include "asyncio.h"
+#include <algorithm>
+#include <set>
+
+using namespace std;
+const std::string WHITESPACE = " \n\r\t\f\v";
+
+vector<string> _procStat(pid_t pid);
+
+// #define DBUG
+
+#if defined(DBUG)
+#define FUNC_ENTRY()  \
+  func_entry_c __func(__PRETTY_FUNCTION__);
+#else
+#define FUNC_ENTRY()
+#endif
+
+class func_entry_c {
+    const char* _func;
+public:
+    func_entry_c(const char* func): _func(func) {
+        cerr << _func << " --> " << endl;
+    }
+    ~func_entry_c() {
+        cerr << _func << " <-- " << endl;
+    }
+};
+
+string _ltrim(const std::string& s)
+{
+  size_t start = s.find_first_not_of(WHITESPACE);
+  return (start == std::string::npos) ? "" : s.substr(start);
+}
+
+string _rtrim(const std::string& s)
+{
+  size_t end = s.find_last_not_of(WHITESPACE);
+  return (end == std::string::npos) ? "" : s.substr(0, end + 1);
+}
+
+string _trim(const std::string& s)
+{
+  return _rtrim(_ltrim(s));
+}
+
+int _parseCommandLine(const char* cmd_line, char** args) {
+//   FUNC_ENTRY()
+  int i = 0;
+  std::istringstream iss(_trim(string(cmd_line)).c_str());
+  for(std::string s; i < COMMAND_MAX_ARGS - 1 && iss >> s; ) {
+    args[i] = (char*)malloc(s.length()+1);
+    memset(args[i], 0, s.length()+1);
+    strcpy(args[i], s.c_str());
+    args[++i] = NULL;
+  }
+  return i;
+}
+
+bool _isBackgroundComamnd(const char* cmd_line) {
+  const string str(cmd_line);
+  return str[str.find_last_not_of(WHITESPACE)] == '&';
+}
+
+void _removeBackgroundSign(char* cmd_line) {
+  const string str(cmd_line);
+  // find last character other than spaces
+  unsigned int idx = str.find_last_not_of(WHITESPACE);
+  // if all characters are spaces then return
+  if (idx == string::npos) {
+    return;
+  }
+  // if the command line does not end with & then return
+  if (cmd_line[idx] != '&') {
+    return;
+  }
+  // replace the & (background sign) with space and then remove all tailing spaces.
+  cmd_line[idx] = ' ';
+  // truncate the command line string up to the last non-space character
+  cmd_line[str.find_last_not_of(WHITESPACE, idx) + 1] = 0;
+}
+
+void _removeBackgroundSign(string& cmd_line) {
+    // find last character other than spaces
+    unsigned int idx = cmd_line.find_last_not_of(WHITESPACE);
+    // if all characters are spaces then return
+    if (idx == string::npos) {
+        return;
+    }
+    // if the command line does not end with & then return
+    if (cmd_line[idx] != '&') {
+        return;
+    }
+    // replace the & (background sign) with space and then remove all tailing spaces.
+    cmd_line[idx] = ' ';
+    // truncate the command line string up to the last non-space character
+    cmd_line.resize(cmd_line.find_last_not_of(WHITESPACE, idx) + 1);
+}
+
+// Ends a forked child of the smash, or an exec that failed. Unlike exit(), it
+// runs none of the atexit handlers and static destructors, which belong to
+// the parent: a program embedding the smash through libsmash, for one.
+[[noreturn]] void _exitChild(int status) {
+    cout.flush();
+    cerr.flush();
+    _exit(status);
+}
+
+bool _isComplex(const std::string& s) {
+    FUNC_ENTRY()
+    char ch1 = '*';
+    char ch2 = '?';
+    size_t pos1 = s.find(ch1);
+    size_t pos2 = s.find(ch2);
+    return pos1 != std::string::npos || pos2 != std::string::npos;
+}
+
+bool _isNumber(const std::string& s) {
+    if (s.empty()) {
+        return false;
+    }
+
+    // Check for a leading '-' character if present
+    size_t start = 0;
+    if (s[0] == '-') {
+        if (s.length() == 1) {
+            // The string contains only a '-' character
+            return false;
+        }
+        start = 1;
+    }
+
+    // Check if all remaining characters are digits
+    return std::all_of(s.begin() + start, s.end(),
+                       [](unsigned char c) { return std::isdigit(c); });
+}
+
+bool _isNumber(const char* s) {
+    return _isNumber(string(s));
+}
+
+bool _isRegularRedirection(const std::string& s) {
+    char ch = '>';
+    size_t pos = s.find(ch);
+    return pos != std::string::npos;
+}
+
+bool _isAppendRedirection(const std::string& s) {
+    std::string ch = ">>";
+    size_t pos = s.find(ch);
+    return pos != std::string::npos;
+}
+
+bool _isRedirectionCommand(const char* cmd_line) {
+    string s(cmd_line);
+    return _isRegularRedirection(s) || _isAppendRedirection(s);
+}
+
+bool _isRegularPipe(const std::string& s) {
+    // "|>" is the fan-out redirection operator, not a pipe
+    size_t pos = s.find('|');
+    while (pos != std::string::npos && pos + 1 < s.length() && s[pos + 1] == '>') {
+        pos = s.find('|', pos + 2);
+    }
+    return pos != std::string::npos;
+}
+
+bool _isStderrPipe(const std::string& s) {
+    std::string ch = "|&";
+    size_t pos = s.find(ch);
+    return pos != std::string::npos;
+}
+
+bool _isPipeCommand(const char* cmd_line) {
+    string s(cmd_line);
+    return _isRegularPipe(s) || _isStderrPipe(s);
+}
+
+int _pidfdOpen(pid_t pid) {
+#if defined(SYS_pidfd_open)
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int _pidfdSendSignal(int pidfd, int sig_num) {
+#if defined(SYS_pidfd_send_signal)
+    return syscall(SYS_pidfd_send_signal, pidfd, sig_num, nullptr, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+uint64_t _fnv1a(const std::string& data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int _memfdCreate(const char* name) {
+#if defined(SYS_memfd_create)
+    return syscall(SYS_memfd_create, name, MFD_CLOEXEC);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// glibc has no wrappers or constants for the I/O priority syscalls
+#define IOPRIO_CLASS_SHIFT (13)
+#define IOPRIO_WHO_PROCESS (1)
+#define IOPRIO_WHO_PGRP (2)
+
+int _ioprioSet(int which, int who, int ioprio) {
+#if defined(SYS_ioprio_set)
+    return syscall(SYS_ioprio_set, which, who, ioprio);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int _ioprioGet(int which, int who) {
+#if defined(SYS_ioprio_get)
+    return syscall(SYS_ioprio_get, which, who);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+long _monotonicMillis() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+volatile sig_atomic_t _leader_interrupted = 0;
+
+void _leaderSignalHandler(int sig_num) {
+    _leader_interrupted = sig_num;
+}
+
+// A job's leader outlives the signals aimed at its group and only exits once
+// the processes it waits for do, so a job never disappears from the list while
+// part of it is still running. Caught signals go back to default across exec.
+void _setupJobLeader() {
+    resetSignalEvents();
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGINT, _leaderSignalHandler);
+    signal(SIGTERM, _leaderSignalHandler);
+}
+
+/* -------------- Command -------------- */
+
+Command::Command(const char* cmd_line) {
+    _smash = &SmallShell::getInstance();
+    _cmd_line = new char[strlen(cmd_line) + 1];
+    strcpy(_cmd_line, cmd_line);
+    _jid = -1;
+    _pid = -1;
+    _group = false;
+}
+
+std::string Command::progress() {
+    return "";
+}
+
+// Extra state shown by "jobs -v"
+std::string Command::details() {
+    return "";
+}
+
+bool Command::reap(int *status) {
+    return waitpid(_pid, status, WNOHANG) > 0;
+}
+
+const char *Command::cmd_line() {
+    return _cmd_line;
+}
+
+int Command::pid() {
+    return _pid;
+}
+
+bool Command::group() {
+    return _group;
+}
+
+// A job passes the pidfd its entry holds. Without one the process must still
+// be an unreaped child, the foreground command, for the pid to be safe to use.
+void Command::sendSignal(int sig_num, int pidfd) {
+    // an unreaped leader keeps its pid and so its group id reserved, which
+    // makes killpg safe; a lone process is addressed through a pidfd instead
+    if (_group) {
+        killpg(_pid, sig_num);
+        return;
+    }
+    int own_pidfd = pidfd < 0 ? _pidfdOpen(_pid) : -1;
+    if (pidfd < 0) {
+        pidfd = own_pidfd;
+    }
+    if (pidfd < 0 || _pidfdSendSignal(pidfd, sig_num) < 0) {
+        if (errno == ENOSYS) {
+            kill(_pid, sig_num);
+        }
+    }
+    if (own_pidfd >= 0) {
+        close(own_pidfd);
+    }
+}
+
+/* -------------- Command::CommandError -------------- */
+
+Command::CommandError::CommandError(const std::string& message) {
+    _message = message;
+}
+
+const std::string& Command::CommandError::what() const {
+    return _message;
+}
+
+/* -------------- SmallShell -------------- */
+SmallShell::SmallShell():
+    _name("smash> ") {
+    _cwd = new char[COMMAND_ARGS_MAX_LENGTH];
+    _cd_called = false;
+    _running_cmd = nullptr;
+    _pgid = getpgrp();
+    _serving = false;
+    _interrupts = 0;
+    _detached_cmd = nullptr;
+    _status = 0;
+    _subreaper = false;
+}
+
+SmallShell *SmallShell::_current = nullptr;
+
+// The smash that commands are created for: the process's own, unless an
+// embedding made one of its engines current.
+SmallShell &SmallShell::getInstance() {
+    static SmallShell instance;
+    return _current ? *_current : instance;
+}
+
+// Makes smash the current one, nullptr standing for the process's own, and
+// returns the previous one.
+SmallShell *SmallShell::makeCurrent(SmallShell *smash) {
+    SmallShell *previous = _current;
+    _current = smash;
+    return previous;
+}
+
+// Builtins by the first word of their command line
+static const struct {
+    const char *name;
+    CommandKind kind;
+} BUILTINS[] = {
+    {"chprompt", CMD_CHPROMPT}, {"showpid", CMD_SHOWPID}, {"pwd", CMD_PWD}, {"cd", CMD_CD},
+    {"jobs", CMD_JOBS}, {"fg", CMD_FG}, {"bg", CMD_BG}, {"wait", CMD_WAIT}, {"quit", CMD_QUIT},
+    {"kill", CMD_KILL}, {"getfileinfo", CMD_GETFILEINFO}, {"chmod", CMD_CHMOD},
+    {"tail", CMD_TAIL}, {"touch", CMD_TOUCH}, {"setcore", CMD_SETCORE},
+    {"parallel", CMD_PARALLEL}, {"setprio", CMD_SETPRIO}, {"capture", CMD_CAPTURE},
+    {"joblog", CMD_JOBLOG}, {"rundag", CMD_RUNDAG}, {"pipestat", CMD_PIPESTAT},
+    {"xargs", CMD_XARGS}, {"cat", CMD_TEXT}, {"head", CMD_TEXT}, {"wc", CMD_TEXT},
+    {"grep", CMD_TEXT}, {"pgrep", CMD_PGREP}, {"pkill", CMD_PGREP}, {"cp", CMD_CP},
+};
+
+// Decides what a parsed command line is. The result only depends on the text,
+// which lets a script plan store it (see script.h).
+CommandKind SmallShell::classify(const char* cmd_line, char* args[]) {
+    // a submitted command line may itself be a pipeline or a redirection
+    if (strcmp(args[0], "submit") == 0 || strcmp(args[0], "submit&") == 0) {
+        return CMD_SUBMIT;
+    }
+    // so may a repeated or memoized one
+    if (strcmp(args[0], "repeat") == 0 || strcmp(args[0], "watch") == 0) {
+        return CMD_REPEAT;
+    }
+    if (strcmp(args[0], "memo") == 0) {
+        return CMD_MEMO;
+    }
+
+    if (_isPipeCommand(cmd_line)) {
+        return CMD_PIPE;
+    } else if (_isRedirectionCommand(cmd_line)) {
+        return CMD_REDIRECTION;
+    }
+
+    string firstWord(args[0]);
+    if (firstWord.back() == '&') {
+        firstWord.pop_back();
+    }
+    for (const auto& builtin : BUILTINS) {
+        if (firstWord.compare(builtin.name) == 0) {
+            return builtin.kind;
+        }
+    }
+    return CMD_EXTERNAL;
+}
+
+Command *SmallShell::CreateCommand(const char* cmd_line) {
+    char* args[COMMAND_MAX_ARGS];
+    _parseCommandLine(cmd_line, args);
+    return CreateCommand(cmd_line, classify(cmd_line, args), args);
+}
+
+Command *SmallShell::CreateCommand(const char* cmd_line, CommandKind kind, char* args[]) {
+    switch (kind) {
+    case CMD_SUBMIT:
+        return new SubmitCommand(cmd_line, args, &_job_list);
+    case CMD_REPEAT:
+        return new RepeatCommand(cmd_line, args);
+    case CMD_MEMO:
+        return new MemoCommand(cmd_line, args);
+    case CMD_PIPE:
+        return new PipeCommand(cmd_line);
+    case CMD_REDIRECTION:
+        return new RedirectionCommand(cmd_line);
+    case CMD_CHPROMPT:
+        return new ChpromptCommand(cmd_line, args);
+    case CMD_SHOWPID:
+        return new ShowPidCommand(cmd_line, args);
+    case CMD_PWD:
+        return new GetCurrDirCommand(cmd_line, args);
+    case CMD_CD:
+        return new ChangeDirCommand(cmd_line, args);
+    case CMD_JOBS:
+        return new JobsCommand(cmd_line, args, &_job_list);
+    case CMD_FG:
+        return new ForegroundCommand(cmd_line, args, &_job_list);
+    case CMD_BG:
+        return new BackgroundCommand(cmd_line, args, &_job_list);
+    case CMD_WAIT:
+        return new WaitCommand(cmd_line, args, &_job_list);
+    case CMD_QUIT:
+        return new QuitCommand(cmd_line, args, &_job_list);
+    case CMD_KILL:
+        return new KillCommand(cmd_line, args, &_job_list);
+    case CMD_PGREP:
+        return new PgrepCommand(cmd_line, args);
+    case CMD_GETFILEINFO:
+        return new GetFileTypeCommand(cmd_line, args);
+    case CMD_CHMOD:
+        return new ChmodCommand(cmd_line, args);
+    case CMD_SETCORE:
+        return new SetcoreCommand(cmd_line, args, &_job_list);
+    case CMD_PARALLEL:
+        return new ParallelCommand(cmd_line);
+    case CMD_SETPRIO:
+        return new SetprioCommand(cmd_line, args, &_job_list);
+    case CMD_CAPTURE:
+        return new CaptureCommand(cmd_line, args, &_job_list);
+    case CMD_JOBLOG:
+        return new JobLogCommand(cmd_line, args, &_job_list);
+    case CMD_RUNDAG:
+        return new RunDagCommand(cmd_line, args, &_job_list);
+    case CMD_PIPESTAT:
+        return new PipeStatCommand(cmd_line, args, &_job_list);
+    case CMD_XARGS:
+        return new XargsCommand(cmd_line, args);
+    case CMD_TEXT: {
+        Command *text = TextCommand::create(cmd_line, args);
+        if (text) {
+            return text;
+        }
+        break;
+    }
+    case CMD_CP: {
+        Command *cp = CpCommand::create(cmd_line, args);
+        if (cp) {
+            return cp;
+        }
+        break;
+    }
+    case CMD_TAIL: {
+        Command *tail = TailCommand::create(cmd_line, args);
+        if (tail) {
+            return tail;
+        }
+        break;
+    }
+    case CMD_TOUCH: {
+        Command *touch = TouchCommand::create(cmd_line, args);
+        if (touch) {
+            return touch;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return new ExternalCommand(cmd_line);
+}
+
+bool SmallShell::executeCommand(const char *cmd_line) {
+    if (_trim(cmd_line).empty()) {
+        return executeCommand(cmd_line, CMD_NONE, nullptr);
+    }
+    char* args[COMMAND_MAX_ARGS];
+    _parseCommandLine(cmd_line, args);
+    return executeCommand(cmd_line, classify(cmd_line, args), args);
+}
+
+// A server must not block on one session's builtin. wait and joblog -f work
+// on the server's own job list and loop, so they are refused; the other
+// builtins that can run for long, or print more than the session's pipe
+// holds, go to a child of their own. memo and parallel return at once on
+// their own when in the background.
+static Command *_serveBuiltin(Command *cmd, CommandKind kind, char* args[]) {
+    bool background = _isBackgroundComamnd(cmd->cmd_line());
+    switch (kind) {
+    case CMD_WAIT:
+        throw Command::CommandError("wait: not available to a served session");
+    case CMD_JOBLOG:
+        for (int i = 1; args[i]; ++i) {
+            if (strcmp(args[i], "-f") == 0) {
+                throw Command::CommandError("joblog: -f is not available to a served session");
+            }
+        }
+        return new ForkedBuiltinCommand(cmd->cmd_line(), cmd);
+    case CMD_MEMO:
+    case CMD_PARALLEL:
+        if (background) {
+            return cmd;
+        }
+        // fall through
+    case CMD_REPEAT:
+    case CMD_RUNDAG:
+    case CMD_XARGS:
+    case CMD_CP:
+    case CMD_TEXT:
+    case CMD_TAIL:
+    case CMD_GETFILEINFO:
+    case CMD_PGREP:
+        if (dynamic_cast<ExternalCommand *>(cmd)) {
+            return cmd;
+        }
+        return new ForkedBuiltinCommand(cmd->cmd_line(), cmd);
+    default:
+        return cmd;
+    }
+}
+
+// Runs a command line that was already parsed and classified, CMD_NONE being
+// an empty line. Returns false after quit.
+bool SmallShell::executeCommand(const char* cmd_line, CommandKind kind, char* args[]) {
+    _job_list.removeFinishedJobs();
+    reapOrphans();
+    if (kind == CMD_NONE) {
+        return true;
+    }
+    try {
+        Command* cmd = CreateCommand(cmd_line, kind, args);
+        if (_serving && getpgrp() == _pgid) {
+            cmd = _serveBuiltin(cmd, kind, args);
+        }
+        _status = 0;
+        cmd->execute();
+
+        if (kind == CMD_QUIT) {
+            return false;
+        }
+    } catch (const Command::CommandError& e) {
+        cerr << "smash error: " << e.what() << endl;
+        _status = 1;
+    }
+    // commands like kill and bg change job states behind the list's back
+    _job_list.publish();
+    return true;
+}
+
+// Runs the command line of "smash -c" and returns its exit status. A
+// foreground external command takes over the smash's process instead, so
+// there is no fork and no wait, and its status is the smash's.
+int SmallShell::executeOnce(const char* cmd_line) {
+    if (_trim(cmd_line).empty()) {
+        return 0;
+    }
+    char* args[COMMAND_MAX_ARGS];
+    _parseCommandLine(cmd_line, args);
+    try {
+        Command *cmd = CreateCommand(cmd_line, classify(cmd_line, args), args);
+        ExternalCommand *external = dynamic_cast<ExternalCommand *>(cmd);
+        if (external && !external->background()) {
+            external->replaceProcess();
+        }
+        _status = 0;
+        cmd->execute();
+    } catch (const Command::CommandError& e) {
+        cerr << "smash error: " << e.what() << endl;
+        return 1;
+    }
+    return _status;
+}
+
+// Exit status of the last foreground command, as a shell's $? would have it:
+// 1 for a builtin that failed, 128 plus the signal for one killed or stopped.
+int SmallShell::lastStatus() const {
+    return _status;
+}
+
+const std::string& SmallShell::name() const {
+    return _name;
+}
+
+// What the prompt read from stdin past the line being run. A builtin that
+// reads the shell's stdin takes it from here first.
+std::string& SmallShell::input() {
+    return _input;
+}
+
+void SmallShell::handle_ctrl_z(int sig_num) {
+	cout << "smash: got ctrl-Z" << endl;
+    if (_running_cmd) {
+		pid_t pid = _running_cmd->pid();
+        _running_cmd->sendSignal(sig_num);
+        _job_list.addJob(_running_cmd, true);
+        _running_cmd = nullptr;
+        cout << "smash: process " << pid << " was stopped" << endl;
+    }
+}
+
+void SmallShell::handle_ctrl_c(int sig_num) {
+	cout << "smash: got ctrl-C" << endl;
+    _interrupts++;
+    if (_running_cmd) {
+	    int pid = _running_cmd->pid();
+        _running_cmd->sendSignal(sig_num);
+        _running_cmd = nullptr;
+        cout << "smash: process " << pid << " was killed" << endl;
+    }
+}
+
+void SmallShell::handle_io(int sig_num) {
+    _job_list.drainCaptures();
+}
+
+// Lets long-running builtins notice a Ctrl-C that arrived while they waited.
+int SmallShell::interrupts() const {
+    return _interrupts;
+}
+
+// Orphaned processes of jobs are reparented to the smash, which reaps them.
+bool SmallShell::becomeSubreaper() {
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0) {
+        perror("smash error: prctl failed");
+        return false;
+    }
+    _subreaper = true;
+    return true;
+}
+
+// As a child subreaper the smash inherits whatever its jobs leave behind.
+// Zombies are peeked at first so that a job's own exit status is left for the
+// jobs list. A zombie job does not end the sweep: the children listed under
+// /proc are collected one by one, skipping jobs, so orphans queued behind it
+// are reaped too. Any other smash, such as an engine embedded in a process
+// with children of its own, must leave those alone.
+void SmallShell::reapOrphans() {
+    if (!_subreaper) {
+        return;
+    }
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0 || info.si_pid == 0) {
+        return;
+    }
+    set<pid_t> jobs;
+    for (JobsList::JobEntry *job : _job_list.getAllJobs()) {
+        jobs.insert(job->pid());
+    }
+    DIR *tasks = opendir("/proc/self/task");
+    if (!tasks) {
+        return;
+    }
+    struct dirent *task;
+    while ((task = readdir(tasks))) {
+        if (task->d_name[0] == '.') {
+            continue;
+        }
+        ifstream children(string("/proc/self/task/") + task->d_name + "/children");
+        pid_t pid;
+        while (children >> pid) {
+            if (!jobs.count(pid)) {
+                waitid(P_PID, pid, &info, WEXITED | WNOHANG);
+            }
+        }
+    }
+    closedir(tasks);
+}
+
+// Launches queued jobs while the queue limits admit them. It only runs where
+// no job list iteration is in progress: at the prompt and from the loops that
+// wait for the foreground or for jobs. While load or pressure hold the queue
+// back nothing else would wake us, so an alarm polls them again.
+void SmallShell::runQueue() {
+    string cmd_line;
+    int jid;
+    bool pressure = false;
+    while (_job_list.dequeue(cmd_line, jid, pressure)) {
+        try {
+            Command *cmd = CreateCommand(cmd_line.c_str());
+            cmd->_jid = jid;
+            cmd->execute();
+        } catch (const Command::CommandError& e) {
+            cerr << "smash error: " << e.what() << endl;
+        }
+    }
+    // without handlers, as in an embedding, SIGALRM would be fatal
+    if (pressure && signalEventsFd() >= 0) {
+        alarm(1);
+    }
+}
+
+// Called whenever the smash wakes up between commands or while it waits for
+// the foreground: collects finished jobs, so that the exported table does not
+// lag behind, and lets the queue start more.
+void SmallShell::refreshJobs() {
+    _job_list.removeFinishedJobs();
+    runQueue();
+}
+
+// Finds a command on PATH the way execvp would, once: after that only the
+// file found is checked, which saves the child the failed execs in the
+// directories before it. The cache is dropped whenever PATH changes, and a
+// server's sessions share it. Names with a slash, and PATH entries that are
+// relative, are left to execvp.
+std::string SmallShell::lookupCommand(const char *name) {
+    const char *path = getenv("PATH");
+    if (!path || !*name || strchr(name, '/')) {
+        return name;
+    }
+    if (_commands_path != path) {
+        _commands.clear();
+        _commands_path = path;
+    }
+    auto cached = _commands.find(name);
+    if (cached != _commands.end()) {
+        if (access(cached->second.c_str(), X_OK) == 0) {
+            return cached->second;
+        }
+        _commands.erase(cached);
+    }
+    std::istringstream dirs(_commands_path);
+    for (string dir; getline(dirs, dir, ':');) {
+        if (dir.empty() || dir[0] != '/') {
+            return name;
+        }
+        string file = dir + "/" + name;
+        struct stat st;
+        if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(file.c_str(), X_OK) == 0) {
+            _commands[name] = file;
+            return file;
+        }
+    }
+    return name;
+}
+
+bool SmallShell::openJobTable(const std::string& name) {
+    JobTable *table = JobTable::create(name);
+    if (table) {
+        _job_list.setJobTable(table);
+    }
+    return table != nullptr;
+}
+
+bool SmallShell::openJobDb(const std::string& path) {
+    JobDb *db = JobDb::open(path);
+    if (db) {
+        _job_list.setJobDb(db);
+    }
+    return db != nullptr;
+}
+
+// Gives a freshly forked job its own process group, so that signals reach
+// every process it spawns. Called with 0 from the child and with the child's
+// pid from the parent to close the race between the two. Processes forked
+// inside a job (pipeline stages, redirected commands) stay in the job's group.
+bool SmallShell::setJobGroup(pid_t pid) {
+    if (getpgrp() != _pgid) {
+        return false;
+    }
+    if (setpgid(pid, pid) < 0 && pid == 0) {
+        perror("smash error: setpgid failed");
+        return false;
+    }
+    return true;
+}
+
+void SmallShell::waitForeground(Command *cmd) {
+    // a server keeps serving its other sessions and collects the job itself
+    if (_serving && getpgrp() == _pgid) {
+        _detached_cmd = cmd;
+        return;
+    }
+    AdoptedCommand *adopted = dynamic_cast<AdoptedCommand *>(cmd);
+
+    // on a terminal the job's group becomes the foreground group, so keyboard
+    // signals reach it directly and show up in the wait status instead
+    bool tty = !adopted && cmd->group() && isatty(STDIN_FILENO) &&
+               tcgetpgrp(STDIN_FILENO) == getpgrp();
+    sigset_t ttou, old;
+    sigemptyset(&ttou);
+    sigaddset(&ttou, SIGTTOU);
+    if (tty) {
+        tcsetpgrp(STDIN_FILENO, cmd->pid());
+    }
+
+    // inside a job only the smash itself should notice a stop, a nested wait
+    // returning early would make the job's leader exit while it is suspended
+    bool nested = getpgrp() != _pgid || signalEventsFd() < 0;
+    int status = 0;
+    bool exited = false;
+    _running_cmd = cmd;
+    while (nested) {
+        if (waitpid(cmd->pid(), &status, 0) >= 0 || errno != EINTR) {
+            break;
+        }
+    }
+    // the smash sleeps on the signal pipe, which SIGCHLD also writes to, and
+    // handles Ctrl-C/Ctrl-Z between checks of the child
+    while (!nested && !adopted) {
+        pid_t ret = waitpid(cmd->pid(), &status, WUNTRACED | WNOHANG);
+        if (ret > 0) {
+            exited = !WIFSTOPPED(status);
+            break;
+        }
+        if (ret < 0 && errno != EINTR) {
+            perror("smash error: waitpid failed");
+            break;
+        }
+        struct pollfd pfd = {signalEventsFd(), POLLIN, 0};
+        poll(&pfd, 1, -1);
+        dispatchSignalEvents();
+        refreshJobs();
+    }
+    // an adopted job is not our child, so there is no SIGCHLD and no stop
+    // notification: its pidfd wakes us up when it exits
+    while (adopted && _running_cmd == cmd) {
+        if ((exited = adopted->reap(&status))) {
+            break;
+        }
+        struct pollfd pfds[2] = {{signalEventsFd(), POLLIN, 0}, {adopted->pidfd(), POLLIN, 0}};
+        poll(pfds, 2, -1);
+        dispatchSignalEvents();
+    }
+    if (exited && cmd->_jid != -1) {
+        _job_list.journal(cmd, JOB_DONE);
+    }
+    if (WIFEXITED(status)) {
+        _status = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        _status = 128 + WTERMSIG(status);
+    } else if (WIFSTOPPED(status)) {
+        _status = 128 + WSTOPSIG(status);
+    }
+
+    if (tty) {
+        sigprocmask(SIG_BLOCK, &ttou, &old);
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+        sigprocmask(SIG_SETMASK, &old, nullptr);
+        if (_running_cmd && WIFSTOPPED(status)) {
+            cout << endl << "smash: got ctrl-Z" << endl;
+            _job_list.addJob(cmd, true);
+            cout << "smash: process " << cmd->pid() << " was stopped" << endl;
+        } else if (_running_cmd && WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+            cout << endl << "smash: got ctrl-C" << endl;
+            cout << "smash: process " << cmd->pid() << " was killed" << endl;
+        }
+    }
+    _running_cmd = nullptr;
+}
+
+/* -------------- BuiltInCommand -------------- */
+
+BuiltInCommand::BuiltInCommand(const char* cmd_line):
+    Command(cmd_line) {
+    _pid = getpid();
+}
+
+std::string& BuiltInCommand::smash_name() {
+    return _smash->_name;
+}
+
+char *BuiltInCommand::smash_cwd() {
+    return _smash->_cwd;
+}
+
+bool &BuiltInCommand::smash_cd_called() {
+    return _smash->_cd_called;
+}
+
+Command* &BuiltInCommand::smash_running_cmd() {
+    return _smash->_running_cmd;
+}
+
+int &BuiltInCommand::smash_status() {
+    return _smash->_status;
+}
+
+/* -------------- ExternalCommand -------------- */
+
+ExternalCommand::ExternalCommand(const char* cmd_line):
+    Command(cmd_line),
+    _background_cmd(false) {
+	FUNC_ENTRY()
+    _command = new char[COMMAND_ARGS_MAX_LENGTH];
+    _args = new char*[COMMAND_MAX_ARGS + 2];
+    strcpy(_command, cmd_line);
+
+    if (_isBackgroundComamnd(cmd_line)) {
+        _background_cmd = true;
+        _removeBackgroundSign(_command);
+    }
+    if (_isComplex(cmd_line)) {
+        _parseCommandLine("/bin/bash -c ", _args);
+        _args[2] = _command;
+    } else {
+        _parseCommandLine(_command, _args);
+    }
+}
+
+bool ExternalCommand::background() const {
+    return _background_cmd;
+}
+
+// Execs the command in the calling process, as the last thing it does.
+void ExternalCommand::replaceProcess() {
+    execvp(_args[0], _args);
+    perror("smash error: execvp failed");
+    _exitChild(1);
+}
+
+void ExternalCommand::execute() {
+	FUNC_ENTRY()
+    OutputCapture *capture = _background_cmd ? _smash->_job_list.startCapture() : nullptr;
+    string path = _smash->lookupCommand(_args[0]);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+        delete capture;
+    } else if (pid == 0) {
+        _smash->setJobGroup(0);
+        if (capture) {
+            capture->attach();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.defaultPriority().apply(0, false);
+        }
+        // a cached path that went stale falls back to searching PATH
+        if (path != _args[0]) {
+            execv(path.c_str(), _args);
+        }
+        execvp(_args[0], _args);
+        perror("smash error: execvp failed");
+        _exitChild(1);
+    } else {
+        _pid = pid;
+        _group = _smash->setJobGroup(pid);
+        if (capture) {
+            capture->closeWriter();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.addJob(this, false, capture);
+        } else {
+            _smash->waitForeground(this);
+        }
+    }
+}
+
+/* -------------- AdoptedCommand -------------- */
+
+AdoptedCommand::AdoptedCommand(const char* cmd_line, pid_t pid, int pidfd):
+    Command(cmd_line),
+    _pidfd(pidfd) {
+    FUNC_ENTRY()
+    _pid = pid;
+    _group = getpgid(pid) == pid;
+}
+
+AdoptedCommand::~AdoptedCommand() {
+    close(_pidfd);
+}
+
+// The exit status went to the process's real parent, so a finished adopted
+// job is reported as having exited with 0.
+bool AdoptedCommand::reap(int *status) {
+    struct pollfd pfd = {_pidfd, POLLIN, 0};
+    if (poll(&pfd, 1, 0) <= 0) {
+        return false;
+    }
+    if (status) {
+        *status = 0;
+    }
+    return true;
+}
+
+int AdoptedCommand::pidfd() const {
+    return _pidfd;
+}
+
+/* -------------- ChpromptCommand -------------- */
+
+ChpromptCommand::ChpromptCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {
+    _new_name = "smash";
+    if (args[1]) {
+        _new_name = args[1];
+    }
+    _new_name.append("> ");
+}
+
+void ChpromptCommand::execute() {
+    smash_name() = _new_name;
+}
+
+/* -------------- ShowPidCommand -------------- */
+
+ShowPidCommand::ShowPidCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {}
+
+void ShowPidCommand::execute() {
+    cout << "smash pid is " << _pid << endl;
+}
+
+/* -------------- GetCurrDirCommand -------------- */
+
+GetCurrDirCommand::GetCurrDirCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {}
+
+void GetCurrDirCommand::execute() {
+    char cwd[COMMAND_ARGS_MAX_LENGTH];
+    cout << getcwd(cwd, sizeof(cwd)) << endl;
+}
+
+/* -------------- ChangeDirCommand -------------- */
+
+ChangeDirCommand::ChangeDirCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {
+    if (args[2]) {
+        throw Command::CommandError("cd: too many arguments");
+    }
+    _new_dir = args[1];
+    if (strcmp(args[1], "-") == 0) {
+        if (!smash_cd_called()) {
+            throw Command::CommandError("cd: OLDPWD not set");
+        }
+        strcpy(_new_dir, smash_cwd());
+    }
+}
+
+void ChangeDirCommand::execute() {
+    char cwd[COMMAND_ARGS_MAX_LENGTH];
+    getcwd(cwd, sizeof(cwd));
+
+    if (chdir(_new_dir) != 0) {
+        perror("smash error: chdir failed");
+        return;
+    }
+    strcpy(smash_cwd(), cwd);
+    smash_cd_called() = true;
+}
+
+/* -------------- OutputCapture -------------- */
+
+#define CAPTURE_BLOCK (65536)
+
+OutputCapture::OutputCapture():
+    _memfd(-1),
+    _base(nullptr),
+    _capacity(0),
+    _head(0),
+    _tail(0),
+    _eof(false) {
+    _pipe[0] = _pipe[1] = -1;
+}
+
+OutputCapture *OutputCapture::create(size_t capacity) {
+    FUNC_ENTRY()
+    size_t page = sysconf(_SC_PAGESIZE);
+    OutputCapture *capture = new OutputCapture();
+    capture->_capacity = max(page, (capacity + page - 1) / page * page);
+    capture->_memfd = _memfdCreate("smash-joblog");
+    if (capture->_memfd < 0 || ftruncate(capture->_memfd, capture->_capacity) < 0 ||
+        pipe2(capture->_pipe, O_CLOEXEC) < 0) {
+        perror("smash error: capture failed");
+        delete capture;
+        return nullptr;
+    }
+
+    // reserve twice the size, then map the memfd into both halves
+    size_t size = capture->_capacity;
+    void *base = mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED ||
+        mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, capture->_memfd, 0) == MAP_FAILED ||
+        mmap((char *)base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, capture->_memfd, 0) == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        if (base != MAP_FAILED) {
+            munmap(base, 2 * size);
+        }
+        delete capture;
+        return nullptr;
+    }
+    capture->_base = (char *)base;
+
+    // the smash is told about new output by SIGIO instead of polling for it,
+    // where it handles SIGIO at all
+    if (signalEventsFd() >= 0) {
+        fcntl(capture->_pipe[0], F_SETOWN, getpid());
+        fcntl(capture->_pipe[0], F_SETFL, O_NONBLOCK | O_ASYNC);
+    } else {
+        fcntl(capture->_pipe[0], F_SETFL, O_NONBLOCK);
+    }
+    return capture;
+}
+
+OutputCapture::~OutputCapture() {
+    if (_base) {
+        munmap(_base, 2 * _capacity);
+    }
+    for (int fd : {_memfd, _pipe[0], _pipe[1]}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+// Called in the forked job before exec.
+void OutputCapture::attach() {
+    dup2(_pipe[1], STDOUT_FILENO);
+    dup2(_pipe[1], STDERR_FILENO);
+}
+
+void OutputCapture::closeWriter() {
+    close(_pipe[1]);
+    _pipe[1] = -1;
+}
+
+// Reads up to len bytes of what the job wrote straight into the ring,
+// overwriting the oldest output once it is full. Returns the number of bytes
+// read, 0 once the job closed its output, or -1 when nothing is pending.
+ssize_t OutputCapture::fill(size_t len) {
+    while (!_eof) {
+        ssize_t n = read(_pipe[0], _base + _head % _capacity, min(len, _capacity));
+        if (n > 0) {
+            _head += n;
+            _tail = max(_tail, _head > _capacity ? _head - _capacity : 0);
+            return n;
+        } else if (n == 0) {
+            _eof = true;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Reads everything the job wrote so far into the ring. Returns false once the
+// job closed its output.
+bool OutputCapture::drain() {
+    while (fill(_capacity) > 0) {}
+    return !_eof;
+}
+
+bool OutputCapture::eof() const {
+    return _eof;
+}
+
+size_t OutputCapture::size() const {
+    return _head - _tail;
+}
+
+unsigned long long OutputCapture::head() const {
+    return _head;
+}
+
+// Drops the oldest bytes and gives the memory of every page they fully
+// covered back to the system.
+void OutputCapture::evict(size_t bytes) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    unsigned long long tail = min(_head, _tail + bytes);
+    unsigned long long first = (_tail + page - 1) / page * page;
+    unsigned long long last = tail / page * page;
+    _tail = tail;
+    if (last <= first) {
+        return;
+    }
+    size_t offset = first % _capacity;
+    size_t len = last - first;
+    size_t part = min(len, _capacity - offset);
+    fallocate(_memfd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, part);
+    if (len > part) {
+        fallocate(_memfd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, len - part);
+    }
+}
+
+// Writes the retained output from offset from on, or only its last lines,
+// to stdout directly out of the mapping.
+void OutputCapture::print(unsigned long long from, int lines) {
+    unsigned long long start = max(from, _tail);
+    if (lines == 0) {
+        return;
+    }
+    if (lines > 0) {
+        unsigned long long pos = _head;
+        if (pos > start && _base[(pos - 1) % _capacity] == '\n') {
+            pos--;
+        }
+        for (int found = 0; pos > start; --pos) {
+            if (_base[(pos - 1) % _capacity] == '\n' && ++found == lines) {
+                break;
+            }
+        }
+        start = pos;
+    }
+    cout.flush();
+    const char *data = _base + start % _capacity;
+    for (size_t done = 0, len = _head - start; done < len;) {
+        ssize_t n = write(STDOUT_FILENO, data + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("smash error: write failed");
+            return;
+        }
+        done += n;
+    }
+}
+
+/* -------------- JobPriority -------------- */
+
+static const char *const POLICY_NAMES[] = {"other", "fifo", "rr", "batch", "", "idle"};
+static const char *const IOPRIO_CLASS_NAMES[] = {"none", "rt", "be", "idle"};
+
+JobPriority::JobPriority():
+    set_nice(false),
+    nice(0),
+    policy(-1),
+    rt_priority(0),
+    ioprio(-1) {}
+
+bool JobPriority::empty() const {
+    return !set_nice && policy < 0 && ioprio < 0;
+}
+
+// Parses [-n nice] [-s other|batch|idle|fifo[:prio]] [-io rt|be[:level]|idle],
+// reporting errors as "<cmd>: invalid arguments".
+void JobPriority::parse(char* args[], const std::string& cmd) {
+    Command::CommandError invalid(cmd + ": invalid arguments");
+    for (int i = 0; args[i]; i += 2) {
+        if (!args[i + 1]) {
+            throw invalid;
+        }
+        string option(args[i]);
+        string value(args[i + 1]);
+        string level;
+        size_t colon = value.find(':');
+        if (colon != string::npos) {
+            level = value.substr(colon + 1);
+            value.erase(colon);
+            if (!_isNumber(level)) {
+                throw invalid;
+            }
+        }
+        if (option == "-n") {
+            char *end = nullptr;
+            long n = strtol(args[i + 1], &end, 10);
+            if (*end || end == args[i + 1] || n < -20 || n > 19) {
+                throw invalid;
+            }
+            set_nice = true;
+            nice = n;
+        } else if (option == "-s") {
+            if (value == "fifo") {
+                policy = SCHED_FIFO;
+                rt_priority = level.empty() ? sched_get_priority_min(SCHED_FIFO) : stoi(level);
+                if (rt_priority < sched_get_priority_min(SCHED_FIFO) ||
+                    rt_priority > sched_get_priority_max(SCHED_FIFO)) {
+                    throw invalid;
+                }
+            } else if (level.empty() && (value == "other" || value == "batch" || value == "idle")) {
+                policy = value == "other" ? SCHED_OTHER : value == "batch" ? SCHED_BATCH : SCHED_IDLE;
+                rt_priority = 0;
+            } else {
+                throw invalid;
+            }
+        } else if (option == "-io") {
+            int io_class = value == "rt" ? 1 : value == "be" ? 2 : value == "idle" ? 3 : -1;
+            int io_level = level.empty() ? 4 : stoi(level);
+            if (io_class < 0 || io_level < 0 || io_level > 7 || (io_class == 3 && !level.empty())) {
+                throw invalid;
+            }
+            ioprio = io_class << IOPRIO_CLASS_SHIFT | (io_class == 3 ? 0 : io_level);
+        } else {
+            throw invalid;
+        }
+    }
+}
+
+// Applies the settings to a process, or with group to its whole process
+// group. Nice and I/O priority can address a group directly. The scheduling
+// policy is per thread, so it is set on every member found in /proc; any
+// process forked later inherits it.
+bool JobPriority::apply(pid_t pid, bool group) const {
+    bool ok = true;
+    if (set_nice && setpriority(group ? PRIO_PGRP : PRIO_PROCESS, pid, nice) < 0) {
+        perror("smash error: setpriority failed");
+        ok = false;
+    }
+    if (ioprio >= 0 && _ioprioSet(group ? IOPRIO_WHO_PGRP : IOPRIO_WHO_PROCESS, pid, ioprio) < 0) {
+        perror("smash error: ioprio_set failed");
+        ok = false;
+    }
+    if (policy < 0) {
+        return ok;
+    }
+    struct sched_param param;
+    param.sched_priority = rt_priority;
+    vector<pid_t> members(1, pid);
+    DIR *proc = group ? opendir("/proc") : nullptr;
+    if (proc) {
+        members.clear();
+        for (struct dirent *entry; (entry = readdir(proc));) {
+            if (_isNumber(entry->d_name) && getpgid(stoi(entry->d_name)) == pid) {
+                members.push_back(stoi(entry->d_name));
+            }
+        }
+        closedir(proc);
+    }
+    for (pid_t member : members) {
+        if (sched_setscheduler(member, policy, &param) < 0 && errno != ESRCH) {
+            perror("smash error: sched_setscheduler failed");
+            return false;
+        }
+    }
+    return ok;
+}
+
+std::string JobPriority::describe(pid_t pid) {
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, pid);
+    int policy = sched_getscheduler(pid);
+    int ioprio = _ioprioGet(IOPRIO_WHO_PROCESS, pid);
+    if (errno == ESRCH) {
+        return "";
+    }
+    policy &= ~SCHED_RESET_ON_FORK;
+    ostringstream ret;
+    ret << " [nice " << nice << ", ";
+    ret << (policy >= 0 && policy <= SCHED_IDLE ? POLICY_NAMES[policy] : "?");
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        struct sched_param param;
+        sched_getparam(pid, &param);
+        ret << ":" << param.sched_priority;
+    }
+    int io_class = ioprio < 0 ? 0 : ioprio >> IOPRIO_CLASS_SHIFT;
+    ret << ", io " << (io_class <= 3 ? IOPRIO_CLASS_NAMES[io_class] : "?");
+    if (io_class == 1 || io_class == 2) {
+        ret << ":" << (ioprio & ((1 << IOPRIO_CLASS_SHIFT) - 1));
+    }
+    ret << "]";
+    return ret.str();
+}
+
+/* -------------- QueueLimits -------------- */
+
+QueueLimits::QueueLimits():
+    max_jobs(sysconf(_SC_NPROCESSORS_ONLN)),
+    max_load(0),
+    max_cpu(0),
+    max_mem(0) {}
+
+// The first avg10 of a /proc/pressure file belongs to its "some" line. Kernels
+// without PSI have no such file and never report pressure.
+static double _pressureAvg10(const std::string& resource) {
+    ifstream file("/proc/pressure/" + resource);
+    for (string word; file >> word;) {
+        if (word.compare(0, 6, "avg10=") == 0) {
+            return strtod(word.c_str() + 6, nullptr);
+        }
+    }
+    return 0;
+}
+
+bool QueueLimits::overloaded() const {
+    double load;
+    if (max_load > 0 && getloadavg(&load, 1) == 1 && load >= max_load) {
+        return true;
+    }
+    if (max_cpu > 0 && _pressureAvg10("cpu") >= max_cpu) {
+        return true;
+    }
+    return max_mem > 0 && _pressureAvg10("memory") >= max_mem;
+}
+
+/* -------------- PipePolicy -------------- */
+
+// Pipes hold this much time of the measured throughput under the adaptive policy
+#define PIPE_ADAPT_MS (100)
+#define PIPE_DEFAULT_SIZE (65536)
+
+static string _formatBytes(double bytes) {
+    static const char *UNITS[] = {"B", "KB", "MB", "GB"};
+    int unit = 0;
+    for (; bytes >= 1024 && unit < 3; ++unit) {
+        bytes /= 1024;
+    }
+    ostringstream ret;
+    ret << fixed << setprecision(unit ? 1 : 0) << bytes << " " << UNITS[unit];
+    return ret.str();
+}
+
+PipePolicy::PipePolicy():
+    mode(ADAPTIVE),
+    size(0) {}
+
+// Takes default, adaptive, max or a static size in bytes, K or M.
+void PipePolicy::parse(const std::string& policy) {
+    if (policy == "default" || policy == "adaptive" || policy == "max") {
+        mode = policy == "default" ? DEFAULT : policy == "adaptive" ? ADAPTIVE : MAX;
+        return;
+    }
+    char *end;
+    long long bytes = strtoll(policy.c_str(), &end, 10);
+    if (*end == 'K' || *end == 'k') {
+        bytes *= 1024;
+        ++end;
+    } else if (*end == 'M' || *end == 'm') {
+        bytes *= 1024 * 1024;
+        ++end;
+    }
+    if (end == policy.c_str() || *end || bytes <= 0) {
+        throw Command::CommandError("pipestat: invalid pipe size policy");
+    }
+    // the kernel allocates a power of two number of pages
+    long long rounded = sysconf(_SC_PAGESIZE);
+    while (rounded < bytes) {
+        rounded *= 2;
+    }
+    mode = STATIC;
+    size = min<long long>(rounded, maxSize());
+}
+
+// The size a new pipe gets, 0 leaves the kernel's default.
+int PipePolicy::initialSize() const {
+    switch (mode) {
+    case STATIC:
+        return min(size, maxSize());
+    case MAX:
+        return maxSize();
+    default:
+        return 0;
+    }
+}
+
+// The size a running pipe should have at this many bytes per second, a power
+// of two between the default and the maximum, or 0 to leave it alone.
+int PipePolicy::adaptedSize(double rate) const {
+    if (mode != ADAPTIVE) {
+        return 0;
+    }
+    double wanted = rate * PIPE_ADAPT_MS / 1000;
+    int size = PIPE_DEFAULT_SIZE;
+    while (size < wanted && size < maxSize()) {
+        size *= 2;
+    }
+    return min(size, maxSize());
+}
+
+std::string PipePolicy::describe() const {
+    switch (mode) {
+    case DEFAULT:
+        return "default";
+    case STATIC:
+        return "static " + _formatBytes(initialSize());
+    case ADAPTIVE:
+        return "adaptive, up to " + _formatBytes(maxSize());
+    default:
+        return "max " + _formatBytes(maxSize());
+    }
+}
+
+// Unprivileged processes cannot grow a pipe past this
+int PipePolicy::maxSize() {
+    ifstream file("/proc/sys/fs/pipe-max-size");
+    int size = 0;
+    if (!(file >> size) || size <= 0) {
+        size = 1024 * 1024;
+    }
+    return size;
+}
+
+/* -------------- JobsList::JobEntry -------------- */
+
+// A job is added right after its fork, or when it stops in the foreground,
+// and is our unreaped child either way, so its pid cannot have been reused
+// yet. An adopted job already comes with a pidfd.
+JobsList::JobEntry::JobEntry(Command *cmd, bool stopped) {
+    _start = time(nullptr);
+    _cmd = cmd;
+    _pid = cmd->pid();
+    _stopped = stopped;
+    _awaited = false;
+    _capture = nullptr;
+    AdoptedCommand *adopted = dynamic_cast<AdoptedCommand *>(cmd);
+    _pidfd = adopted ? fcntl(adopted->pidfd(), F_DUPFD_CLOEXEC, 0) : _pidfdOpen(_pid);
+}
+
+Command *JobsList::JobEntry::cmd() {
+    return _cmd;
+}
+
+bool &JobsList::JobEntry::stopped() {
+    return _stopped;
+}
+
+bool &JobsList::JobEntry::awaited() {
+    return _awaited;
+}
+
+pid_t JobsList::JobEntry::pid() const {
+    return _pid;
+}
+
+OutputCapture *JobsList::JobEntry::capture() {
+    return _capture;
+}
+
+void JobsList::JobEntry::sendSignal(int sig_num) {
+    _cmd->sendSignal(sig_num, _pidfd);
+}
+
+// Once the job leaves the list nothing signals it through its entry anymore.
+void JobsList::JobEntry::closePidfd() {
+    if (_pidfd >= 0) {
+        close(_pidfd);
+        _pidfd = -1;
+    }
+}
+
+/* -------------- JobsList -------------- */
+
+// statuses kept for wait when it never comes, before the oldest are dropped
+#define FINISHED_LIMIT (1024)
+
+JobsList::JobsList() {
+    FUNC_ENTRY()
+    _next_jid = 1;
+    _capture_on = false;
+    _capture_limit = 0;
+    _db = nullptr;
+    _db_owner = -1;
+    _table = nullptr;
+    _table_owner = -1;
+}
+
+JobsList::~JobsList() {
+    delete _table;
+}
+
+void JobsList::addJob(Command* cmd, bool stopped, OutputCapture *capture) {
+    FUNC_ENTRY()
+    removeFinishedJobs();
+    JobEntry *job = new JobEntry(cmd, stopped);
+    // a job coming back from the foreground gets its capture back
+    auto detached = _detached_captures.find(cmd->pid());
+    if (!capture && detached != _detached_captures.end()) {
+        capture = detached->second;
+        _detached_captures.erase(detached);
+    }
+    job->_capture = capture;
+
+    if (cmd->_jid == -1){
+        //JobEntry *job = new JobEntry(cmd, stopped);
+        job->_jid = _next_jid++;
+        cmd->_jid = job->_jid;
+        forgetFinished(job->_jid);
+        _jobs.push_back(job);
+    }
+
+    else{
+        //JobEntry *job = new JobEntry(cmd, stopped);
+        job->_jid = cmd->_jid;
+
+        auto it = _jobs.begin();
+        for (; it != _jobs.end(); ++it){
+            auto job2 = *it;
+            if (job2->_jid > job->_jid){
+                break;
+            }
+        }
+        _jobs.insert(it, job);
+
+        //  _jobs.push_back(job);
+    }
+
+    journal(cmd, stopped ? JOB_STOPPED : JOB_RUNNING);
+    publish();
+}
+
+void JobsList::removeJobById(int jid) {
+    FUNC_ENTRY()
+    if (_jobs.empty()) {
+        return;
+    }
+    for (std::list<JobEntry *>::iterator it = _jobs.begin(); it != _jobs.end();) {
+        if ((*it)->_jid == jid) {
+            // the job still writes to its capture while in the foreground
+            if ((*it)->_capture) {
+                _detached_captures[(*it)->pid()] = (*it)->_capture;
+            }
+            (*it)->closePidfd();
+            it = _jobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    publish();
+}
+
+void JobsList::removeFinishedJobs() {
+    FUNC_ENTRY()
+    bool reaped = false;
+    for (std::list<JobEntry *>::iterator it = _jobs.begin(); it != _jobs.end();) {
+        int status;
+        if (!(*it)->_awaited && (*it)->cmd()->reap(&status)) {
+            reaped = true;
+            if (_reaped_hook) {
+                _reaped_hook(*it, status);
+            }
+            FinishedJob finished = {(*it)->_jid, (*it)->cmd()->cmd_line(), status};
+            _finished.push_back(finished);
+            if (_finished.size() > FINISHED_LIMIT) {
+                _finished.pop_front();
+            }
+            journal((*it)->cmd(), JOB_DONE);
+            freeCapture(*it);
+            (*it)->closePidfd();
+            it = _jobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // queued jobs already own their jids
+    int last = _jobs.empty() ? 0 : _jobs.back()->_jid;
+    if (!_queue.empty()) {
+        last = max(last, _queue.back().jid);
+    }
+    _next_jid = last + 1;
+    if (reaped) {
+        publish();
+    }
+}
+
+void JobsList::printJobsList(bool verbose) {
+    FUNC_ENTRY()
+    removeFinishedJobs();
+    // queued jobs have no pid yet and count their time from submission
+    auto queued = _queue.begin();
+    auto printQueued = [&](const JobEntry *next) {
+        for (; queued != _queue.end() && (!next || queued->jid < next->_jid); ++queued) {
+            cout << "[" << queued->jid << "] " << queued->cmd_line << " : ";
+            cout << difftime(time(nullptr), queued->submitted) << " secs (queued)";
+            if (verbose) {
+                cout << " [priority " << queued->priority << "]";
+            }
+            cout << endl;
+        }
+    };
+    for (const JobEntry *job : _jobs) {
+        printQueued(job);
+        cout << "[" << job->_jid << "] " << job->_cmd->cmd_line();
+        cout << " : " << job->_cmd->pid() << " ";
+        cout << difftime(time(nullptr), job->_start) << " secs";
+        cout << job->_cmd->progress();
+        if (job->_stopped) {
+            cout << " (stopped)";
+        }
+        if (verbose) {
+            cout << JobPriority::describe(job->_cmd->pid());
+            cout << job->_cmd->details();
+        }
+        cout << endl;
+    }
+    printQueued(nullptr);
+}
+
+// Terminates every job and reaps it before returning. With a grace period all
+// groups get SIGTERM at once and are awaited together until the deadline, and
+// only the jobs still alive after it are escalated to SIGKILL.
+void JobsList::killAllJobs(int grace_ms) {
+    FUNC_ENTRY()
+    _queue.clear();
+    vector<pair<int, int>> reaped;
+    if (grace_ms > 0 && !_jobs.empty()) {
+        cout << "smash: sending SIGTERM signal to " << _jobs.size() << " jobs:" << endl;
+        for (JobEntry *job : _jobs) {
+            cout << job->_cmd->pid() << ": " << job->_cmd->cmd_line() << endl;
+            job->sendSignal(SIGTERM);
+            if (job->_stopped) {
+                job->sendSignal(SIGCONT);
+            }
+        }
+        if (waitJobs(getAllJobs(), false, grace_ms, reaped)) {
+            return;
+        }
+    }
+
+    cout << "smash: sending SIGKILL signal to " << _jobs.size() << " jobs:" << endl;
+    for (JobEntry *job : _jobs) {
+        cout << job->_cmd->pid() << ": " << job->_cmd->cmd_line() << endl;
+        job->sendSignal(SIGKILL);
+    }
+    waitJobs(vector<JobEntry *>(_jobs.begin(), _jobs.end()), false, -1, reaped);
+    for (JobEntry *job : _jobs) {
+        freeCapture(job);
+        job->closePidfd();
+    }
+    _jobs.clear();
+    publish();
+}
+
+bool JobsList::waitJobs(std::vector<JobEntry *> jobs, bool any, int timeout_ms,
+                        std::vector<std::pair<int, int>>& reaped) {
+    FUNC_ENTRY()
+    long deadline = _monotonicMillis() + timeout_ms;
+    int interrupts = SmallShell::getInstance().interrupts();
+    vector<int> pidfds(jobs.size(), -1);
+    size_t remaining = jobs.size();
+    int status;
+
+    // reap one job and drop it from the list as soon as it is known to be done
+    auto reap = [&](size_t i, int wstatus) {
+        reaped.push_back(std::make_pair(jobs[i]->_jid, wstatus));
+        journal(jobs[i]->_cmd, JOB_DONE);
+        freeCapture(jobs[i]);
+        removeJobById(jobs[i]->_jid);
+        if (pidfds[i] >= 0) {
+            close(pidfds[i]);
+            pidfds[i] = -1;
+        }
+        jobs[i] = nullptr;
+        remaining--;
+    };
+    auto done = [&]() {
+        return remaining == 0 || (any && !reaped.empty());
+    };
+    // a Ctrl-C at the prompt ends the wait early
+    auto interrupted = [&]() {
+        dispatchSignalEvents();
+        return SmallShell::getInstance().interrupts() != interrupts;
+    };
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; epfd >= 0 && i < jobs.size(); ++i) {
+        pidfds[i] = jobs[i]->_pidfd >= 0 ? fcntl(jobs[i]->_pidfd, F_DUPFD_CLOEXEC, 0) : -1;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        if (pidfds[i] < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, pidfds[i], &ev) < 0) {
+            close(epfd);
+            epfd = -1;
+        }
+    }
+
+    if (epfd >= 0) {
+        struct epoll_event events[64];
+        while (!done()) {
+            int timeout = timeout_ms < 0 ? -1 : max(0L, deadline - _monotonicMillis());
+            int n = epoll_wait(epfd, events, 64, timeout);
+            if (n < 0 && errno == EINTR) {
+                if (interrupted()) {
+                    break;
+                }
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            for (int k = 0; k < n; ++k) {
+                size_t i = events[k].data.u64;
+                if (jobs[i] && jobs[i]->_cmd->reap(&status)) {
+                    reap(i, status);
+                }
+            }
+        }
+        close(epfd);
+    } else {
+        // no pidfd support: block SIGCHLD and sleep in sigtimedwait between
+        // non-blocking waitid sweeps
+        sigset_t chld, old;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, &old);
+        while (!done()) {
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                siginfo_t info;
+                info.si_pid = 0;
+                if (jobs[i] && waitid(P_PID, jobs[i]->_cmd->pid(), &info, WEXITED | WNOHANG) == 0
+                    && info.si_pid != 0) {
+                    status = info.si_code == CLD_EXITED ? (info.si_status & 0xff) << 8
+                                                         : info.si_status & 0x7f;
+                    reap(i, status);
+                }
+            }
+            if (done()) {
+                break;
+            }
+            long left = deadline - _monotonicMillis();
+            if (timeout_ms >= 0 && left <= 0) {
+                break;
+            }
+            struct timespec ts = {left / 1000, (left % 1000) * 1000000L};
+            if (sigtimedwait(&chld, nullptr, timeout_ms < 0 ? nullptr : &ts) < 0 &&
+                errno == EINTR && interrupted()) {
+                break;
+            }
+        }
+        sigprocmask(SIG_SETMASK, &old, nullptr);
+    }
+
+    for (int fd : pidfds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return done();
+}
+
+// Resolves a job specifier in a single pass over the list: a job id (N or %N),
+// an id range (%N-%M), %all, %running, %stopped, or a pattern matched against
+// the command name (%sleep, %my_*). Given finished, jobs that were reaped but
+// not yet waited for match too and are added there; they count as running.
+std::vector<JobsList::JobEntry *> JobsList::getJobsBySpec(const std::string& spec,
+                                                          std::vector<FinishedJob> *finished) {
+    FUNC_ENTRY()
+    removeFinishedJobs();
+    string word = (!spec.empty() && spec[0] == '%') ? spec.substr(1) : spec;
+    if (_isNumber(word)) {
+        int jid = stoi(word);
+        for (const FinishedJob& job : _finished) {
+            if (finished && job.jid == jid) {
+                finished->push_back(job);
+                return vector<JobEntry *>();
+            }
+        }
+        return vector<JobEntry *>(1, getJobById(jid));
+    }
+
+    int low = 0, high = -1;
+    size_t dash = word.find('-', 1);
+    if (dash != string::npos) {
+        string first = word.substr(0, dash);
+        string last = word.substr(dash + 1);
+        if (!last.empty() && last[0] == '%') {
+            last.erase(0, 1);
+        }
+        if (_isNumber(first) && _isNumber(last)) {
+            low = stoi(first);
+            high = stoi(last);
+        }
+    }
+    if (high < 0 && (spec[0] != '%' || word.empty())) {
+        throw Command::CommandError("invalid arguments");
+    }
+
+    auto matches = [&](int jid, bool stopped, const string& line) {
+        if (high >= 0) {
+            return jid >= low && jid <= high;
+        } else if (word == "all") {
+            return true;
+        } else if (word == "running") {
+            return !stopped;
+        } else if (word == "stopped") {
+            return stopped;
+        }
+        string name = _trim(line).substr(0, _trim(line).find_first_of(WHITESPACE + "&"));
+        return fnmatch(word.c_str(), name.c_str(), 0) == 0;
+    };
+    vector<JobEntry *> ret;
+    for (JobEntry *job : _jobs) {
+        if (matches(job->_jid, job->_stopped, job->_cmd->cmd_line())) {
+            ret.push_back(job);
+        }
+    }
+    size_t found = 0;
+    for (const FinishedJob& job : _finished) {
+        if (finished && matches(job.jid, false, job.cmd_line)) {
+            finished->push_back(job);
+            found++;
+        }
+    }
+    if (ret.empty() && !found) {
+        throw Command::CommandError("no job matches " + spec);
+    }
+    return ret;
+}
+
+std::vector<JobsList::JobEntry *> JobsList::getAllJobs() {
+    removeFinishedJobs();
+    return vector<JobEntry *>(_jobs.begin(), _jobs.end());
+}
+
+std::vector<JobsList::FinishedJob> JobsList::getFinishedJobs() const {
+    return vector<FinishedJob>(_finished.begin(), _finished.end());
+}
+
+void JobsList::forgetFinished(int jid) {
+    for (auto it = _finished.begin(); it != _finished.end();) {
+        it = it->jid == jid ? _finished.erase(it) : next(it);
+    }
+}
+
+void JobsList::setReapedHook(std::function<void(JobEntry *, int)> hook) {
+    _reaped_hook = hook;
+}
+
+// A limit of 0 keeps the current one.
+void JobsList::setCapture(bool on, size_t limit) {
+    _capture_on = on;
+    if (limit) {
+        _capture_limit = limit;
+    }
+    drainCaptures();
+}
+
+OutputCapture *JobsList::startCapture() {
+    return _capture_on ? OutputCapture::create(_capture_limit) : nullptr;
+}
+
+// Pulls pending output of every captured job into its ring, a block at a
+// time. Each ring may hold the whole limit, so the total is enforced as the
+// output comes in: after every block the oldest output is evicted, starting
+// with captures of jobs that are now in the foreground, and the total kept
+// across jobs never exceeds the limit by more than one block.
+void JobsList::drainCaptures() {
+    FUNC_ENTRY()
+    vector<OutputCapture *> captures;
+    for (const auto& detached : _detached_captures) {
+        captures.push_back(detached.second);
+    }
+    for (JobEntry *job : _jobs) {
+        if (job->_capture) {
+            captures.push_back(job->_capture);
+        }
+    }
+    size_t total = 0;
+    for (OutputCapture *capture : captures) {
+        total += capture->size();
+    }
+    for (OutputCapture *capture : captures) {
+        size_t before = capture->size();
+        while (capture->fill(CAPTURE_BLOCK) > 0) {
+            total += capture->size() - before;
+            for (size_t i = 0; i < captures.size() && total > _capture_limit && _capture_limit > 0; ++i) {
+                size_t drop = min(total - _capture_limit, captures[i]->size());
+                captures[i]->evict(drop);
+                total -= drop;
+            }
+            before = capture->size();
+        }
+    }
+    for (auto it = _detached_captures.begin(); it != _detached_captures.end();) {
+        if (it->second->eof()) {
+            delete it->second;
+            it = _detached_captures.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Re-adopts the jobs that outlived the previous smash and from then on keeps
+// the journal in step with the list.
+void JobsList::setJobDb(JobDb *db) {
+    _db = db;
+    _db_owner = getpid();
+    struct timespec boot;
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    long ticks = sysconf(_SC_CLK_TCK);
+    for (auto& survivor : db->takeSurvivors()) {
+        const JobRecord& record = survivor.first;
+        Command *cmd = new AdoptedCommand(record.cmd_line, record.pid, survivor.second);
+        cmd->_jid = record.jid;
+        _start_times[record.pid] = record.start_time;
+        addJob(cmd, JobDb::stopped(record.pid));
+        getJobById(record.jid)->_start = time(nullptr) - (boot.tv_sec - record.start_time / ticks);
+    }
+}
+
+// Appends a job's new state to the journal. Forked job leaders share the
+// mapping but must leave it to the smash.
+void JobsList::journal(Command *cmd, JobState state) {
+    if (!_db || getpid() != _db_owner) {
+        return;
+    }
+    pid_t pid = cmd->pid();
+    auto it = _start_times.find(pid);
+    if (it == _start_times.end()) {
+        if (state == JOB_DONE) {
+            return;
+        }
+        it = _start_times.insert(make_pair(pid, JobDb::startTime(pid))).first;
+    }
+    _db->append(cmd->_jid, pid, it->second, state, cmd->cmd_line());
+    if (state == JOB_DONE) {
+        _start_times.erase(it);
+    }
+}
+
+void JobsList::setJobTable(JobTable *table) {
+    _table = table;
+    _table_owner = getpid();
+    publish();
+}
+
+// Rewrites the exported job table from the list and the queue, with CPU time
+// and resident size of each job's leader taken from /proc.
+void JobsList::publish() {
+    if (!_table || getpid() != _table_owner) {
+        return;
+    }
+    long ticks = sysconf(_SC_CLK_TCK);
+    long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    vector<JobTableEntry> entries;
+    auto queued = _queue.begin();
+    auto add = [&](int jid, pid_t pid, JobState state, time_t start, const string& cmd_line) {
+        JobTableEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.jid = jid;
+        entry.pid = pid;
+        entry.state = state;
+        entry.start = start;
+        vector<string> stat = pid > 0 ? _procStat(pid) : vector<string>();
+        if (stat.size() > 21) {
+            entry.utime_ms = stoull(stat[11]) * 1000 / ticks;
+            entry.stime_ms = stoull(stat[12]) * 1000 / ticks;
+            entry.rss_kb = stoull(stat[21]) * page_kb;
+        }
+        strncpy(entry.cmd_line, cmd_line.c_str(), JOBTABLE_CMD_LENGTH - 1);
+        entries.push_back(entry);
+    };
+    auto addQueued = [&](int below) {
+        for (; queued != _queue.end() && queued->jid < below; ++queued) {
+            add(queued->jid, 0, JOB_QUEUED, queued->submitted, queued->cmd_line);
+        }
+    };
+    for (const JobEntry *job : _jobs) {
+        addQueued(job->_jid);
+        add(job->_jid, job->_pid, job->_stopped ? JOB_STOPPED : JOB_RUNNING, job->_start,
+            job->_cmd->cmd_line());
+    }
+    addQueued(INT_MAX);
+    _table->publish(entries);
+}
+
+void JobsList::freeCapture(JobEntry *job) {
+    delete job->_capture;
+    job->_capture = nullptr;
+}
+
+// Queued jobs get their jid right away, so they can be listed and cancelled.
+int JobsList::enqueue(const std::string& cmd_line, int priority) {
+    removeFinishedJobs();
+    QueuedJob queued;
+    queued.jid = _next_jid++;
+    forgetFinished(queued.jid);
+    queued.priority = priority;
+    queued.cmd_line = cmd_line;
+    queued.submitted = time(nullptr);
+    _queue.push_back(queued);
+    publish();
+    return queued.jid;
+}
+
+// Takes the queued job with the highest priority, the earliest submitted
+// among equals, if the limits admit one more job. Stopped jobs do not count
+// as running. Load and pressure are only checked while something runs, so
+// the queue cannot stall on load it is not responsible for; they are
+// reported through pressure since no SIGCHLD will come to retry.
+bool JobsList::dequeue(std::string& cmd_line, int& jid, bool& pressure) {
+    if (_queue.empty()) {
+        return false;
+    }
+    removeFinishedJobs();
+    int running = 0;
+    for (const JobEntry *job : _jobs) {
+        running += !job->_stopped;
+    }
+    if (_queue_limits.max_jobs > 0 && running >= _queue_limits.max_jobs) {
+        return false;
+    }
+    if (running > 0 && _queue_limits.overloaded()) {
+        pressure = true;
+        return false;
+    }
+    auto best = _queue.begin();
+    for (auto it = _queue.begin(); it != _queue.end(); ++it) {
+        if (it->priority > best->priority) {
+            best = it;
+        }
+    }
+    cmd_line = best->cmd_line;
+    jid = best->jid;
+    _queue.erase(best);
+    publish();
+    return true;
+}
+
+// Matches queued jobs by jid or jid range, or all of them with %all.
+std::vector<int> JobsList::getQueuedBySpec(const std::string& spec) {
+    string word = (!spec.empty() && spec[0] == '%') ? spec.substr(1) : spec;
+    int low = 0, high = -1;
+    size_t dash = word.find('-', 1);
+    if (_isNumber(word)) {
+        low = high = stoi(word);
+    } else if (word == "all" && spec[0] == '%') {
+        high = INT_MAX;
+    } else if (dash != string::npos) {
+        string first = word.substr(0, dash);
+        string last = word.substr(dash + 1);
+        if (!last.empty() && last[0] == '%') {
+            last.erase(0, 1);
+        }
+        if (_isNumber(first) && _isNumber(last)) {
+            low = stoi(first);
+            high = stoi(last);
+        }
+    }
+    vector<int> ret;
+    for (const QueuedJob& queued : _queue) {
+        if (queued.jid >= low && queued.jid <= high) {
+            ret.push_back(queued.jid);
+        }
+    }
+    return ret;
+}
+
+void JobsList::cancelQueued(int jid) {
+    for (auto it = _queue.begin(); it != _queue.end(); ++it) {
+        if (it->jid == jid) {
+            _queue.erase(it);
+            publish();
+            return;
+        }
+    }
+}
+
+bool JobsList::queueEmpty() const {
+    return _queue.empty();
+}
+
+QueueLimits& JobsList::queueLimits() {
+    return _queue_limits;
+}
+
+PipePolicy& JobsList::pipePolicy() {
+    return _pipe_policy;
+}
+
+// Settings applied to every background job when it is launched.
+JobPriority& JobsList::defaultPriority() {
+    return _default_priority;
+}
+
+JobsList::JobEntry *JobsList::getJobById(int jid) {
+    FUNC_ENTRY()
+    for (JobEntry *job : _jobs) {
+        if (job->_jid == jid) {
+            return job;
+        }
+    }
+    throw Command::CommandError("job-id " + to_string(jid) + " does not exist");
+}
+
+JobsList::JobEntry *JobsList::getLastJob(int* lastJobId) {
+    FUNC_ENTRY()
+    if (_jobs.empty()) {
+        throw Command::CommandError("jobs list is empty");
+    }
+    JobEntry *ret = _jobs.back();
+    if (ret->_capture) {
+        _detached_captures[ret->pid()] = ret->_capture;
+    }
+    ret->closePidfd();
+    _jobs.pop_back();
+    if (lastJobId) {
+        *lastJobId = ret->_jid;
+    }
+    return ret;
+}
+
+JobsList::JobEntry *JobsList::getLastStoppedJob(int* lastJobId) {
+    FUNC_ENTRY()
+    if (_jobs.empty()) {
+        throw Command::CommandError("there is no stopped jobs to resume");
+    }
+    for (auto it = _jobs.rbegin(); it != _jobs.rend(); ++it) {
+        if ((*it)->_stopped) {
+            JobEntry *ret = *it;
+            if (lastJobId) {
+                *lastJobId = ret->_jid;
+            }
+            return ret;
+        }
+    }
+    throw Command::CommandError("there is no stopped jobs to resume");
+}
+
+/* -------------- JobsCommand -------------- */
+
+JobsCommand::JobsCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    _jobs = jobs;
+    _verbose = args[1] && strcmp(args[1], "-v") == 0;
+}
+
+void JobsCommand::execute() {
+    _jobs->printJobsList(_verbose);
+}
+
+/* -------------- ForegroundCommand -------------- */
+
+ForegroundCommand::ForegroundCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+
+    int jid;
+    JobsList::JobEntry *job;
+	if (!args[1]) {
+		try {
+		 job = jobs->getLastJob(&jid);
+		} catch (Command::CommandError& e) {
+			throw Command::CommandError("fg: " + e.what());
+        }
+	} else {
+        if (!_isNumber(string(args[1])) || args[2]) {
+            throw Command::CommandError("fg: invalid arguments");
+        }
+
+        jid = stoi(args[1]);
+        try {
+            job = jobs->getJobById(jid);
+        } catch (Command::CommandError& e) {
+            throw Command::CommandError("fg: " + e.what());
+        }
+    }
+    jobs->removeJobById(jid);
+    _cmd = job->cmd();
+}
+
+void ForegroundCommand::execute() {
+    cout << _cmd->cmd_line() << " : " << _cmd->pid() << endl;
+    _cmd->sendSignal(SIGCONT);
+    _smash->waitForeground(_cmd);
+}
+
+/* -------------- BackgroundCommand -------------- */
+
+BackgroundCommand::BackgroundCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+
+    int jid;
+    JobsList::JobEntry *job;
+	if (!args[1]) {
+		try {
+		 job = jobs->getLastStoppedJob(&jid);
+		} catch (Command::CommandError& e) {
+			throw Command::CommandError("bg: " + e.what());
+        }
+        _targets.push_back(job);
+        return;
+	}
+    if (args[2]) {
+        throw Command::CommandError("bg: invalid arguments");
+    }
+
+    string spec(args[1]);
+    vector<JobsList::JobEntry *> matched;
+    try {
+        matched = jobs->getJobsBySpec(spec);
+    } catch (Command::CommandError& e) {
+        throw Command::CommandError("bg: " + e.what());
+    }
+    if (_isNumber(spec[0] == '%' ? spec.substr(1) : spec)) {
+        if (!matched[0]->stopped()) {
+            throw Command::CommandError("bg: job-id " + to_string(stoi(spec.substr(spec[0] == '%')))
+            + " is already running in the background");
+        }
+    }
+    for (JobsList::JobEntry *stopped : matched) {
+        if (stopped->stopped()) {
+            _targets.push_back(stopped);
+        }
+    }
+    if (_targets.empty()) {
+        throw Command::CommandError("bg: there is no stopped jobs to resume");
+    }
+}
+
+void BackgroundCommand::execute() {
+    for (JobsList::JobEntry *job : _targets) {
+        cout << job->cmd()->cmd_line() << " : " << job->cmd()->pid() << endl;
+        job->stopped() = false;
+        job->sendSignal(SIGCONT);
+    }
+}
+
+/* -------------- WaitCommand -------------- */
+
+WaitCommand::WaitCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _jobs = jobs;
+    _all = true;
+    _any = false;
+    _timeout_ms = -1;
+    for (int i = 1; args[i]; ++i) {
+        string arg(args[i]);
+        if (arg == "-n") {
+            _any = true;
+        } else if (arg == "-t") {
+            char *end = nullptr;
+            double secs = args[i + 1] ? strtod(args[i + 1], &end) : -1;
+            if (!end || *end || secs < 0) {
+                throw Command::CommandError("wait: invalid arguments");
+            }
+            _timeout_ms = secs * 1000;
+            ++i;
+        } else {
+            _all = false;
+            try {
+                vector<JobsList::JobEntry *> matched = jobs->getJobsBySpec(arg, &_finished);
+                _targets.insert(_targets.end(), matched.begin(), matched.end());
+            } catch (const CommandError& e) {
+                throw CommandError("wait: " + e.what());
+            }
+        }
+    }
+}
+
+// Jobs that finished before wait ran, and were reaped by the prompt, are
+// reported first, and "wait -n" takes one of them without blocking. A plain
+// "wait" also waits for the queue to drain: it then returns after each job to
+// let the queue launch the next ones. The status is that of the last job
+// reported, or 130 when a Ctrl-C ends the wait.
+void WaitCommand::execute() {
+    FUNC_ENTRY()
+    auto report = [&](int jid, int status) {
+        if (WIFSIGNALED(status)) {
+            cout << "smash: job-id " << jid << " was killed by signal " << WTERMSIG(status) << endl;
+            smash_status() = 128 + WTERMSIG(status);
+        } else {
+            cout << "smash: job-id " << jid << " exited with status " << WEXITSTATUS(status) << endl;
+            smash_status() = WEXITSTATUS(status);
+        }
+    };
+    if (_all) {
+        _finished = _jobs->getFinishedJobs();
+    }
+    set<int> reported;
+    for (const JobsList::FinishedJob& job : _finished) {
+        if (reported.insert(job.jid).second) {
+            report(job.jid, job.status);
+            _jobs->forgetFinished(job.jid);
+        }
+        if (_any) {
+            return;
+        }
+    }
+    if (!_all && _targets.empty()) {
+        return;
+    }
+
+    bool drain = _all && !_any;
+    int interrupts = SmallShell::getInstance().interrupts();
+    long deadline = _monotonicMillis() + _timeout_ms;
+    bool completed, queued;
+    do {
+        if (_all) {
+            _targets = _jobs->getAllJobs();
+        }
+        // launching queued jobs must not reap the ones still to report
+        for (JobsList::JobEntry *job : _targets) {
+            job->awaited() = drain;
+        }
+        int timeout = _timeout_ms < 0 ? -1 : max(0L, deadline - _monotonicMillis());
+        queued = drain && !_jobs->queueEmpty();
+        vector<pair<int, int>> reaped;
+        completed = _jobs->waitJobs(_targets, _any || queued, timeout, reaped);
+        for (const pair<int, int>& job : reaped) {
+            report(job.first, job.second);
+        }
+        if (drain) {
+            SmallShell::getInstance().runQueue();
+        }
+    } while (completed && queued);
+    for (JobsList::JobEntry *job : _targets) {
+        job->awaited() = false;
+    }
+    if (SmallShell::getInstance().interrupts() != interrupts) {
+        smash_status() = 130;
+    } else if (!completed) {
+        throw Command::CommandError("wait: timed out");
+    }
+}
+
+/* -------------- QuitCommand -------------- */
+
+QuitCommand::QuitCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    _kill = false;
+    _grace_ms = 0;
+    _jobs = jobs;
+    if (args[1] && strcmp(args[1], "kill") == 0) {
+        _kill = true;
+        if (args[2] && strcmp(args[2], "--grace") == 0) {
+            char *end = nullptr;
+            double secs = args[3] ? strtod(args[3], &end) : -1;
+            if (!end || *end || secs < 0) {
+                throw Command::CommandError("quit: invalid arguments");
+            }
+            _grace_ms = secs * 1000;
+        }
+    }
+}
+
+void QuitCommand::execute() {
+    if (_kill) {
+        _jobs->killAllJobs(_grace_ms);
+    }
+}
+
+/* -------------- KillCommand -------------- */
+
+KillCommand::KillCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+
+    if (!args[1] || !args[2] || args[1][0] != '-' || !_isNumber(string(args[1] + 1))
+    || args[3]) {
+        throw Command::CommandError("kill: invalid arguments");
+    }
+
+    // a queued job is not signalled but taken off the queue
+    _jobs = jobs;
+    _queued = jobs->getQueuedBySpec(args[2]);
+    try {
+        _targets = jobs->getJobsBySpec(args[2]);
+    } catch (const CommandError& e) {
+        if (_queued.empty()) {
+            throw CommandError("kill: " + e.what());
+        }
+    }
+    _signum = stoi(args[1] + 1);
+    if (_signum > SIGRTMAX || _signum < 1){
+        throw Command::CommandError("kill: invalid arguments");
+    }
+}
+
+void KillCommand::execute() {
+    FUNC_ENTRY()
+    for (JobsList::JobEntry *job : _targets) {
+        cout << "signal number " << _signum << " was sent to pid " << job->cmd()->pid() << endl;
+        job->sendSignal(_signum);
+        if (_signum == SIGSTOP || _signum == SIGTSTP || _signum == SIGTTIN || _signum == SIGTTOU) {
+            job->stopped() = true;
+        } else if (_signum == SIGCONT) {
+            job->stopped() = false;
+        }
+    }
+    for (int jid : _queued) {
+        _jobs->cancelQueued(jid);
+        cout << "job-id " << jid << " was removed from the queue" << endl;
+    }
+}
+
+/* -------------- PgrepCommand -------------- */
+
+PgrepCommand::PgrepCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    bool pkill = strncmp(args[0], "pkill", 5) == 0;
+    string name = pkill ? "pkill" : "pgrep";
+    _long = false;
+    _signum = pkill ? SIGTERM : 0;
+    int i = 1;
+    if (pkill && args[1] && args[1][0] == '-' && _isNumber(args[1] + 1)) {
+        _signum = stoi(args[1] + 1);
+        if (_signum > SIGRTMAX || _signum < 1) {
+            throw Command::CommandError(name + ": invalid arguments");
+        }
+        i = 2;
+    }
+    const char *pattern = nullptr;
+    for (; args[i]; i++) {
+        string arg(args[i]);
+        if (arg == "-f") {
+            _query.full = true;
+        } else if (arg == "-l" && !pkill) {
+            _long = true;
+        } else if (arg == "-P" && args[i + 1] && _isNumber(args[i + 1])) {
+            _query.ppid = stoi(args[++i]);
+        } else if (arg == "-u" && args[i + 1]) {
+            struct passwd *pw = getpwnam(args[++i]);
+            if (!pw && !_isNumber(args[i])) {
+                throw Command::CommandError(name + ": invalid user");
+            }
+            _query.by_uid = true;
+            _query.uid = pw ? pw->pw_uid : stoul(args[i]);
+        } else if (arg[0] != '-' && !pattern) {
+            pattern = args[i];
+        } else {
+            throw Command::CommandError(name + ": invalid arguments");
+        }
+    }
+    // with nothing to match on it would reach every process
+    if (!pattern && !_query.by_uid && _query.ppid < 0) {
+        throw Command::CommandError(name + ": invalid arguments");
+    }
+    if (pattern) {
+        if (regcomp(&_pattern, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+            throw Command::CommandError(name + ": invalid pattern");
+        }
+        _query.pattern = &_pattern;
+    }
+    _query.cmdlines = _long && _query.full;
+    _query.identify = _signum != 0;
+}
+
+PgrepCommand::~PgrepCommand() {
+    if (_query.pattern) {
+        regfree(&_pattern);
+    }
+}
+
+// Like pgrep and pkill the status is 1 when nothing matched. A process that
+// exits between the scan and its signal no longer counts.
+void PgrepCommand::execute() {
+    FUNC_ENTRY()
+    vector<ProcMatch> matches;
+    if (!procScan(_query, matches)) {
+        perror("smash error: getdents64 failed");
+        smash_status() = 1;
+        return;
+    }
+    size_t found = 0;
+    for (const ProcMatch& match : matches) {
+        if (_signum) {
+            if (procSignal(match, _signum) < 0) {
+                if (errno != ESRCH) {
+                    perror("smash error: kill failed");
+                }
+                continue;
+            }
+        } else if (_long) {
+            cout << match.pid << " " << (match.cmdline.empty() ? match.name : match.cmdline) << "\n";
+        } else {
+            cout << match.pid << "\n";
+        }
+        found++;
+    }
+    cout.flush();
+    smash_status() = found ? 0 : 1;
+}
+
+/* -------------- ForkedBuiltinCommand -------------- */
+
+ForkedBuiltinCommand::ForkedBuiltinCommand(const char* cmd_line, Command *cmd):
+    Command(cmd_line),
+    _cmd(cmd) {}
+
+void ForkedBuiltinCommand::execute() {
+    FUNC_ENTRY()
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+    } else if (pid == 0) {
+        _smash->setJobGroup(0);
+        _setupJobLeader();
+        _smash->_status = 0;
+        try {
+            _cmd->execute();
+        } catch (const Command::CommandError& e) {
+            cerr << "smash error: " << e.what() << endl;
+            _exitChild(1);
+        }
+        _exitChild(_smash->lastStatus());
+    } else {
+        _pid = pid;
+        _group = _smash->setJobGroup(pid);
+        _smash->waitForeground(this);
+    }
+}
+
+/* -------------- RedirectionCommand -------------- */
+
+RedirectionCommand::RedirectionCommand(const char* cmd_line):
+    Command(cmd_line) {
+    FUNC_ENTRY()
+    string _cmd_line(cmd_line);
+    _background_cmd = _isBackgroundComamnd(cmd_line);
+    _removeBackgroundSign(_cmd_line);
+    size_t pos = _cmd_line.find('>');
+    if (pos > 0 && _cmd_line[pos - 1] == '|') {
+        // cmd |> a b c
+        std::istringstream targets(_cmd_line.substr(pos + 1));
+        for (string filename; targets >> filename;) {
+            _targets.push_back(Target{filename, false});
+        }
+        if (_targets.empty()) {
+            throw Command::CommandError("|>: invalid arguments");
+        }
+        _cmd = _smash->CreateCommand(_trim(_cmd_line.substr(0, pos - 1)).c_str());
+        return;
+    }
+    // cmd > a >> b ...
+    _cmd = _smash->CreateCommand(_trim(_cmd_line.substr(0, pos)).c_str());
+    while (pos != string::npos) {
+        bool append = _cmd_line.compare(pos, 2, ">>") == 0;
+        size_t start = pos + (append ? 2 : 1);
+        pos = _cmd_line.find('>', start);
+        string filename = _trim(_cmd_line.substr(start, pos == string::npos ? string::npos : pos - start));
+        if (!filename.empty()) {
+            _targets.push_back(Target{filename, append});
+        }
+    }
+}
+
+void RedirectionCommand::execute() {
+    FUNC_ENTRY()
+    OutputCapture *capture = _background_cmd ? _smash->_job_list.startCapture() : nullptr;
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+        delete capture;
+    } else if (pid == 0) {
+        _smash->setJobGroup(0);
+        _setupJobLeader();
+        if (capture) {
+            capture->attach();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.defaultPriority().apply(0, false);
+        }
+        if (_targets.size() > 1) {
+            fanOut();
+        }
+        close(1);
+        if (!_targets.empty()) {
+            openTarget(_targets[0]);
+        }
+        _smash->_status = 0;
+        _cmd->execute();
+        _exitChild(_smash->lastStatus());
+    } else {
+        _pid = pid;
+        _group = _smash->setJobGroup(pid);
+        if (capture) {
+            capture->closeWriter();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.addJob(this, false, capture);
+        } else {
+            _smash->waitForeground(this);
+        }
+    }
+}
+
+int RedirectionCommand::openTarget(const Target& target) {
+    if (target.append) {
+        return open(target.filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+    }
+    return open(target.filename.c_str(), O_WRONLY | O_CREAT, 0666);
+}
+
+// Moves exactly len bytes from a pipe to fd. splice() keeps the data in the
+// kernel; targets it rejects (e.g. append-mode files on older kernels) fall
+// back to read/write.
+static bool _drainPipe(int pipe_fd, int fd, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(pipe_fd, nullptr, fd, nullptr, len, SPLICE_F_MOVE);
+        if (n < 0 && (errno == EINVAL || errno == EBADF)) {
+            char buf[4096];
+            n = read(pipe_fd, buf, std::min(len, sizeof(buf)));
+            for (ssize_t done = 0, w; n > 0 && done < n; done += w) {
+                if ((w = write(fd, buf + done, n - done)) < 0) {
+                    return false;
+                }
+            }
+        }
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+// Runs the command with stdout on a pipe and duplicates that stream into every
+// target. tee() clones the pending pipe buffers into a scratch pipe per target
+// without consuming them, so the bytes are never copied through user space.
+void RedirectionCommand::fanOut() {
+    FUNC_ENTRY()
+    std::vector<int> fds;
+    for (const Target& target : _targets) {
+        int fd = openTarget(target);
+        if (fd < 0) {
+            perror("smash error: open failed");
+            _exitChild(1);
+        }
+        fds.push_back(fd);
+    }
+    int in[2];
+    if (pipe(in) < 0) {
+        perror("smash error: pipe failed");
+        _exitChild(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+        _exitChild(1);
+    } else if (pid == 0) {
+        dup2(in[1], 1);
+        close(in[0]);
+        close(in[1]);
+        for (int fd : fds) {
+            close(fd);
+        }
+        _smash->_status = 0;
+        _cmd->execute();
+        _exitChild(_smash->lastStatus());
+    }
+    close(in[1]);
+
+    // a scratch pipe as large as the source always takes a whole tee()
+    int size = fcntl(in[0], F_GETPIPE_SZ);
+    std::vector<int> scratch(2 * (fds.size() - 1));
+    for (size_t i = 0; i + 1 < fds.size(); ++i) {
+        if (pipe(&scratch[2 * i]) < 0) {
+            perror("smash error: pipe failed");
+            _exitChild(1);
+        }
+        fcntl(scratch[2 * i + 1], F_SETPIPE_SZ, size);
+    }
+
+    bool ok = true;
+    while (ok) {
+        ssize_t len = tee(in[0], scratch[1], size, 0);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            ok = len == 0;
+            break;
+        }
+        for (size_t i = 1; ok && i + 1 < fds.size(); ++i) {
+            ssize_t n;
+            while ((n = tee(in[0], scratch[2 * i + 1], len, 0)) < 0 && errno == EINTR) {}
+            ok = n == len;
+        }
+        for (size_t i = 0; ok && i + 1 < fds.size(); ++i) {
+            ok = _drainPipe(scratch[2 * i], fds[i], len);
+        }
+        // the last target consumes the source
+        ok = ok && _drainPipe(in[0], fds.back(), len);
+    }
+    if (!ok) {
+        perror("smash error: tee failed");
+    }
+    close(in[0]);
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("smash error: waitpid failed");
+    }
+    _exitChild(ok && WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+/* -------------- PipeCommand -------------- */
+
+#define PIPE_SAMPLE_MS (250)
+
+PipeCommand::PipeCommand(const char* cmd_line):
+    Command(cmd_line) {
+    FUNC_ENTRY()
+
+    size_t pos;
+    string _cmd_line_2;
+    string _cmd_line(cmd_line);
+    _background_cmd = _isBackgroundComamnd(cmd_line);
+    _removeBackgroundSign(_cmd_line);
+    if (_isRegularPipe(_cmd_line)) {
+        pos = _cmd_line.find('|');
+        while (_cmd_line[pos + 1] == '>') {
+            pos = _cmd_line.find('|', pos + 2);
+        }
+        _cmd_line_2 = _cmd_line.substr(pos + 1, _cmd_line.length());
+    } else {
+        pos = _cmd_line.find("|&");
+        _cmd_line_2 = _cmd_line.substr(pos + 2, _cmd_line.length());
+    }
+    _cmds[0] = _smash->CreateCommand(_trim(_cmd_line.substr(0, pos)).c_str());
+    _cmds[1] = _smash->CreateCommand(_trim(_cmd_line_2).c_str());
+
+    void *shared = mmap(nullptr, sizeof(Stats), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        throw Command::CommandError("pipe: cannot allocate statistics");
+    }
+    _stats = static_cast<Stats *>(shared);
+    memset(shared, 0, sizeof(Stats));
+    _last_ticks[0] = _last_ticks[1] = 0;
+    _last_written = 0;
+}
+
+PipeCommand::~PipeCommand() {
+    munmap(_stats, sizeof(Stats));
+}
+
+void PipeCommand::execute() {
+    FUNC_ENTRY()
+    // a leader process owns the job's process group and waits for both stages
+    OutputCapture *capture = _background_cmd ? _smash->_job_list.startCapture() : nullptr;
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+        delete capture;
+    } else if (pid == 0) {
+        _smash->setJobGroup(0);
+        _setupJobLeader();
+        if (capture) {
+            capture->attach();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.defaultPriority().apply(0, false);
+        }
+        runStages();
+    } else {
+        _pid = pid;
+        _group = _smash->setJobGroup(pid);
+        if (capture) {
+            capture->closeWriter();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.addJob(this, false, capture);
+        } else {
+            _smash->waitForeground(this);
+        }
+    }
+}
+
+void PipeCommand::runStages() {
+    FUNC_ENTRY()
+    int _pipe[2];
+    pipe(_pipe);
+    int size = _smash->_job_list.pipePolicy().initialSize();
+    if (size > 0) {
+        fcntl(_pipe[1], F_SETPIPE_SZ, size);
+    }
+    int _out = _isRegularPipe(cmd_line()) ? 1 : 2;
+    pid_t pid_1 = fork();
+    if (pid_1 < 0) {
+        perror("smash error: fork failed");
+    } else if (pid_1 == 0) {
+        dup2(_pipe[1], _out);
+        close(_pipe[0]);
+        close(_pipe[1]);
+        _cmds[0]->execute();
+        _exitChild(0);
+    }
+    pid_t pid_2 = fork();
+    if (pid_2 < 0) {
+        perror("smash error: fork failed");
+    } else if (pid_2 == 0) {
+        dup2(_pipe[0], 0);
+        close(_pipe[0]);
+        close(_pipe[1]);
+        _smash->_status = 0;
+        _cmds[1]->execute();
+        _exitChild(_smash->lastStatus());
+    }
+    close(_pipe[0]);
+    close(_pipe[1]);
+
+    // the pipeline ends with its second stage, until then it is sampled
+    // every PIPE_SAMPLE_MS
+    pid_t pids[2] = {pid_1, pid_2};
+    int pidfd = pid_2 > 0 ? _pidfdOpen(pid_2) : -1;
+    if (pidfd >= 0) {
+        struct pollfd pfd = {pidfd, POLLIN, 0};
+        long last = _monotonicMillis();
+        while (poll(&pfd, 1, PIPE_SAMPLE_MS) <= 0) {
+            long now = _monotonicMillis();
+            if (now - last >= PIPE_SAMPLE_MS) {
+                sample(pids, now - last);
+                last = now;
+            }
+        }
+        close(pidfd);
+    }
+    int status = 0;
+    if (waitpid(pid_1, nullptr, 0) < 0) {
+        perror("smash error: waitpid failed");
+    }
+    if (waitpid(pid_2, &status, 0) < 0) {
+        perror("smash error: waitpid failed");
+    }
+    _exitChild(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+// CPU ticks used and bytes written by a process and everything it forked
+static void _treeUsage(pid_t pid, unsigned long long& ticks, unsigned long long& written) {
+    vector<string> stat = _procStat(pid);
+    if (stat.size() > 12) {
+        ticks += stoull(stat[11]) + stoull(stat[12]);
+    }
+    ifstream io("/proc/" + to_string(pid) + "/io");
+    string key;
+    unsigned long long value;
+    while (io >> key >> value) {
+        if (key == "wchar:") {
+            written += value;
+        }
+    }
+    ifstream children("/proc/" + to_string(pid) + "/task/" + to_string(pid) + "/children");
+    for (pid_t child; children >> child;) {
+        _treeUsage(child, ticks, written);
+    }
+}
+
+// Measures the fill level of the pipe, the throughput into it and each
+// stage's CPU use, and resizes the pipe under the adaptive policy.
+void PipeCommand::sample(pid_t pids[2], long elapsed_ms) {
+    // the pipe is reopened through the reader's stdin each time, a descriptor
+    // held by the leader would keep the writer from ever getting EPIPE
+    string path = "/proc/" + to_string(pids[1]) + "/fd/0";
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    int capacity = fcntl(fd, F_GETPIPE_SZ);
+    int fill = 0;
+    if (capacity <= 0 || ioctl(fd, FIONREAD, &fill) < 0) {
+        close(fd);
+        return;
+    }
+
+    static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    double seconds = elapsed_ms / 1000.0;
+    unsigned long long written[2] = {0, 0};
+    double cpu[2];
+    for (int i = 0; i < 2; ++i) {
+        unsigned long long ticks = 0;
+        _treeUsage(pids[i], ticks, written[i]);
+        // a stage's processes take their counters with them when they exit
+        unsigned long long used = ticks > _last_ticks[i] ? ticks - _last_ticks[i] : 0;
+        cpu[i] = _stats->sampled ? used / (double)ticks_per_sec / seconds : 0;
+        _last_ticks[i] = ticks;
+    }
+    unsigned long long delta = written[0] > _last_written ? written[0] - _last_written : 0;
+    _last_written = written[0];
+    double rate = delta / seconds;
+
+    // smoothed over the last few samples, the first one taken as is
+    double weight = _stats->sampled ? 0.5 : 1;
+    _stats->bytes += delta;
+    _stats->rate = weight * rate + (1 - weight) * _stats->rate;
+    _stats->fill_avg = weight * fill / capacity + (1 - weight) * _stats->fill_avg;
+    for (int i = 0; i < 2; ++i) {
+        _stats->cpu[i] = weight * cpu[i] + (1 - weight) * _stats->cpu[i];
+    }
+    _stats->fill = fill;
+
+    // resized only when off by a factor of two, so it does not flap
+    int wanted = _smash->_job_list.pipePolicy().adaptedSize(_stats->rate);
+    if (wanted > 0 && (wanted >= 2 * capacity || 2 * wanted <= capacity) &&
+        fcntl(fd, F_SETPIPE_SZ, wanted) >= 0) {
+        capacity = fcntl(fd, F_GETPIPE_SZ);
+        _stats->resizes++;
+    }
+    _stats->capacity = capacity;
+    _stats->sampled = true;
+    close(fd);
+}
+
+// A pipeline of more than two stages nests the rest in its second command
+std::vector<PipeCommand *> PipeCommand::chain() {
+    vector<PipeCommand *> pipes(1, this);
+    PipeCommand *next;
+    while ((next = dynamic_cast<PipeCommand *>(pipes.back()->_cmds[1]))) {
+        pipes.push_back(next);
+    }
+    return pipes;
+}
+
+// The slow stage is the one whose input backs up while its output runs dry:
+// a pipe that stays full waits for its reader, an empty one for its writer.
+std::string PipeCommand::bottleneck() {
+    vector<PipeCommand *> pipes = chain();
+    for (PipeCommand *pipe : pipes) {
+        if (!pipe->_stats->sampled) {
+            return "";
+        }
+    }
+    for (size_t i = 0; i <= pipes.size(); ++i) {
+        bool backed_up = i == 0 || pipes[i - 1]->_stats->fill_avg >= 0.75;
+        bool dry = i == pipes.size() || pipes[i]->_stats->fill_avg <= 0.25;
+        if (backed_up && dry) {
+            return i < pipes.size() ? pipes[i]->_cmds[0]->cmd_line()
+                                    : pipes.back()->_cmds[1]->cmd_line();
+        }
+    }
+    return "";
+}
+
+// Only once data moved, "jobs -v" is no place for an idle pipe
+std::string PipeCommand::details() {
+    if (!_stats->sampled || _stats->bytes == 0) {
+        return "";
+    }
+    string slow = bottleneck();
+    return " [" + _formatBytes(_stats->rate) + "/s" +
+           (slow.empty() ? "" : ", bottleneck: " + slow) + "]";
+}
+
+void PipeCommand::printStats() {
+    if (!_stats->sampled) {
+        cout << "  no samples yet" << endl;
+        return;
+    }
+    vector<PipeCommand *> pipes = chain();
+    auto printStage = [](size_t n, Command *cmd, double cpu) {
+        cout << "  " << n << " " << left << setw(30) << cmd->cmd_line() << right
+             << setw(5) << (int)(cpu * 100 + 0.5) << "% cpu" << endl;
+    };
+    for (size_t i = 0; i < pipes.size(); ++i) {
+        const Stats& stats = *pipes[i]->_stats;
+        printStage(i + 1, pipes[i]->_cmds[0], stats.cpu[0]);
+        cout << "    | ";
+        if (!stats.sampled) {
+            cout << "no samples yet" << endl;
+            continue;
+        }
+        cout << _formatBytes(stats.bytes) << ", " << _formatBytes(stats.rate) << "/s, fill "
+             << (int)(stats.fill_avg * 100 + 0.5) << "% of " << _formatBytes(stats.capacity);
+        if (stats.resizes) {
+            cout << ", resized " << stats.resizes << (stats.resizes == 1 ? " time" : " times");
+        }
+        cout << endl;
+    }
+    printStage(pipes.size() + 1, pipes.back()->_cmds[1], pipes.back()->_stats->cpu[1]);
+    string slow = bottleneck();
+    cout << "  bottleneck: " << (slow.empty() ? "none" : slow) << endl;
+}
+
+/* -------------- PipeStatCommand -------------- */
+
+PipeStatCommand::PipeStatCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _jobs = jobs;
+    _jid = 0;
+    _policy = args[1] && strcmp(args[1], "-p") == 0;
+    if (_policy) {
+        if (args[2] && args[3]) {
+            throw Command::CommandError("pipestat: invalid arguments");
+        }
+        if (args[2]) {
+            _new_policy = args[2];
+            PipePolicy check;
+            check.parse(_new_policy);
+        }
+    } else if (args[1]) {
+        if (!_isNumber(args[1]) || args[2]) {
+            throw Command::CommandError("pipestat: invalid arguments");
+        }
+        _jid = stoi(args[1]);
+        JobsList::JobEntry *job;
+        try {
+            job = jobs->getJobById(_jid);
+        } catch (Command::CommandError& e) {
+            throw Command::CommandError("pipestat: " + e.what());
+        }
+        if (!dynamic_cast<PipeCommand *>(job->cmd())) {
+            throw Command::CommandError("pipestat: job-id " + to_string(_jid) +
+                                        " is not a pipeline");
+        }
+    }
+}
+
+// Shows where the data of each pipeline job is and how fast it moves, or
+// with -p the pipe size policy for new pipelines.
+void PipeStatCommand::execute() {
+    FUNC_ENTRY()
+    if (_policy) {
+        if (_new_policy.empty()) {
+            cout << "pipe size: " << _jobs->pipePolicy().describe() << endl;
+        } else {
+            _jobs->pipePolicy().parse(_new_policy);
+        }
+        return;
+    }
+    for (JobsList::JobEntry *job : _jobs->getAllJobs()) {
+        PipeCommand *pipe = dynamic_cast<PipeCommand *>(job->cmd());
+        if (!pipe || (_jid && job->cmd()->_jid != _jid)) {
+            continue;
+        }
+        cout << "[" << job->cmd()->_jid << "] " << pipe->cmd_line() << endl;
+        pipe->printStats();
+    }
+}
+
+/* -------------- GetFileTypeCommand -------------- */
+
+// Requests go to AsyncIo in windows of this many, bounding the memory a
+// wildcard over a huge directory takes
+#define FILE_BATCH (4096)
+
+// The smash does not expand wildcards for builtins, so the file builtins do
+// it themselves. A pattern that matches nothing is kept as is.
+static vector<string> _expandPaths(const vector<string>& args) {
+    vector<string> paths;
+    for (const string& arg : args) {
+        glob_t matches;
+        if (arg.find_first_of("*?[") != string::npos &&
+            glob(arg.c_str(), GLOB_NOCHECK, nullptr, &matches) == 0) {
+            paths.insert(paths.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+            globfree(&matches);
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    return paths;
+}
+
+static int _countArgs(char* args[]) {
+    int count = 0;
+    while (args[count]) {
+        ++count;
+    }
+    return count;
+}
+
+static void _printIoError(const char *syscall, long result) {
+    cerr << "smash error: " << syscall << " failed: " << strerror(-result) << endl;
+}
+
+GetFileTypeCommand::GetFileTypeCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    if (!args[1]) {
+        throw Command::CommandError("gettype: invalid arguments");
+    }
+    _paths = _expandPaths(vector<string>(args + 1, args + _countArgs(args)));
+}
+
+// All the paths are stat'ed as one batch.
+void GetFileTypeCommand::execute() {
+    FUNC_ENTRY()
+    AsyncIo io;
+    for (size_t first = 0; first < _paths.size(); first += FILE_BATCH) {
+        vector<IoRequest> batch;
+        for (size_t i = first; i < _paths.size() && i < first + FILE_BATCH; ++i) {
+            batch.push_back(IoRequest::statx(_paths[i]));
+        }
+        io.run(batch);
+        for (const IoRequest& request : batch) {
+            if (request.result < 0) {
+                cout << flush;
+                _printIoError("stat", request.result);
+                continue;
+            }
+            mode_t mode = request.stx.stx_mode;
+            std::string type;
+            if (S_ISREG(mode)) {
+                type = "\"regular file\"";
+            } else if (S_ISDIR(mode)) {
+                type = "\"directory\"";
+            } else if (S_ISCHR(mode)) {
+                type = "\"character device\"";
+            } else if (S_ISBLK(mode)) {
+                type = "\"block device\"";
+            } else if (S_ISFIFO(mode)) {
+                type = "\"FIFO\"";
+            } else if (S_ISLNK(mode)) {
+                type = "\"symbolic link\"";
+            } else if (S_ISSOCK(mode)) {
+                type = "\"socket\"";
+            } else {
+                throw Command::CommandError("gettype: invalid arguments");
+            }
+            cout << request.path << "'s type is " << type;
+            cout << " and takes up " << request.stx.stx_size << " bytes\n";
+        }
+    }
+    cout << flush;
+}
+
+/* -------------- ChmodCommand -------------- */
+
+ChmodCommand::ChmodCommand(const char *cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    if (!args[1] || !args[2] || !_isNumber(string(args[1]))) {
+        throw Command::CommandError("chmod: invalid arguments");
+    }
+    try {
+        _new_mode = stoi(args[1], 0 , 8);
+    } catch (...) {
+        throw Command::CommandError("chmod: invalid arguments");
+    }
+    _paths = _expandPaths(vector<string>(args + 2, args + _countArgs(args)));
+}
+
+// io_uring has no chmod, so these batches always go through the thread pool.
+void ChmodCommand::execute() {
+    FUNC_ENTRY()
+    AsyncIo io;
+    for (size_t first = 0; first < _paths.size(); first += FILE_BATCH) {
+        vector<IoRequest> batch;
+        for (size_t i = first; i < _paths.size() && i < first + FILE_BATCH; ++i) {
+            batch.push_back(IoRequest::chmod(_paths[i], _new_mode));
+        }
+        io.run(batch);
+        for (const IoRequest& request : batch) {
+            if (request.result < 0) {
+                _printIoError("chmod", request.result);
+            }
+        }
+    }
+}
+
+/* -------------- CpCommand -------------- */
+
+// The last component of a path, ignoring trailing slashes
+static string _baseName(const string& path) {
+    size_t end = path.find_last_not_of('/');
+    if (end == string::npos) {
+        return "/";
+    }
+    size_t slash = path.find_last_of('/', end);
+    return path.substr(slash == string::npos ? 0 : slash + 1, end - (slash == string::npos ? -1 : slash));
+}
+
+// Whether path, which need not exist yet, is dir or somewhere below it
+static bool _isInside(const string& dir, const string& path) {
+    char real_dir[PATH_MAX], real_parent[PATH_MAX];
+    size_t slash = path.find_last_of('/');
+    string parent = slash == string::npos ? "." : path.substr(0, slash ? slash : 1);
+    if (!realpath(dir.c_str(), real_dir) || !realpath(parent.c_str(), real_parent)) {
+        return false;
+    }
+    string resolved = string(real_parent) + "/" + path.substr(slash + 1);
+    string prefix = string(real_dir) + "/";
+    return resolved + "/" == prefix || resolved.compare(0, prefix.size(), prefix) == 0;
+}
+
+CpCommand::CpCommand(const char* cmd_line):
+    BuiltInCommand(cmd_line),
+    _io(nullptr),
+    _status(0) {}
+
+Command *CpCommand::create(const char* cmd_line, char* args[]) {
+    if (_isBackgroundComamnd(cmd_line)) {
+        return nullptr;
+    }
+    int i = 1;
+    while (args[i] && (strcmp(args[i], "-r") == 0 || strcmp(args[i], "-R") == 0)) {
+        ++i;
+    }
+    if (i == 1) {
+        return nullptr;
+    }
+    CpCommand *cmd = new CpCommand(cmd_line);
+    vector<string> paths;
+    for (; args[i]; ++i) {
+        // options after the operands are left to the binary too
+        if (args[i][0] == '-') {
+            delete cmd;
+            return nullptr;
+        }
+        paths.push_back(args[i]);
+    }
+    if (paths.size() < 2 || _isComplex(paths.back())) {
+        delete cmd;
+        return nullptr;
+    }
+    cmd->_target = paths.back();
+    paths.pop_back();
+    cmd->_sources = _expandPaths(paths);
+    return cmd;
+}
+
+// Errors are printed the way coreutils does, and the copy goes on with the
+// next file.
+void CpCommand::execute() {
+    FUNC_ENTRY()
+    AsyncIo io;
+    _io = &io;
+    _status = 0;
+    struct stat st;
+    bool into_dir = stat(_target.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    if (_sources.size() > 1 && !into_dir) {
+        error("target '" + _target + "' is not a directory");
+    }
+    for (size_t i = 0; i < _sources.size() && (into_dir || _sources.size() == 1); ++i) {
+        const string& source = _sources[i];
+        string target = into_dir ? _target + "/" + _baseName(source) : _target;
+        // like cp -r, which does not follow links in the tree either, a
+        // link is copied as a link
+        if (lstat(source.c_str(), &st) < 0) {
+            error("cannot stat '" + source + "'", errno);
+        } else if (S_ISDIR(st.st_mode) && _isInside(source, target)) {
+            error("cannot copy a directory, '" + source + "', into itself, '" + target + "'");
+        } else if (S_ISDIR(st.st_mode)) {
+            copyTree(source, target, st);
+        } else {
+            struct stat target_st;
+            if (stat(target.c_str(), &target_st) == 0 && target_st.st_dev == st.st_dev &&
+                target_st.st_ino == st.st_ino) {
+                error("'" + source + "' and '" + target + "' are the same file");
+            } else {
+                copy(source, target, st);
+            }
+        }
+    }
+    runCopies();
+    // deepest first, since a directory may lose the permission to reach into it
+    reverse(_modes.begin(), _modes.end());
+    for (size_t first = 0; first < _modes.size(); first += FILE_BATCH) {
+        vector<IoRequest> batch(_modes.begin() + first,
+                                _modes.begin() + min(_modes.size(), first + FILE_BATCH));
+        io.run(batch);
+        for (const IoRequest& request : batch) {
+            if (request.result < 0) {
+                error("preserving permissions for '" + request.path + "'", -request.result);
+            }
+        }
+    }
+    smash_status() = _status;
+}
+
+void CpCommand::copy(const std::string& source, const std::string& target, const struct stat& st) {
+    if (S_ISLNK(st.st_mode)) {
+        char link[PATH_MAX];
+        ssize_t len = readlink(source.c_str(), link, sizeof(link) - 1);
+        if (len < 0) {
+            error("cannot read symbolic link '" + source + "'", errno);
+            return;
+        }
+        link[len] = '\0';
+        if (symlink(link, target.c_str()) < 0 &&
+            (errno != EEXIST || unlink(target.c_str()) < 0 || symlink(link, target.c_str()) < 0)) {
+            error("cannot create symbolic link '" + target + "'", errno);
+        }
+        return;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        error("cannot copy special file '" + source + "'");
+        return;
+    }
+    _copies.push_back(IoRequest::copy(source, target));
+    if (_copies.size() >= FILE_BATCH) {
+        runCopies();
+    }
+}
+
+// Directories are created as the walk reaches them, so their files can be
+// copied right away; they get their modes once everything is copied. Entry
+// types come from readdir(), so a file in the tree costs no stat() here.
+void CpCommand::copyTree(const std::string& source, const std::string& target, const struct stat& st) {
+    struct stat target_st;
+    if (mkdir(target.c_str(), 0700) < 0 &&
+        (errno != EEXIST || stat(target.c_str(), &target_st) < 0 || !S_ISDIR(target_st.st_mode))) {
+        error("cannot create directory '" + target + "'", errno == EEXIST ? ENOTDIR : errno);
+        return;
+    }
+    _modes.push_back(IoRequest::chmod(target, st.st_mode & 07777));
+    DIR *dir = opendir(source.c_str());
+    if (!dir) {
+        error("cannot access '" + source + "'", errno);
+        return;
+    }
+    vector<pair<string, unsigned char>> entries;
+    for (struct dirent *entry; (entry = readdir(dir));) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            entries.push_back(make_pair(string(entry->d_name), entry->d_type));
+        }
+    }
+    closedir(dir);
+    for (const auto& entry : entries) {
+        string child = source + "/" + entry.first;
+        string child_target = target + "/" + entry.first;
+        struct stat child_st;
+        if (entry.second == DT_REG) {
+            child_st.st_mode = S_IFREG;
+        } else if (entry.second == DT_LNK) {
+            child_st.st_mode = S_IFLNK;
+        } else if (lstat(child.c_str(), &child_st) < 0) {
+            error("cannot stat '" + child + "'", errno);
+            continue;
+        }
+        if (S_ISDIR(child_st.st_mode)) {
+            copyTree(child, child_target, child_st);
+        } else {
+            copy(child, child_target, child_st);
+        }
+    }
+}
+
+void CpCommand::runCopies() {
+    _io->run(_copies);
+    for (const IoRequest& request : _copies) {
+        if (request.result >= 0) {
+            continue;
+        }
+        string step = request.failed ? request.failed : "";
+        if (step == "open" || step == "stat") {
+            error("cannot open '" + request.path + "' for reading", -request.result);
+        } else if (step == "create") {
+            error("cannot create regular file '" + request.target + "'", -request.result);
+        } else if (step == "chmod") {
+            error("preserving permissions for '" + request.target + "'", -request.result);
+        } else {
+            error("error copying '" + request.path + "' to '" + request.target + "'", -request.result);
+        }
+    }
+    _copies.clear();
+}
+
+void CpCommand::error(const std::string& message, int error_number) {
+    cerr << "cp: " << message;
+    if (error_number) {
+        cerr << ": " << strerror(error_number);
+    }
+    cerr << endl;
+    _status = 1;
+}
+
+/* -------------- TailCommand -------------- */
+
+#define TAIL_BLOCK (65536)
+
+TailCommand::TailCommand(const char* cmd_line):
+    BuiltInCommand(cmd_line),
+    _lines(10) {}
+
+// The builtin takes "tail [-N] file". Other options and several files are
+// left to the binary; without a file it would read the shell's own stdin, so
+// that stays an error.
+Command *TailCommand::create(const char* cmd_line, char* args[]) {
+    FUNC_ENTRY()
+    int i = 1;
+    size_t lines = 10;
+    if (args[1] && args[1][0] == '-' && args[1][1] != '-' && _isNumber(args[1] + 1)) {
+        lines = stoul(args[1] + 1);
+        i = 2;
+    }
+    if (!args[i]) {
+        throw Command::CommandError("tail: invalid arguments");
+    }
+    for (int j = i; args[j]; ++j) {
+        if (args[j][0] == '-') {
+            return nullptr;
+        }
+    }
+    if (args[i + 1]) {
+        return nullptr;
+    }
+    TailCommand *cmd = new TailCommand(cmd_line);
+    cmd->_lines = lines;
+    cmd->_path = args[i];
+    return cmd;
+}
+
+// Reads a regular file backwards a block at a time until it holds enough
+// lines, anything else from the start with sequential reads: a pipe cannot
+// seek, and /proc files report a size of 0. A newline that ends the file does
+// not begin another line.
+void TailCommand::execute() {
+    FUNC_ENTRY()
+    AsyncIo io;
+    vector<IoRequest> batch(1, IoRequest::openat(_path, O_RDONLY));
+    io.run(batch);
+    if (batch[0].result < 0) {
+        _printIoError("open", batch[0].result);
+        return;
+    }
+    int fd = batch[0].result;
+    batch[0] = IoRequest::fstatx(fd);
+    io.run(batch);
+    bool regular = batch[0].result == 0 && S_ISREG(batch[0].stx.stx_mode) &&
+                   batch[0].stx.stx_size > 0;
+    off_t size = regular ? batch[0].stx.stx_size : 0;
+
+    string data;
+    char block[TAIL_BLOCK];
+    off_t offset = regular ? size : 0;
+    bool done = _lines == 0;
+    while (!done) {
+        size_t len = regular ? min<off_t>(offset, TAIL_BLOCK) : TAIL_BLOCK;
+        off_t at = regular ? offset - len : -1;
+        batch[0] = IoRequest::read(fd, block, len, at);
+        io.run(batch);
+        if (batch[0].result < 0) {
+            _printIoError("read", batch[0].result);
+            break;
+        }
+        if (regular) {
+            data.insert(0, block, batch[0].result);
+            offset = at;
+            size_t ends = data.empty() ? 0 :
+                          count(data.begin(), data.end() - (data.back() == '\n'), '\n');
+            done = offset == 0 || ends >= _lines;
+        } else {
+            data.append(block, batch[0].result);
+            done = batch[0].result == 0;
+        }
+    }
+    if (!data.empty() && _lines > 0) {
+        // each line found moves start back to just after the newline before it
+        size_t start = data.length() - (data.back() == '\n');
+        for (size_t n = 0; n < _lines && start > 0; ++n) {
+            size_t nl = data.rfind('\n', start - 1);
+            start = nl == string::npos ? 0 : nl;
+            if (n + 1 == _lines && nl != string::npos) {
+                ++start;
+            }
+        }
+        cout << data.substr(start) << flush;
+    }
+    batch[0] = IoRequest::close(fd);
+    io.run(batch);
+}
+
+/* -------------- TouchCommand -------------- */
+
+TouchCommand::TouchCommand(const char* cmd_line):
+    BuiltInCommand(cmd_line),
+    _time(0) {}
+
+// The builtin takes "touch path... timestamp". Without the timestamp, or with
+// options, the command is left to the binary.
+Command *TouchCommand::create(const char* cmd_line, char* args[]) {
+    FUNC_ENTRY()
+    int count = _countArgs(args);
+    struct tm time = {};
+    char end;
+    bool stamp = count >= 2 &&
+                 sscanf(args[count - 1], "%d:%d:%d:%d:%d:%d%c", &time.tm_sec, &time.tm_min,
+                        &time.tm_hour, &time.tm_mday, &time.tm_mon, &time.tm_year, &end) == 6;
+    if (count < 2 || (stamp && count < 3)) {
+        throw Command::CommandError("touch: invalid arguments");
+    }
+    for (int i = 1; i < count; ++i) {
+        if (args[i][0] == '-') {
+            return nullptr;
+        }
+    }
+    if (!stamp) {
+        return nullptr;
+    }
+    TouchCommand *cmd = new TouchCommand(cmd_line);
+    // the timestamp is seconds:minutes:hours:day:month:year, in local time
+    time.tm_mon -= 1;
+    time.tm_year -= 1900;
+    time.tm_isdst = -1;
+    cmd->_time = mktime(&time);
+    cmd->_paths = _expandPaths(vector<string>(args + 1, args + count - 1));
+    return cmd;
+}
+
+void TouchCommand::execute() {
+    FUNC_ENTRY()
+    struct timespec times[2] = {{_time, 0}, {_time, 0}};
+    AsyncIo io;
+    vector<IoRequest> batch;
+    for (const string& path : _paths) {
+        batch.push_back(IoRequest::utimens(path, times));
+    }
+    io.run(batch);
+    for (const IoRequest& request : batch) {
+        if (request.result < 0) {
+            _printIoError("utime", request.result);
+        }
+    }
+}
+
+/* -------------- CaptureCommand -------------- */
+
+CaptureCommand::CaptureCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _jobs = jobs;
+    _limit = 0;
+    if (!args[1] || (strcmp(args[1], "on") != 0 && strcmp(args[1], "off") != 0)) {
+        throw Command::CommandError("capture: invalid arguments");
+    }
+    _on = strcmp(args[1], "on") == 0;
+    if (args[2]) {
+        if (!_on || args[3] || !_isNumber(args[2]) || stoul(args[2]) == 0) {
+            throw Command::CommandError("capture: invalid arguments");
+        }
+        _limit = stoul(args[2]) * 1024;
+    } else if (_on) {
+        _limit = 1024 * 1024;
+    }
+}
+
+void CaptureCommand::execute() {
+    _jobs->setCapture(_on, _limit);
+}
+
+/* -------------- JobLogCommand -------------- */
+
+JobLogCommand::JobLogCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _follow = false;
+    _lines = -1;
+    string spec = args[1] ? args[1] : "";
+    if (!spec.empty() && spec[0] == '%') {
+        spec.erase(0, 1);
+    }
+    if (!_isNumber(spec)) {
+        throw Command::CommandError("joblog: invalid arguments");
+    }
+    for (int i = 2; args[i]; ++i) {
+        if (strcmp(args[i], "-f") == 0) {
+            _follow = true;
+        } else if (strcmp(args[i], "-n") == 0 && args[i + 1] && _isNumber(args[i + 1])) {
+            _lines = stoi(args[++i]);
+        } else {
+            throw Command::CommandError("joblog: invalid arguments");
+        }
+    }
+    try {
+        _job = jobs->getJobById(stoi(spec));
+    } catch (const CommandError& e) {
+        throw CommandError("joblog: " + e.what());
+    }
+    if (!_job->capture()) {
+        throw CommandError("joblog: job-id " + spec + " output is not captured");
+    }
+    // drained by the smash itself, since a server prints the log from a child
+    _jobs = jobs;
+    _jobs->drainCaptures();
+}
+
+void JobLogCommand::execute() {
+    OutputCapture *capture = _job->capture();
+    capture->print(0, _lines);
+    // follow the job until it closes its output or Ctrl-C is pressed
+    int interrupts = _smash->interrupts();
+    unsigned long long from = capture->head();
+    while (_follow && !capture->eof() && _smash->interrupts() == interrupts) {
+        struct pollfd pfd = {signalEventsFd(), POLLIN, 0};
+        poll(&pfd, 1, -1);
+        dispatchSignalEvents();
+        _jobs->drainCaptures();
+        capture->print(from);
+        from = capture->head();
+    }
+}
+
+/* -------------- SetcoreCommand -------------- */
+
+SetcoreCommand::SetcoreCommand(const char *cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    if (!args[1] || !args[2] || args[3] || !_isNumber(args[2])) {
+        throw Command::CommandError("setcore: invalid arguments");
+    }
+    _core = stoi(args[2]);
+    try {
+        _targets = jobs->getJobsBySpec(args[1]);
+    } catch (const CommandError& e) {
+        throw CommandError("setcore: " + e.what());
+    }
+}
+
+void SetcoreCommand::execute(){
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(_core, &cpuset);
+    for (JobsList::JobEntry *job : _targets) {
+        if (sched_setaffinity(job->pid(), sizeof(cpuset), &cpuset) == -1){
+            throw Command::CommandError("setcore: invalid core number");
+        }
+    }
+}
+/* -------------- SetprioCommand -------------- */
+
+SetprioCommand::SetprioCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _jobs = jobs;
+    if (!args[1]) {
+        throw Command::CommandError("setprio: invalid arguments");
+    }
+    _default = strcmp(args[1], "-d") == 0;
+    _priority.parse(args + 2, "setprio");
+    if (_default) {
+        return;
+    }
+    if (_priority.empty()) {
+        throw Command::CommandError("setprio: invalid arguments");
+    }
+    try {
+        _targets = jobs->getJobsBySpec(args[1]);
+    } catch (const CommandError& e) {
+        throw CommandError("setprio: " + e.what());
+    }
+}
+
+// "setprio -d [options]" sets what background jobs get at launch, and with no
+// options goes back to inheriting the smash's settings.
+void SetprioCommand::execute() {
+    if (_default) {
+        _jobs->defaultPriority() = _priority;
+        return;
+    }
+    for (JobsList::JobEntry *job : _targets) {
+        _priority.apply(job->pid(), job->cmd()->group());
+    }
+}
+
+/* -------------- SubmitCommand -------------- */
+
+SubmitCommand::SubmitCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _jobs = jobs;
+    _limits = jobs->queueLimits();
+    _priority = 0;
+    _show = !args[1];
+
+    // the queued command always runs in the background, "&" adds nothing
+    vector<string> words;
+    for (int i = 1; args[i]; ++i) {
+        words.push_back(args[i]);
+    }
+    if (!words.empty() && words.back().back() == '&') {
+        words.back().pop_back();
+        if (words.back().empty()) {
+            words.pop_back();
+        }
+    }
+
+    size_t i = 0;
+    bool priority_set = false;
+    for (; i < words.size() && words[i][0] == '-'; i += 2) {
+        const string& opt = words[i];
+        char *end = nullptr;
+        double value = i + 1 < words.size() ? strtod(words[i + 1].c_str(), &end) : -1;
+        bool integer = value == (int)value;
+        if (!end || *end || (opt != "-p" && value < 0)) {
+            throw Command::CommandError("submit: invalid arguments");
+        }
+        if (opt == "-p" && integer) {
+            _priority = value;
+            priority_set = true;
+        } else if (opt == "-j" && integer) {
+            _limits.max_jobs = value;
+        } else if (opt == "-l") {
+            _limits.max_load = value;
+        } else if (opt == "-c") {
+            _limits.max_cpu = value;
+        } else if (opt == "-m") {
+            _limits.max_mem = value;
+        } else {
+            throw Command::CommandError("submit: invalid arguments");
+        }
+    }
+    for (; i < words.size(); ++i) {
+        _cmd_line += words[i] + " ";
+    }
+    if (_cmd_line.empty() && priority_set) {
+        throw Command::CommandError("submit: invalid arguments");
+    }
+    if (!_cmd_line.empty()) {
+        _cmd_line.back() = '&';
+    }
+}
+
+// "submit [-j jobs] [-l load] [-c cpu%] [-m mem%]" sets the queue limits,
+// "submit [-p priority] command" queues a background job and "submit" alone
+// shows the limits.
+void SubmitCommand::execute() {
+    if (_show) {
+        auto limit = [](double value, const char *unit) {
+            ostringstream out;
+            out << value << unit;
+            return value > 0 ? out.str() : string("off");
+        };
+        cout << "jobs " << limit(_limits.max_jobs, "") << ", load " << limit(_limits.max_load, "")
+             << ", cpu " << limit(_limits.max_cpu, "%") << ", mem " << limit(_limits.max_mem, "%")
+             << endl;
+        return;
+    }
+    _jobs->queueLimits() = _limits;
+    if (!_cmd_line.empty()) {
+        _jobs->enqueue(_cmd_line, _priority);
+    }
+    SmallShell::getInstance().runQueue();
+}
+
+/* -------------- RunDagCommand -------------- */
+
+RunDagCommand::RunDagCommand(const char* cmd_line, char* args[], JobsList* jobs):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    // the targets are jobs of the smash, which must stay to launch the rest
+    if (_isBackgroundComamnd(cmd_line)) {
+        throw Command::CommandError("rundag: invalid arguments");
+    }
+    _jobs = jobs;
+    _max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+    if (args[i] && strcmp(args[i], "-j") == 0) {
+        if (!args[i + 1] || !_isNumber(args[i + 1]) || stoi(args[i + 1]) < 1) {
+            throw Command::CommandError("rundag: invalid arguments");
+        }
+        _max_jobs = stoi(args[i + 1]);
+        i += 2;
+    }
+    if (!args[i] || args[i + 1]) {
+        throw Command::CommandError("rundag: invalid arguments");
+    }
+    string path(args[i]);
+    ifstream file(path);
+    if (!file) {
+        throw Command::CommandError("rundag: cannot open " + path);
+    }
+    parse(file);
+}
+
+// The jobfile lists targets as "name: dependencies...", each optionally
+// followed by one indented command line. A target without a command only
+// groups its dependencies. Blank lines and lines starting with '#' are
+// ignored.
+void RunDagCommand::parse(std::istream& file) {
+    map<string, size_t> index;
+    vector<vector<string>> dep_names;
+    int lineno = 0;
+    for (string line; getline(file, line);) {
+        ++lineno;
+        string trimmed = _trim(line);
+        if (trimmed.empty() || trimmed[0] == '#') {
+            continue;
+        }
+        string where = "rundag: line " + to_string(lineno) + ": ";
+        if (WHITESPACE.find(line[0]) != string::npos) {
+            if (_nodes.empty()) {
+                throw Command::CommandError(where + "command outside of a target");
+            }
+            if (!_nodes.back().cmd_line.empty()) {
+                throw Command::CommandError(where + "target " + _nodes.back().name +
+                                            " has more than one command");
+            }
+            _removeBackgroundSign(trimmed);
+            _nodes.back().cmd_line = _trim(trimmed);
+            continue;
+        }
+        size_t colon = trimmed.find(':');
+        string name = _trim(trimmed.substr(0, colon));
+        if (colon == string::npos || name.empty() ||
+            name.find_first_of(WHITESPACE) != string::npos) {
+            throw Command::CommandError(where + "expected \"target: dependencies\"");
+        }
+        if (!index.insert(make_pair(name, _nodes.size())).second) {
+            throw Command::CommandError(where + "target " + name + " defined twice");
+        }
+        Node node;
+        node.name = name;
+        node.state = WAITING;
+        node.start_ms = node.end_ms = node.path_ms = 0;
+        node.path_prev = -1;
+        _nodes.push_back(node);
+        dep_names.push_back(vector<string>());
+        std::istringstream deps(trimmed.substr(colon + 1));
+        for (string dep; deps >> dep;) {
+            dep_names.back().push_back(dep);
+        }
+    }
+
+    for (size_t n = 0; n < _nodes.size(); ++n) {
+        for (const string& dep : dep_names[n]) {
+            auto it = index.find(dep);
+            if (it == index.end()) {
+                throw Command::CommandError("rundag: target " + _nodes[n].name +
+                                            " depends on unknown target " + dep);
+            }
+            _nodes[n].deps.push_back(it->second);
+            _nodes[it->second].dependents.push_back(n);
+        }
+        _nodes[n].pending = _nodes[n].deps.size();
+    }
+
+    // Kahn's algorithm: whatever never becomes ready lies on a cycle
+    vector<size_t> pending(_nodes.size());
+    vector<size_t> order;
+    for (size_t n = 0; n < _nodes.size(); ++n) {
+        pending[n] = _nodes[n].pending;
+        if (pending[n] == 0) {
+            order.push_back(n);
+        }
+    }
+    for (size_t k = 0; k < order.size(); ++k) {
+        for (size_t d : _nodes[order[k]].dependents) {
+            if (--pending[d] == 0) {
+                order.push_back(d);
+            }
+        }
+    }
+    for (size_t n = 0; n < _nodes.size(); ++n) {
+        if (pending[n] != 0) {
+            throw Command::CommandError("rundag: dependency cycle through " + _nodes[n].name);
+        }
+    }
+}
+
+// Keeps up to -j targets running as background jobs, launching each one as
+// soon as its dependencies are done. A failed target skips everything that
+// depends on it while independent branches carry on. Ctrl-C stops launching
+// and leaves the running targets as ordinary jobs.
+void RunDagCommand::execute() {
+    FUNC_ENTRY()
+    SmallShell& smash = SmallShell::getInstance();
+    int interrupts = smash.interrupts();
+    long begin = _monotonicMillis();
+    for (size_t n = 0; n < _nodes.size(); ++n) {
+        if (_nodes[n].pending == 0) {
+            _ready.push_back(n);
+        }
+    }
+
+    bool interrupted = false;
+    while (!interrupted && (!_ready.empty() || !_running.empty())) {
+        while (!_ready.empty() && (int)_running.size() < _max_jobs) {
+            size_t n = _ready.front();
+            _ready.pop_front();
+            launch(n);
+        }
+        if (_running.empty()) {
+            continue;
+        }
+        vector<JobsList::JobEntry *> running;
+        for (const pair<const int, size_t>& entry : _running) {
+            running.push_back(_jobs->getJobById(entry.first));
+        }
+        // the timeout only bounds how long a Ctrl-C goes unnoticed
+        vector<pair<int, int>> reaped;
+        _jobs->waitJobs(running, true, 200, reaped);
+        for (const pair<int, int>& job : reaped) {
+            size_t n = _running[job.first];
+            _running.erase(job.first);
+            finish(n, job.second);
+        }
+        interrupted = smash.interrupts() != interrupts;
+    }
+
+    if (interrupted) {
+        for (const pair<const int, size_t>& entry : _running) {
+            _jobs->getJobById(entry.first)->awaited() = false;
+        }
+        cout << "rundag: interrupted, " << _running.size()
+             << " targets left running in the background" << endl;
+        return;
+    }
+    summary(_monotonicMillis() - begin);
+    for (const Node& node : _nodes) {
+        if (node.state == FAILED) {
+            throw Command::CommandError("rundag: target " + node.name + " failed");
+        }
+    }
+}
+
+static string _formatSeconds(long ms) {
+    ostringstream out;
+    out << fixed << setprecision(2) << ms / 1000.0 << "s";
+    return out.str();
+}
+
+void RunDagCommand::launch(size_t n) {
+    Node& node = _nodes[n];
+    node.start_ms = _monotonicMillis();
+    if (node.cmd_line.empty()) {
+        finish(n, 0);
+        return;
+    }
+    Command *cmd = nullptr;
+    int status;
+    try {
+        cmd = SmallShell::getInstance().CreateCommand((node.cmd_line + "&").c_str());
+        smash_status() = 0;
+        cmd->execute();
+        if (cmd->_jid != -1) {
+            // the job list owns the command from here
+            _jobs->getJobById(cmd->_jid)->awaited() = true;
+            _running[cmd->_jid] = n;
+            node.state = RUNNING;
+            return;
+        }
+        // a builtin has already completed, and an external command that is
+        // not a job could not be started
+        status = dynamic_cast<ExternalCommand *>(cmd) ? 1 : smash_status();
+    } catch (const Command::CommandError& e) {
+        cerr << "smash error: " << e.what() << endl;
+        status = 1;
+    }
+    smash_status() = 0;
+    delete cmd;
+    finish(n, status << 8);
+}
+
+void RunDagCommand::finish(size_t n, int status) {
+    Node& node = _nodes[n];
+    node.end_ms = _monotonicMillis();
+    node.path_ms = node.end_ms - node.start_ms;
+    long longest = 0;
+    for (size_t dep : node.deps) {
+        if (_nodes[dep].path_ms >= longest) {
+            longest = _nodes[dep].path_ms;
+            node.path_prev = dep;
+        }
+    }
+    node.path_ms += longest;
+
+    string secs = _formatSeconds(node.end_ms - node.start_ms);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        node.state = DONE;
+        cout << "rundag: " << node.name << " done in " << secs << endl;
+        for (size_t d : node.dependents) {
+            if (--_nodes[d].pending == 0) {
+                _ready.push_back(d);
+            }
+        }
+    } else {
+        node.state = FAILED;
+        cout << "rundag: " << node.name << " failed after " << secs << ", ";
+        if (WIFSIGNALED(status)) {
+            cout << "killed by signal " << WTERMSIG(status) << endl;
+        } else {
+            cout << "exit status " << WEXITSTATUS(status) << endl;
+        }
+        for (size_t d : node.dependents) {
+            skip(d, node.name);
+        }
+    }
+}
+
+void RunDagCommand::skip(size_t n, const std::string& cause) {
+    Node& node = _nodes[n];
+    if (node.state != WAITING) {
+        return;
+    }
+    node.state = SKIPPED;
+    cout << "rundag: " << node.name << " skipped, " << cause << " failed" << endl;
+    for (size_t d : node.dependents) {
+        skip(d, cause);
+    }
+}
+
+// Compares the wall time with the total work and shows the chain of targets
+// that bounded it.
+void RunDagCommand::summary(long elapsed_ms) {
+    int counts[SKIPPED + 1] = {0};
+    long work_ms = 0;
+    int last = -1;
+    for (size_t n = 0; n < _nodes.size(); ++n) {
+        const Node& node = _nodes[n];
+        counts[node.state]++;
+        if (node.state == DONE || node.state == FAILED) {
+            work_ms += node.end_ms - node.start_ms;
+            if (last < 0 || node.path_ms > _nodes[last].path_ms) {
+                last = n;
+            }
+        }
+    }
+    cout << "rundag: " << counts[DONE] << " done, " << counts[FAILED] << " failed, "
+         << counts[SKIPPED] << " skipped in " << _formatSeconds(elapsed_ms) << ", "
+         << _formatSeconds(work_ms) << " of work" << endl;
+    if (last >= 0) {
+        vector<int> path;
+        for (int n = last; n >= 0; n = _nodes[n].path_prev) {
+            path.push_back(n);
+        }
+        cout << "rundag: critical path " << _formatSeconds(_nodes[last].path_ms) << ":";
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            const Node& node = _nodes[*it];
+            cout << (it == path.rbegin() ? " " : " -> ") << node.name << " ("
+                 << _formatSeconds(node.end_ms - node.start_ms) << ")";
+        }
+        cout << endl;
+    }
+}
+
+/* -------------- XargsCommand -------------- */
+
+// Linux refuses any single argument longer than this (MAX_ARG_STRLEN)
+#define XARGS_MAX_ARG_LENGTH (32 * 4096)
+
+XargsCommand::XargsCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _delim = '\n';
+    _max_procs = 1;
+    _max_args = 0;
+    _batch_cost = 0;
+    _failures = 0;
+    _too_long = false;
+    _interrupts = 0;
+    _interrupted = false;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-'; ++i) {
+        if (strcmp(args[i], "-0") == 0) {
+            _delim = '\0';
+        } else if ((strcmp(args[i], "-P") == 0 || strcmp(args[i], "-n") == 0) &&
+                   args[i + 1] && _isNumber(args[i + 1])) {
+            if (args[i][1] == 'P') {
+                _max_procs = stoi(args[i + 1]);
+            } else {
+                _max_args = stoi(args[i + 1]);
+            }
+            ++i;
+        } else {
+            throw Command::CommandError("xargs: invalid arguments");
+        }
+    }
+    // in the background it would read the shell's own stdin, whose lines are
+    // commands; xargs at the end of a background pipeline reads the pipe
+    if (_isBackgroundComamnd(cmd_line)) {
+        throw Command::CommandError("xargs: invalid arguments");
+    }
+    for (; args[i]; ++i) {
+        _cmd.push_back(args[i]);
+    }
+    if (_cmd.empty()) {
+        _cmd.push_back("echo");
+    }
+}
+
+// Reads items from stdin in fixed-size chunks and launches an invocation
+// whenever the next item would not fit in ARG_MAX, so memory stays bounded by
+// one argument list however long the input is. With -P N up to N invocations
+// (any number for 0) run at once. They are not jobs: the prompt is busy until
+// xargs returns, so nothing could list or signal them meanwhile, and Ctrl-C
+// stops them along with the input. Failures are reported once all are done;
+// nothing is thrown, as the builtin may be running as a pipeline stage.
+void XargsCommand::execute() {
+    FUNC_ENTRY()
+    // what exec needs besides our items: the environment, the command words
+    // and the POSIX headroom of 2048 bytes
+    size_t used = 2048 + sizeof(char *);
+    for (char **env = environ; *env; ++env) {
+        used += strlen(*env) + 1 + sizeof(char *);
+    }
+    for (const string& word : _cmd) {
+        used += word.length() + 1 + sizeof(char *);
+    }
+    long arg_max = sysconf(_SC_ARG_MAX);
+    _budget = arg_max > (long)used ? arg_max - used : 0;
+    _batch.reserve(_budget);
+
+    char buf[65536];
+    string partial;
+    ssize_t n;
+    _interrupts = _smash->interrupts();
+    while (!_too_long && (n = input(buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            perror("smash error: read failed");
+            break;
+        }
+        const char *p = buf, *end = buf + n;
+        const char *next;
+        while ((next = (const char *)memchr(p, _delim, end - p))) {
+            if (partial.empty()) {
+                addItem(p, next - p);
+            } else {
+                partial.append(p, next - p);
+                addItem(partial.data(), partial.length());
+                partial.clear();
+            }
+            p = next + 1;
+        }
+        partial.append(p, end - p);
+    }
+    if (_interrupted) {
+        for (const pair<pid_t, int>& child : _running) {
+            kill(child.first, SIGINT);
+        }
+    } else if (!partial.empty()) {
+        addItem(partial.data(), partial.length());
+    }
+    if (!_offsets.empty() && !_interrupted) {
+        launch();
+    }
+    while (!_running.empty()) {
+        reapOne();
+    }
+    if (_interrupted) {
+        smash_status() = 130;
+        return;
+    }
+    if (_too_long) {
+        cerr << "smash error: xargs: argument line too long" << endl;
+    }
+    if (_failures) {
+        cerr << "smash error: xargs: " << _failures << " invocations of " << _cmd[0]
+             << " failed" << endl;
+    }
+}
+
+// At the prompt the items come from the shell's stdin, starting with what
+// the prompt read ahead, and a blocking read would hold off Ctrl-C, so the
+// smash's signal events are polled alongside. Returns 0 at the end of the
+// input or on Ctrl-C.
+ssize_t XargsCommand::input(char *buf, size_t len) {
+    bool top = signalEventsFd() >= 0;
+    string& ahead = _smash->input();
+    if (top && !ahead.empty()) {
+        len = min(len, ahead.length());
+        memcpy(buf, ahead.data(), len);
+        ahead.erase(0, len);
+        return len;
+    }
+    while (top) {
+        struct pollfd pfds[2] = {{STDIN_FILENO, POLLIN, 0}, {signalEventsFd(), POLLIN, 0}};
+        if (poll(pfds, 2, -1) < 0 && errno != EINTR) {
+            return -1;
+        }
+        dispatchSignalEvents();
+        if (_smash->interrupts() != _interrupts) {
+            _interrupted = true;
+            return 0;
+        }
+        if (pfds[0].revents) {
+            break;
+        }
+    }
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buf, len)) < 0 && errno == EINTR) {}
+    return n;
+}
+
+void XargsCommand::addItem(const char *data, size_t len) {
+    if ((len == 0 && _delim == '\n') || _too_long) {
+        return;
+    }
+    size_t cost = len + 1 + sizeof(char *);
+    if (len >= XARGS_MAX_ARG_LENGTH || cost > _budget) {
+        _too_long = true;
+        return;
+    }
+    if (!_offsets.empty() &&
+        (_batch_cost + cost > _budget || (_max_args && _offsets.size() == _max_args))) {
+        launch();
+    }
+    _offsets.push_back(_batch.length());
+    _batch.append(data, len);
+    _batch.push_back('\0');
+    _batch_cost += cost;
+}
+
+void XargsCommand::launch() {
+    while (_max_procs > 0 && (int)_running.size() >= _max_procs) {
+        reapOne();
+    }
+    vector<char *> argv;
+    for (string& word : _cmd) {
+        argv.push_back(&word[0]);
+    }
+    for (size_t offset : _offsets) {
+        argv.push_back(&_batch[offset]);
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+        _failures++;
+    } else if (pid == 0) {
+        execvp(argv[0], argv.data());
+        perror("smash error: execvp failed");
+        _exitChild(1);
+    } else {
+        _running.push_back(make_pair(pid, _pidfdOpen(pid)));
+    }
+    _batch.clear();
+    _offsets.clear();
+    _batch_cost = 0;
+}
+
+// Waits for whichever invocation ends first, or without pidfds for the
+// oldest one.
+void XargsCommand::reapOne() {
+    vector<struct pollfd> fds;
+    bool pollable = true;
+    for (const pair<pid_t, int>& child : _running) {
+        fds.push_back({child.second, POLLIN, 0});
+        pollable = pollable && child.second >= 0;
+    }
+    size_t done = 0;
+    if (pollable) {
+        while (poll(fds.data(), fds.size(), -1) < 0 && errno == EINTR) {}
+        while (done < fds.size() - 1 && !(fds[done].revents & POLLIN)) {
+            ++done;
+        }
+    }
+    int status = 0;
+    while (waitpid(_running[done].first, &status, 0) < 0 && errno == EINTR) {}
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        _failures++;
+    }
+    if (_running[done].second >= 0) {
+        close(_running[done].second);
+    }
+    _running.erase(_running.begin() + done);
+}
+
+/* -------------- RepeatCommand -------------- */
+
+// watch(1)'s default interval
+#define WATCH_INTERVAL_NS (2000000000L)
+
+static long _elapsedNanos(const struct timespec& from, const struct timespec& to) {
+    return (to.tv_sec - from.tv_sec) * 1000000000L + (to.tv_nsec - from.tv_nsec);
+}
+
+static void _addNanos(struct timespec& ts, long ns) {
+    ts.tv_sec += ns / 1000000000L;
+    ts.tv_nsec += ns % 1000000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+}
+
+// repeat -n N [-i seconds] [-d] cmd_line, repeat -i seconds [-d] cmd_line
+// and watch [-i seconds] [-d] cmd_line. The command line may be a pipeline or
+// a redirection, but not a background job.
+RepeatCommand::RepeatCommand(const char* cmd_line, char* args[]):
+    BuiltInCommand(cmd_line) {
+    FUNC_ENTRY()
+    _name = args[0];
+    bool watch = _name == "watch";
+    string invalid = _name + ": invalid arguments";
+    _count = 0;
+    _interval_ns = watch ? WATCH_INTERVAL_NS : 0;
+    _changes = false;
+    _interrupts = 0;
+    bool count_set = false;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-'; ++i) {
+        if (strcmp(args[i], "-d") == 0) {
+            _changes = true;
+            continue;
+        }
+        char *end = nullptr;
+        double value = args[i + 1] ? strtod(args[i + 1], &end) : -1;
+        if (!end || *end || value <= 0) {
+            throw Command::CommandError(invalid);
+        }
+        if (strcmp(args[i], "-n") == 0 && !watch && value == (long)value) {
+            _count = value;
+            count_set = true;
+        } else if (strcmp(args[i], "-i") == 0 && value * 1e9 < LONG_MAX) {
+            _interval_ns = value * 1e9;
+        } else {
+            throw Command::CommandError(invalid);
+        }
+        ++i;
+    }
+    string line;
+    for (; args[i]; ++i) {
+        line += string(line.empty() ? "" : " ") + args[i];
+    }
+    // without a count or an interval a repeat would just spin
+    if (line.empty() || _isBackgroundComamnd(line.c_str()) ||
+        (!count_set && _interval_ns == 0)) {
+        throw Command::CommandError(invalid);
+    }
+    _cmd = _smash->CreateCommand(line.c_str());
+}
+
+// Runs start on a fixed schedule, one interval after the previous run
+// started, with clock_nanosleep() sleeping to an absolute deadline so that
+// the time spent running and waking up does not add up. Ticks a slow run
+// overlaps are skipped, not made up for. Ctrl-C ends the loop and the latency
+// of the runs so far is still reported.
+void RepeatCommand::execute() {
+    FUNC_ENTRY()
+    _interrupts = _smash->interrupts();
+    int memfd = -1;
+    if (_changes && (memfd = _memfdCreate("smash-repeat")) < 0) {
+        perror("smash error: memfd_create failed");
+        return;
+    }
+    string last;
+    long runs = 0, overruns = 0, unchanged = 0;
+    long min_ns = LONG_MAX, max_ns = 0, total_ns = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while ((_count == 0 || runs < _count) && !stopped()) {
+        if (runs > 0 && _interval_ns > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            _addNanos(next, _interval_ns);
+            while (_elapsedNanos(next, now) > 0) {
+                _addNanos(next, _interval_ns);
+                overruns++;
+            }
+            int ret;
+            while ((ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr)) == EINTR &&
+                   !stopped()) {}
+            if (ret != 0) {
+                break;
+            }
+        }
+        long elapsed_ns = 0;
+        if (!runOnce(memfd, last, elapsed_ns)) {
+            unchanged++;
+        }
+        runs++;
+        total_ns += elapsed_ns;
+        min_ns = min(min_ns, elapsed_ns);
+        max_ns = max(max_ns, elapsed_ns);
+        // a run stopped with Ctrl-Z became a job, its Command is no longer ours
+        if (_cmd->_jid != -1) {
+            cerr << "smash error: " << _name << ": " << _cmd->cmd_line()
+                 << " was stopped" << endl;
+            break;
+        }
+    }
+    if (memfd >= 0) {
+        close(memfd);
+    }
+    if (runs == 0) {
+        return;
+    }
+    cout << _name << ": " << runs << (runs == 1 ? " run" : " runs") << ", latency min/avg/max "
+         << fixed << setprecision(3) << min_ns / 1e6 << "/" << total_ns / runs / 1e6 << "/"
+         << max_ns / 1e6 << " ms";
+    cout.unsetf(ios_base::floatfield);
+    if (overruns) {
+        cout << ", " << overruns << " skipped";
+    }
+    if (_changes) {
+        cout << ", " << unchanged << " unchanged";
+    }
+    cout << endl;
+}
+
+// With -d the run's stdout goes to a memfd and is only copied out when it
+// differs from the previous run's. Returns false for an unchanged output.
+bool RepeatCommand::runOnce(int memfd, std::string& last, long& elapsed_ns) {
+    int saved = -1;
+    cout.flush();
+    if (memfd >= 0) {
+        saved = dup(STDOUT_FILENO);
+        if (saved < 0 || ftruncate(memfd, 0) < 0 || lseek(memfd, 0, SEEK_SET) < 0 ||
+            dup2(memfd, STDOUT_FILENO) < 0) {
+            perror("smash error: dup2 failed");
+            if (saved >= 0) {
+                close(saved);
+            }
+            saved = -1;
+        }
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    try {
+        _cmd->execute();
+    } catch (const Command::CommandError& e) {
+        cerr << "smash error: " << e.what() << endl;
+    }
+    cout.flush();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed_ns = _elapsedNanos(start, end);
+    if (saved < 0) {
+        return true;
+    }
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    string output;
+    char buf[65536];
+    ssize_t n;
+    off_t offset = 0;
+    while ((n = pread(memfd, buf, sizeof(buf), offset)) > 0) {
+        output.append(buf, n);
+        offset += n;
+    }
+    if (output == last) {
+        return false;
+    }
+    cout << output << flush;
+    last.swap(output);
+    return true;
+}
+
+// Ctrl-C at the prompt, or inside a job as seen by the leader's handler
+bool RepeatCommand::stopped() const {
+    if (_leader_interrupted) {
+        return true;
+    }
+    if (signalEventsFd() >= 0) {
+        dispatchSignalEvents();
+        return _smash->interrupts() != _interrupts;
+    }
+    return false;
+}
+
+/* -------------- MemoCommand -------------- */
+
+#define MEMO_MAGIC (0x4f4d4d53)
+#define MEMO_VERSION (1)
+// how often a memo waiting for an identical one checks its lock
+#define MEMO_LOCK_POLL_US (2000)
+
+// A cache entry, DIR/<hash of the key>.memo: this header, the key and the
+// recorded stdout.
+struct MemoHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t status;
+    uint32_t key_size;
+    uint64_t output_size;
+};
+
+// Creates dir and whatever parents it is missing.
+static bool _makeDirs(const string& dir) {
+    size_t pos = 0;
+    do {
+        pos = dir.find('/', pos + 1);
+        if (mkdir(dir.substr(0, pos).c_str(), 0755) < 0 && errno != EEXIST) {
+            return false;
+        }
+    } while (pos != string::npos);
+    return true;
+}
+
+MemoCommand::MemoCommand(const char* cmd_line, char* args[]):
+    Command(cmd_line) {
+    FUNC_ENTRY()
+    _background_cmd = _isBackgroundComamnd(cmd_line);
+    _interrupts = 0;
+    const char *dir = getenv("SMASH_MEMO_DIR");
+    const char *home = getenv("HOME");
+    _dir = dir ? dir : string(home ? home : "/tmp") + "/.cache/smash/memo";
+    int i = 1;
+    for (; args[i] && args[i][0] == '-'; i += 2) {
+        if (!args[i + 1]) {
+            throw Command::CommandError("memo: invalid arguments");
+        }
+        if (strcmp(args[i], "-d") == 0) {
+            _dir = args[i + 1];
+        } else if (strcmp(args[i], "-e") == 0) {
+            _vars.push_back(args[i + 1]);
+        } else if (strcmp(args[i], "-i") == 0) {
+            _inputs.push_back(args[i + 1]);
+        } else {
+            throw Command::CommandError("memo: invalid arguments");
+        }
+    }
+    for (; args[i]; ++i) {
+        _line += string(_line.empty() ? "" : " ") + args[i];
+    }
+    if (!_line.empty() && _line.back() == '&') {
+        _line = _trim(_line.substr(0, _line.size() - 1));
+    }
+    if (_line.empty()) {
+        throw Command::CommandError("memo: invalid arguments");
+    }
+    _cmd = _smash->CreateCommand(_line.c_str());
+}
+
+void MemoCommand::execute() {
+    FUNC_ENTRY()
+    if (!_background_cmd) {
+        memoize();
+        return;
+    }
+    OutputCapture *capture = _smash->_job_list.startCapture();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+        delete capture;
+    } else if (pid == 0) {
+        _smash->setJobGroup(0);
+        _setupJobLeader();
+        if (capture) {
+            capture->attach();
+        }
+        _smash->_job_list.defaultPriority().apply(0, false);
+        memoize();
+        _exitChild(_smash->lastStatus());
+    } else {
+        _pid = pid;
+        _group = _smash->setJobGroup(pid);
+        if (capture) {
+            capture->closeWriter();
+        }
+        _smash->_job_list.addJob(this, false, capture);
+    }
+}
+
+// Everything a deterministic command's output may depend on that memo knows
+// of. An input file is identified by its inode and modification time, so
+// replacing or touching it makes a new key.
+string MemoCommand::key() const {
+    char cwd[PATH_MAX];
+    string key = "cmd " + _line + "\ncwd " + (getcwd(cwd, sizeof(cwd)) ? cwd : "") + "\n";
+    for (const string& var : _vars) {
+        const char *value = getenv(var.c_str());
+        key += "env " + var + (value ? "=" + string(value) : " unset") + "\n";
+    }
+    for (const string& path : _inputs) {
+        struct stat st;
+        key += "input " + path;
+        if (stat(path.c_str(), &st) == 0) {
+            key += " " + to_string(st.st_dev) + ":" + to_string(st.st_ino) + ":" +
+                   to_string(st.st_size) + ":" + to_string(st.st_mtim.tv_sec) + "." +
+                   to_string(st.st_mtim.tv_nsec);
+        } else {
+            key += " missing";
+        }
+        key += "\n";
+    }
+    return key;
+}
+
+// Replays a cached result if there is one. Otherwise the key's lock is taken
+// before running the command, so that identical invocations meanwhile, from
+// other jobs or other smashes, wait for it and then replay its result instead
+// of doing the same work. The lock file is removed once the entry is
+// published, so a waiter that then gets it checks that it is still the one at
+// the path, and starts over otherwise.
+void MemoCommand::memoize() {
+    string key = this->key();
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx", (unsigned long long)_fnv1a(key));
+    string path = _dir + name;
+    if (replay(path + ".memo", key)) {
+        return;
+    }
+    if (!_makeDirs(_dir)) {
+        perror("smash error: memo: mkdir failed");
+        record("", key);
+        return;
+    }
+    string lock_path = path + ".lock";
+    _interrupts = _smash->interrupts();
+    int lock;
+    while (true) {
+        lock = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock < 0) {
+            perror("smash error: memo: open failed");
+            record("", key);
+            return;
+        }
+        // polled rather than blocking, which SA_RESTART would make uninterruptible
+        while (flock(lock, LOCK_EX | LOCK_NB) < 0) {
+            if (errno != EWOULDBLOCK || interrupted()) {
+                close(lock);
+                _smash->_status = 130;
+                return;
+            }
+            usleep(MEMO_LOCK_POLL_US);
+        }
+        struct stat held, current;
+        if (fstat(lock, &held) == 0 && stat(lock_path.c_str(), &current) == 0 &&
+            held.st_dev == current.st_dev && held.st_ino == current.st_ino) {
+            break;
+        }
+        close(lock);
+    }
+    if (!replay(path + ".memo", key)) {
+        record(path + ".memo", key);
+    }
+    unlink(lock_path.c_str());
+    close(lock);
+}
+
+// Copies a cache entry for key to stdout. Returns false if there is none.
+bool MemoCommand::replay(const std::string& path, const std::string& key) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    MemoHeader header = {};
+    string stored(key.size(), '\0');
+    bool valid = read(fd, &header, sizeof(header)) == sizeof(header) &&
+                 header.magic == MEMO_MAGIC && header.version == MEMO_VERSION &&
+                 header.key_size == key.size() &&
+                 read(fd, &stored[0], stored.size()) == (ssize_t)stored.size() && stored == key;
+    char buf[65536];
+    uint64_t left = header.output_size;
+    ssize_t n = 0;
+    while (valid && left > 0 && (n = read(fd, buf, min<uint64_t>(sizeof(buf), left))) > 0) {
+        cout.write(buf, n);
+        left -= n;
+    }
+    cout.flush();
+    close(fd);
+    if (valid) {
+        _smash->_status = header.status;
+    }
+    return valid;
+}
+
+// Runs the command with its stdout in a memfd, then copies that out and, if
+// path is set, into a new cache entry. stderr is not recorded. A run that was
+// stopped or killed by a signal leaves no entry.
+void MemoCommand::record(const std::string& path, const std::string& key) {
+    cout.flush();
+    int memfd = _memfdCreate("smash-memo");
+    int saved = memfd >= 0 ? dup(STDOUT_FILENO) : -1;
+    if (saved < 0 || dup2(memfd, STDOUT_FILENO) < 0) {
+        perror("smash error: memo: dup2 failed");
+        if (memfd >= 0) {
+            close(memfd);
+        }
+        if (saved >= 0) {
+            close(saved);
+        }
+        memfd = -1;
+    }
+    _smash->_status = 0;
+    try {
+        _cmd->execute();
+    } catch (const Command::CommandError& e) {
+        cerr << "smash error: " << e.what() << endl;
+        _smash->_status = 1;
+    }
+    cout.flush();
+    if (memfd < 0) {
+        return;
+    }
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    int status = _smash->lastStatus();
+    bool store = !path.empty() && _cmd->_jid == -1 && status < 128;
+    string temp = path + "." + to_string(getpid());
+    int fd = store ? open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    MemoHeader header = {MEMO_MAGIC, MEMO_VERSION, status, (uint32_t)key.size(),
+                         (uint64_t)lseek(memfd, 0, SEEK_END)};
+    if (store && (fd < 0 || write(fd, &header, sizeof(header)) != sizeof(header) ||
+                  write(fd, key.data(), key.size()) != (ssize_t)key.size())) {
+        perror("smash error: memo: write failed");
+        store = false;
+    }
+    char buf[65536];
+    ssize_t n;
+    off_t offset = 0;
+    while ((n = pread(memfd, buf, sizeof(buf), offset)) > 0) {
+        cout.write(buf, n);
+        if (store && write(fd, buf, n) != n) {
+            perror("smash error: memo: write failed");
+            store = false;
+        }
+        offset += n;
+    }
+    cout.flush();
+    close(memfd);
+    if (fd >= 0) {
+        close(fd);
+        // the entry appears whole or not at all
+        if (!store || rename(temp.c_str(), path.c_str()) < 0) {
+            unlink(temp.c_str());
+        }
+    }
+}
+
+// Ctrl-C at the prompt, or inside a job as seen by the leader's handler
+bool MemoCommand::interrupted() const {
+    if (_leader_interrupted) {
+        return true;
+    }
+    if (signalEventsFd() >= 0) {
+        dispatchSignalEvents();
+        return _smash->interrupts() != _interrupts;
+    }
+    return false;
+}
+
+/* -------------- TextCommand -------------- */
+
+#define TEXT_BUFFER_SIZE (128 * 1024)
+#define TEXT_OPEN_BATCH (64)
+
+// grep without -F is only taken over when the pattern has no special characters
+static const char *GREP_SPECIAL = "\\.[]*^$+?(){}|";
+
+TextCommand::TextCommand(const char* cmd_line, const char* name):
+    BuiltInCommand(cmd_line), _name(name) {
+    FUNC_ENTRY()
+    _supported = true;
+    _closed = false;
+    _interrupts = 0;
+    _status = 0;
+    _failure = 1;
+}
+
+Command *TextCommand::create(const char* cmd_line, char* args[]) {
+    // background jobs are left to the external binaries
+    if (_isBackgroundComamnd(cmd_line)) {
+        return nullptr;
+    }
+    TextCommand *cmd = nullptr;
+    if (strcmp(args[0], "cat") == 0) {
+        cmd = new CatCommand(cmd_line, args);
+    } else if (strcmp(args[0], "head") == 0) {
+        cmd = new HeadCommand(cmd_line, args);
+    } else if (strcmp(args[0], "wc") == 0) {
+        cmd = new WcCommand(cmd_line, args);
+    } else if (strcmp(args[0], "grep") == 0) {
+        cmd = new GrepCommand(cmd_line, args);
+    }
+    if (!cmd) {
+        return nullptr;
+    }
+    // wildcards are expanded here when they only appear in file names,
+    // anything else (a grep pattern) is left to the external binary
+    int wildcards = 0;
+    for (int i = 1; args[i]; ++i) {
+        wildcards += _isComplex(args[i]);
+    }
+    for (const string& file : cmd->_files) {
+        wildcards -= _isComplex(file);
+    }
+    if (!cmd->_supported || wildcards != 0) {
+        delete cmd;
+        return nullptr;
+    }
+    cmd->_files = _expandPaths(cmd->_files);
+    return cmd;
+}
+
+// Runs over the files, "-" or no files at all meaning stdin. Errors are
+// printed the way coreutils does and never thrown, since the builtin may be
+// running as a pipeline stage.
+void TextCommand::execute() {
+    FUNC_ENTRY()
+    cout.flush();
+    _interrupts = SmallShell::getInstance().interrupts();
+    _closed = false;
+    _status = 0;
+    _out.reserve(TEXT_BUFFER_SIZE);
+    if (_files.empty()) {
+        process(STDIN_FILENO, "");
+    }
+    // files are opened and closed a window at a time through AsyncIo, and
+    // read in order in between
+    AsyncIo io;
+    for (size_t first = 0; first < _files.size() && !stopped(); first += TEXT_OPEN_BATCH) {
+        size_t last = min(_files.size(), first + TEXT_OPEN_BATCH);
+        vector<IoRequest> opens, closes;
+        for (size_t i = first; i < last; ++i) {
+            opens.push_back(IoRequest::openat(_files[i] == "-" ? "" : _files[i], O_RDONLY));
+        }
+        io.run(opens);
+        for (size_t i = first; i < last; ++i) {
+            const IoRequest& request = opens[i - first];
+            if (_files[i] == "-") {
+                if (!stopped()) {
+                    process(STDIN_FILENO, _files[i]);
+                }
+                continue;
+            }
+            if (request.result < 0) {
+                flush();
+                cerr << _name << ": " << _files[i] << ": " << strerror(-request.result) << endl;
+                _status = _failure;
+                continue;
+            }
+            if (!stopped()) {
+                process(request.result, _files[i]);
+            }
+            closes.push_back(IoRequest::close(request.result));
+        }
+        io.run(closes);
+    }
+    if (!stopped()) {
+        finish();
+    }
+    flush();
+    smash_status() = _status;
+}
+
+// At the top level a blocking read would hold off Ctrl-C, so the smash's
+// signal events are polled alongside the input.
+ssize_t TextCommand::input(int fd, char *buf, size_t len, const std::string& name) {
+    if (signalEventsFd() >= 0) {
+        struct pollfd pfds[2] = {{fd, POLLIN, 0}, {signalEventsFd(), POLLIN, 0}};
+        while (!stopped()) {
+            if (poll(pfds, 2, -1) < 0 && errno != EINTR) {
+                break;
+            }
+            if (pfds[0].revents) {
+                break;
+            }
+        }
+        if (stopped()) {
+            return 0;
+        }
+    }
+    ssize_t n;
+    while ((n = read(fd, buf, len)) < 0 && errno == EINTR) {}
+    if (n < 0) {
+        flush();
+        cerr << _name << ": " << (name.empty() ? "-" : name) << ": " << strerror(errno) << endl;
+        _status = _failure;
+    }
+    return n;
+}
+
+void TextCommand::output(const char *data, size_t len) {
+    if (_out.size() + len > TEXT_BUFFER_SIZE) {
+        flush();
+    }
+    // large blocks skip the buffer
+    if (len >= TEXT_BUFFER_SIZE / 2) {
+        writeAll(data, len);
+    } else {
+        _out.append(data, len);
+    }
+}
+
+void TextCommand::output(const std::string& data) {
+    output(data.data(), data.length());
+}
+
+void TextCommand::flush() {
+    writeAll(_out.data(), _out.length());
+    _out.clear();
+}
+
+void TextCommand::writeAll(const char *data, size_t len) {
+    while (len > 0 && !_closed) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            // a reader that went away is not an error worth reporting
+            if (errno != EPIPE) {
+                cerr << _name << ": write error: " << strerror(errno) << endl;
+            }
+            _closed = true;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// True once the output is gone or Ctrl-C was pressed, either in the smash
+// itself or, inside a job, as seen by the leader's handler.
+bool TextCommand::stopped() {
+    if (_closed || _leader_interrupted) {
+        return true;
+    }
+    if (signalEventsFd() >= 0) {
+        dispatchSignalEvents();
+        return SmallShell::getInstance().interrupts() != _interrupts;
+    }
+    return false;
+}
+
+/* -------------- CatCommand -------------- */
+
+CatCommand::CatCommand(const char* cmd_line, char* args[]):
+    TextCommand(cmd_line, "cat") {
+    FUNC_ENTRY()
+    for (int i = 1; args[i]; ++i) {
+        if (args[i][0] == '-' && args[i][1]) {
+            _supported = false;
+        }
+        _files.push_back(args[i]);
+    }
+}
+
+void CatCommand::process(int fd, const std::string& name) {
+    vector<char> buf(TEXT_BUFFER_SIZE);
+    ssize_t n;
+    while (!stopped() && (n = input(fd, buf.data(), buf.size(), name)) > 0) {
+        output(buf.data(), n);
+    }
+}
+
+/* -------------- HeadCommand -------------- */
+
+HeadCommand::HeadCommand(const char* cmd_line, char* args[]):
+    TextCommand(cmd_line, "head") {
+    FUNC_ENTRY()
+    _lines = 10;
+    _first = true;
+    for (int i = 1; args[i]; ++i) {
+        string arg = args[i];
+        if (arg[0] != '-' || arg == "-") {
+            _files.push_back(arg);
+            continue;
+        }
+        string count;
+        if (arg == "-n" && args[i + 1]) {
+            count = args[++i];
+        } else if (arg[1] == 'n') {
+            count = arg.substr(2);
+        } else {
+            count = arg.substr(1);
+        }
+        // negative counts, suffixes and other options go to the real head
+        if (!_isNumber(count) || count[0] == '-') {
+            _supported = false;
+            return;
+        }
+        _lines = stoul(count);
+    }
+}
+
+// Counts newlines a whole buffer at a time and only looks for the exact cut
+// in the buffer where the last line ends.
+void HeadCommand::process(int fd, const std::string& name) {
+    if (_files.size() > 1) {
+        output(string(_first ? "" : "\n") + "==> " +
+               (name == "-" ? "standard input" : name) + " <==\n");
+    }
+    _first = false;
+    vector<char> buf(TEXT_BUFFER_SIZE);
+    size_t left = _lines;
+    ssize_t n;
+    while (left > 0 && !stopped() && (n = input(fd, buf.data(), buf.size(), name)) > 0) {
+        size_t lines = textCountByte(buf.data(), n, '\n');
+        if (lines < left) {
+            output(buf.data(), n);
+            left -= lines;
+            continue;
+        }
+        const char *end = buf.data();
+        for (; left > 0; --left) {
+            end = (const char *)memchr(end, '\n', buf.data() + n - end) + 1;
+        }
+        output(buf.data(), end - buf.data());
+    }
+}
+
+/* -------------- WcCommand -------------- */
+
+WcCommand::WcCommand(const char* cmd_line, char* args[]):
+    TextCommand(cmd_line, "wc") {
+    FUNC_ENTRY()
+    _show_lines = _show_words = _show_bytes = false;
+    _width = 0;
+    _total = {0, 0, 0};
+    for (int i = 1; args[i]; ++i) {
+        if (args[i][0] != '-' || !args[i][1]) {
+            _files.push_back(args[i]);
+            continue;
+        }
+        for (const char *c = args[i] + 1; *c; ++c) {
+            if (*c == 'l') {
+                _show_lines = true;
+            } else if (*c == 'w') {
+                _show_words = true;
+            } else if (*c == 'c') {
+                _show_bytes = true;
+            } else {
+                _supported = false;
+                return;
+            }
+        }
+    }
+    if (!_show_lines && !_show_words && !_show_bytes) {
+        _show_lines = _show_words = _show_bytes = true;
+    }
+}
+
+void WcCommand::process(int fd, const std::string& name) {
+    if (_width == 0) {
+        _width = columnWidth();
+    }
+    Counts counts = {0, 0, 0};
+    bool in_word = false;
+    vector<char> buf(TEXT_BUFFER_SIZE);
+    ssize_t n;
+    while (!stopped() && (n = input(fd, buf.data(), buf.size(), name)) > 0) {
+        counts.bytes += n;
+        if (_show_lines) {
+            counts.lines += textCountByte(buf.data(), n, '\n');
+        }
+        if (_show_words) {
+            counts.words += textCountWords(buf.data(), n, in_word);
+        }
+    }
+    _total.lines += counts.lines;
+    _total.words += counts.words;
+    _total.bytes += counts.bytes;
+    print(counts, name);
+}
+
+void WcCommand::finish() {
+    if (_files.size() > 1) {
+        if (_width == 0) {
+            _width = columnWidth();
+        }
+        print(_total, "total");
+    }
+}
+
+// Columns are as wide as coreutils makes them: wide enough for the total size
+// of the regular files, at least 7 when some input is not one (its size is
+// unknown), and unpadded for a single count of a single input.
+size_t WcCommand::columnWidth() {
+    size_t inputs = max<size_t>(_files.size(), 1);
+    size_t width = 1;
+    if (inputs == 1 && _show_lines + _show_words + _show_bytes == 1) {
+        return width;
+    }
+    size_t regular = 0, minimum = 1;
+    for (size_t i = 0; i < inputs; ++i) {
+        struct stat st;
+        bool is_stdin = _files.empty() || _files[i] == "-";
+        if ((is_stdin ? fstat(STDIN_FILENO, &st) : stat(_files[i].c_str(), &st)) < 0) {
+            continue;
+        }
+        if (S_ISREG(st.st_mode)) {
+            regular += st.st_size;
+        } else {
+            minimum = 7;
+        }
+    }
+    for (; regular >= 10; regular /= 10) {
+        ++width;
+    }
+    return max(width, minimum);
+}
+
+void WcCommand::print(const Counts& counts, const std::string& name) {
+    string line;
+    size_t fields[3] = {counts.lines, counts.words, counts.bytes};
+    bool shown[3] = {_show_lines, _show_words, _show_bytes};
+    for (int f = 0; f < 3; ++f) {
+        if (!shown[f]) {
+            continue;
+        }
+        string field = to_string(fields[f]);
+        if (!line.empty()) {
+            line += ' ';
+        }
+        line += string(_width > field.length() ? _width - field.length() : 0, ' ') + field;
+    }
+    if (!name.empty()) {
+        line += " " + name;
+    }
+    output(line + "\n");
+}
+
+/* -------------- GrepCommand -------------- */
+
+GrepCommand::GrepCommand(const char* cmd_line, char* args[]):
+    TextCommand(cmd_line, "grep") {
+    FUNC_ENTRY()
+    _invert = _count = _number = false;
+    _lineno = _matches = _selected = 0;
+    _failure = 2;
+    bool fixed = false, has_pattern = false;
+    for (int i = 1; args[i]; ++i) {
+        if (!has_pattern && args[i][0] == '-' && args[i][1]) {
+            for (const char *c = args[i] + 1; *c; ++c) {
+                if (*c == 'F') {
+                    fixed = true;
+                } else if (*c == 'v') {
+                    _invert = true;
+                } else if (*c == 'c') {
+                    _count = true;
+                } else if (*c == 'n') {
+                    _number = true;
+                } else {
+                    _supported = false;
+                    return;
+                }
+            }
+        } else if (!has_pattern) {
+            _pattern = args[i];
+            has_pattern = true;
+        } else if (args[i][0] == '-' && args[i][1]) {
+            // options after the pattern
+            _supported = false;
+            return;
+        } else {
+            _files.push_back(args[i]);
+        }
+    }
+    _supported = has_pattern &&
+                 (fixed || _pattern.find_first_of(GREP_SPECIAL) == string::npos);
+}
+
+// Input is scanned in blocks of whole lines, a partial line at the end of a
+// read is carried over to the next one and the buffer grows for lines that
+// do not fit.
+void GrepCommand::process(int fd, const std::string& name) {
+    string prefix;
+    if (_files.size() > 1) {
+        prefix = (name == "-" ? "(standard input)" : name) + ":";
+    }
+    _lineno = _matches = 0;
+    vector<char> buf(TEXT_BUFFER_SIZE);
+    size_t have = 0;
+    bool eof = false;
+    while (!eof && !stopped()) {
+        if (have == buf.size()) {
+            buf.resize(buf.size() * 2);
+        }
+        ssize_t n = input(fd, buf.data() + have, buf.size() - have, name);
+        eof = n <= 0;
+        if (!eof) {
+            have += n;
+        }
+        const char *begin = buf.data(), *end = begin + have;
+        if (!eof) {
+            const char *last = (const char *)memrchr(begin, '\n', have);
+            if (!last) {
+                continue;
+            }
+            end = last + 1;
+        }
+        scan(begin, end, prefix);
+        have -= end - begin;
+        memmove(buf.data(), end, have);
+    }
+    if (_count) {
+        output(prefix + to_string(_matches) + "\n");
+    }
+    _selected += _matches;
+}
+
+// Like grep, 1 when no line was selected
+void GrepCommand::finish() {
+    if (_selected == 0 && _status == 0) {
+        _status = 1;
+    }
+    _selected = 0;
+}
+
+// Jumps from match to match with the substring search instead of testing
+// every line; only the lines around a match are delimited.
+void GrepCommand::scan(const char *begin, const char *end, const std::string& prefix) {
+    const char *cursor = begin;
+    const char *match;
+    while (cursor < end && (match = textFind(cursor, end - cursor, _pattern))) {
+        const char *nl = (const char *)memrchr(cursor, '\n', match - cursor);
+        const char *line = nl ? nl + 1 : cursor;
+        nl = (const char *)memchr(match, '\n', end - match);
+        const char *line_end = nl ? nl + 1 : end;
+        if (_invert) {
+            emit(cursor, line, prefix);
+            _lineno++;
+        } else {
+            if (_number) {
+                _lineno += textCountByte(cursor, line - cursor, '\n');
+            }
+            emit(line, line_end, prefix);
+        }
+        cursor = line_end;
+    }
+    if (_invert) {
+        emit(cursor, end, prefix);
+    } else if (_number) {
+        _lineno += textCountByte(cursor, end - cursor, '\n');
+    }
+}
+
+// Prints, or only counts, every line in [begin, end).
+void GrepCommand::emit(const char *begin, const char *end, const std::string& prefix) {
+    while (begin < end) {
+        const char *nl = (const char *)memchr(begin, '\n', end - begin);
+        const char *line_end = nl ? nl + 1 : end;
+        _lineno++;
+        _matches++;
+        if (!_count) {
+            output(prefix);
+            if (_number) {
+                output(to_string(_lineno) + ":");
+            }
+            output(begin, line_end - begin);
+            if (!nl) {
+                output("\n", 1);
+            }
+        }
+        begin = line_end;
+    }
+}
+
+/* -------------- ParallelCommand -------------- */
+
+ParallelCommand::ParallelCommand(const char* cmd_line):
+    Command(cmd_line) {
+    FUNC_ENTRY()
+    string line(cmd_line);
+    _background_cmd = _isBackgroundComamnd(cmd_line);
+    _removeBackgroundSign(line);
+
+    vector<string> words;
+    std::istringstream iss(_trim(line));
+    for (string s; iss >> s; ) {
+        words.push_back(s);
+    }
+
+    _max_jobs = 0;
+    size_t i = 1;
+    if (i < words.size() && words[i].compare(0, 2, "-j") == 0) {
+        string count = words[i].substr(2);
+        if (count.empty() && ++i < words.size()) {
+            count = words[i];
+        }
+        if (!_isNumber(count) || stoi(count) < 1) {
+            throw Command::CommandError("parallel: invalid arguments");
+        }
+        _max_jobs = stoi(count);
+        ++i;
+    }
+    if (_max_jobs == 0) {
+        _max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    _read_stdin = true;
+    for (; i < words.size(); ++i) {
+        if (words[i] == ":::") {
+            _read_stdin = false;
+            _inputs.assign(words.begin() + i + 1, words.end());
+            break;
+        }
+        _template.push_back(words[i]);
+    }
+    // a background job's stdin is the shell's own, whose lines are commands
+    if (_template.empty() || (_read_stdin && _background_cmd)) {
+        throw Command::CommandError("parallel: invalid arguments");
+    }
+
+    void *shared = mmap(nullptr, sizeof(Progress), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        throw Command::CommandError("parallel: cannot allocate progress counters");
+    }
+    _progress = static_cast<Progress *>(shared);
+    _progress->total = _read_stdin ? -1 : _inputs.size();
+    _progress->running = 0;
+    _progress->done = 0;
+    _progress->failed = 0;
+}
+
+ParallelCommand::~ParallelCommand() {
+    munmap(_progress, sizeof(Progress));
+}
+
+std::string ParallelCommand::progress() {
+    string ret = " (" + to_string(_progress->done);
+    if (_progress->total >= 0) {
+        ret += "/" + to_string(_progress->total);
+    }
+    ret += " done, " + to_string(_progress->running) + " running";
+    if (_progress->failed) {
+        ret += ", " + to_string(_progress->failed) + " failed";
+    }
+    return ret + ")";
+}
+
+pid_t ParallelCommand::spawn(const std::string& input) {
+    // substitute every {} in the template, or append the input if there is none
+    vector<string> argv;
+    string joined;
+    bool substituted = false;
+    for (string word : _template) {
+        for (size_t pos = word.find("{}"); pos != string::npos;
+             pos = word.find("{}", pos + input.length())) {
+            word.replace(pos, 2, input);
+            substituted = true;
+        }
+        argv.push_back(word);
+    }
+    if (!substituted) {
+        argv.push_back(input);
+    }
+    for (const string& word : argv) {
+        joined += (joined.empty() ? "" : " ") + word;
+    }
+    if (_isComplex(joined)) {
+        argv = {"/bin/bash", "-c", joined};
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+    } else if (pid == 0) {
+        vector<char *> args;
+        for (string& word : argv) {
+            args.push_back(&word[0]);
+        }
+        args.push_back(nullptr);
+        execvp(args[0], args.data());
+        perror("smash error: execvp failed");
+        _exitChild(1);
+    }
+    return pid;
+}
+
+void ParallelCommand::coordinate() {
+    FUNC_ENTRY()
+    if (_read_stdin) {
+        char buf[4096];
+        string pending;
+        ssize_t n;
+        while ((n = read(0, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+            pending.append(buf, n > 0 ? n : 0);
+            for (size_t pos; (pos = pending.find('\n')) != string::npos; ) {
+                string item = _trim(pending.substr(0, pos));
+                if (!item.empty()) {
+                    _inputs.push_back(item);
+                }
+                pending.erase(0, pos + 1);
+            }
+        }
+        if (!_trim(pending).empty()) {
+            _inputs.push_back(_trim(pending));
+        }
+        _progress->total = _inputs.size();
+    }
+
+    // keep at most _max_jobs children alive, refilling a slot whenever wait()
+    // reports that one of them exited
+    size_t next = 0;
+    while ((!_leader_interrupted && next < _inputs.size()) || _progress->running > 0) {
+        while (!_leader_interrupted && next < _inputs.size()
+               && _progress->running < _max_jobs) {
+            if (spawn(_inputs[next++]) > 0) {
+                _progress->running++;
+            } else {
+                _progress->failed++;
+                _progress->done++;
+            }
+        }
+        int status;
+        if (wait(&status) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        _progress->running--;
+        _progress->done++;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            _progress->failed++;
+        }
+    }
+    _exitChild(_progress->failed ? 1 : 0);
+}
+
+void ParallelCommand::execute() {
+    FUNC_ENTRY()
+    OutputCapture *capture = _background_cmd ? _smash->_job_list.startCapture() : nullptr;
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("smash error: fork failed");
+        delete capture;
+    } else if (pid == 0) {
+        _smash->setJobGroup(0);
+        _setupJobLeader();
+        if (capture) {
+            capture->attach();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.defaultPriority().apply(0, false);
+        }
+        coordinate();
+    } else {
+        _pid = pid;
+        _group = _smash->setJobGroup(pid);
+        if (capture) {
+            capture->closeWriter();
+        }
+        if (_background_cmd) {
+            _smash->_job_list.addJob(this, false, capture);
+        } else {
+            _smash->waitForeground(this);
+        }
+    }
+}
@@ -1,262 +1,916 @@
-#ifndef SMASH_COMMAND_H_
-#define SMASH_COMMAND_H_
-
-#include <string>
-#include <vector>
-#include <list>
-
-#define COMMAND_ARGS_MAX_LENGTH (80)
-#define COMMAND_MAX_ARGS (20)
-
-class SmallShell;
-class Command {
-public:
-    Command(const char* cmd_line);
-    virtual ~Command() {}
-    virtual void execute() = 0;
-    pid_t pid();
-    int _jid;
-    const char *cmd_line();
-
-    class CommandError;
-private:
-    char* _cmd_line;
-protected:
-    SmallShell *_smash;
-    pid_t _pid;
-};
-
-class Command::CommandError {
-private:
-    std::string _message;
-public:
-    CommandError(const std::string& message);
-    const std::string& what() const;
-};
-
-#define DECLARE_SMALL_SHELL()                       \
-    /* todo: please declare it after JobList */     \
-class SmallShell {                                  \
-private:                                            \
-    SmallShell();                                   \
-    friend class BuiltInCommand;                    \
-    friend class ExternalCommand;                   \
-                                                    \
-    std::string _name;                              \
-    char *_cwd;                                     \
-    bool _cd_called;                                \
-    JobsList _job_list;                             \
-    Command* _running_cmd;                          \
-                                                    \
-public:                                             \
-    static SmallShell& getInstance();               \
-    SmallShell(SmallShell const&)      = delete;    \
-    void operator=(SmallShell const&)  = delete;    \
-    ~SmallShell() {}                                \
-                                                    \
-    Command *CreateCommand(const char* cmd_line);   \
-    bool executeCommand(const char* cmd_line);      \
-    const std::string& name() const;                \
-    void handle_ctrl_z(int sig_num);                \
-    void handle_ctrl_c(int sig_num);                \
-};
-
-
-class BuiltInCommand : public Command {
-protected:
-    std::string& smash_name();
-    char *smash_cwd();
-    bool &smash_cd_called();
-    Command* &smash_running_cmd();
-public:
-    BuiltInCommand(const char* cmd_line);
-    virtual ~BuiltInCommand() {}
-};
-
-class ExternalCommand : public Command {
-public:
-    ExternalCommand(const char* cmd_line);
-    virtual ~ExternalCommand() {
-        delete[] _args;
-        delete _command;
-    }
-    void execute() override;
-private:
-    bool _background_cmd;
-    char** _args;
-    char* _command;
-};
-
-class ChpromptCommand : public BuiltInCommand {
-private:
-    std::string _new_name;
-public:
-    ChpromptCommand(const char* cmd_line, char* args[]);
-    virtual ~ChpromptCommand() {}
-    void execute() override;
-};
-
-class ShowPidCommand : public BuiltInCommand {
-public:
-    ShowPidCommand(const char* cmd_line, char* args[]);
-    virtual ~ShowPidCommand() {}
-    void execute() override;
-};
-
-class GetCurrDirCommand : public BuiltInCommand {
-public:
-    GetCurrDirCommand(const char* cmd_line, char* args[]);
-    virtual ~GetCurrDirCommand() {}
-    void execute() override;
-};
-
-class ChangeDirCommand : public BuiltInCommand {
-private:
-    char *_new_dir;
-public:
-    ChangeDirCommand(const char* cmd_line, char* args[]);
-    virtual ~ChangeDirCommand() {}
-    void execute() override;
-};
-
-class JobsList {
-public:
-    JobsList();
-    JobsList(const JobsList& jl)            = delete;
-    JobsList& operator=(const JobsList& jl) = delete;
-    ~JobsList()                             = default;
-
-    void addJob(Command* cmd, bool stopped = false);
-    void removeJobById(int jobId);
-    void removeFinishedJobs();
-    void printJobsList();
-    void killAllJobs();
-
-    class JobEntry;
-    JobEntry *getJobById(int jobId);
-    JobEntry *getLastJob(int* lastJobId);
-    JobEntry *getLastStoppedJob(int *jobId);
-
-private:
-    std::list<JobEntry *> _jobs;
-    int _next_jid;
-};
-
-class JobsList::JobEntry {
-public:
-    JobEntry(Command *cmd, bool stopped);
-    JobEntry(const JobEntry&)       = delete;
-    void operator=(const JobEntry&) = delete;
-    ~JobEntry()                     = default;
-
-    Command *cmd();
-    bool &stopped();
-    pid_t pid() const;
-
-private:
-    int _jid;
-    pid_t _pid;
-    bool _stopped;
-    time_t _start;
-    Command *_cmd;
-
-    friend JobsList;
-};
-
-DECLARE_SMALL_SHELL()
-
-class JobsCommand : public BuiltInCommand {
-    JobsList *_jobs;
-public:
-    JobsCommand(const char* cmd_line, JobsList* jobs);
-    virtual ~JobsCommand() {}
-    void execute() override;
-};
-
-class ForegroundCommand : public BuiltInCommand {
-public:
-    ForegroundCommand(const char* cmd_line, char* args[], JobsList* jobs);
-    virtual ~ForegroundCommand() {}
-    void execute() override;
-private:
-    Command *_cmd;
-};
-
-class BackgroundCommand : public BuiltInCommand {
-public:
-    BackgroundCommand(const char* cmd_line, char* args[], JobsList* jobs);
-    virtual ~BackgroundCommand() {}
-    void execute() override;
-private:
-    Command *_cmd;
-};
-
-class QuitCommand : public BuiltInCommand {
-    bool _kill;
-    JobsList* _jobs;
-public:
-    QuitCommand(const char* cmd_line, char* args[], JobsList* jobs);
-    virtual ~QuitCommand() {}
-    void execute() override;
-};
-
-class KillCommand : public BuiltInCommand {
-public:
-    KillCommand(const char* cmd_line, char* args[], JobsList* jobs);
-    virtual ~KillCommand() {}
-    void execute() override;
-private:
-    pid_t _pid;
-    int _signum;
-};
-
-class RedirectionCommand : public Command {
-public:
-    RedirectionCommand(const char* cmd_line);
-    virtual ~RedirectionCommand() {}
-    void execute() override;
-private:
-    std::string _filename;
-    Command *_cmd;
-    bool _append;
-};
-
-class PipeCommand : public Command {
-public:
-    PipeCommand(const char* cmd_line);
-    virtual ~PipeCommand() {}
-    void execute() override;
-private:
-    Command* _cmds[2];
-};
-
-class GetFileTypeCommand : public BuiltInCommand {
-public:
-    GetFileTypeCommand(const char* cmd_line, char* args[]);
-    virtual ~GetFileTypeCommand() {}
-    void execute() override;
-private:
-    char* _path;
-};
-
-class ChmodCommand : public BuiltInCommand {
-public:
-    ChmodCommand(const char* cmd_line, char* args[]);
-    virtual ~ChmodCommand() {}
-    void execute() override;
-private:
-    mode_t _new_mode;
-    char* _path;
-};
-
-class SetcoreCommand : public BuiltInCommand {
-public:
-    SetcoreCommand(const char* cmd_line, char* args[], JobsList* jobs);
-    virtual ~SetcoreCommand() {}
-    void execute() override;
-private:
-    int _core;
-    pid_t _pid;
-};
-
+#ifndef SMASH_COMMAND_H_
+#define SMASH_COMMAND_H_
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <functional>
+#include <stdint.h>
+#include "jobdb.h"
+#include "jobtable.h"
+#include "asyncio.h"
+#include "procscan.h"
+
+#define COMMAND_ARGS_MAX_LENGTH (80)
+#define COMMAND_MAX_ARGS (20)
+
+class SmallShell;
+
+// What a command line runs, as decided by SmallShell::classify(). Script plans
+// store these, so new kinds go at the end and bump SCRIPT_PLAN_VERSION.
+enum CommandKind : uint8_t {
+    CMD_NONE,
+    CMD_SUBMIT,
+    CMD_REPEAT,
+    CMD_MEMO,
+    CMD_PIPE,
+    CMD_REDIRECTION,
+    CMD_CHPROMPT,
+    CMD_SHOWPID,
+    CMD_PWD,
+    CMD_CD,
+    CMD_JOBS,
+    CMD_FG,
+    CMD_BG,
+    CMD_WAIT,
+    CMD_QUIT,
+    CMD_KILL,
+    CMD_GETFILEINFO,
+    CMD_CHMOD,
+    CMD_TAIL,
+    CMD_TOUCH,
+    CMD_SETCORE,
+    CMD_PARALLEL,
+    CMD_SETPRIO,
+    CMD_CAPTURE,
+    CMD_JOBLOG,
+    CMD_RUNDAG,
+    CMD_PIPESTAT,
+    CMD_XARGS,
+    CMD_TEXT,
+    CMD_PGREP,
+    CMD_CP,
+    CMD_EXTERNAL,
+};
+class Command {
+public:
+    Command(const char* cmd_line);
+    virtual ~Command() {}
+    virtual void execute() = 0;
+    virtual std::string progress();
+    virtual std::string details();
+    virtual bool reap(int *status);
+    pid_t pid();
+    bool group();
+    int _jid;
+    const char *cmd_line();
+    void sendSignal(int sig_num, int pidfd = -1);
+
+    class CommandError;
+private:
+    char* _cmd_line;
+protected:
+    SmallShell *_smash;
+    pid_t _pid;
+    bool _group;
+};
+
+class Command::CommandError {
+private:
+    std::string _message;
+public:
+    CommandError(const std::string& message);
+    const std::string& what() const;
+};
+
+#define DECLARE_SMALL_SHELL()                       \
+    /* todo: please declare it after JobList */     \
+class SmallShell {                                  \
+private:                                            \
+    SmallShell();                                   \
+    friend class BuiltInCommand;                    \
+    friend class ExternalCommand;                   \
+    friend class ParallelCommand;                   \
+    friend class RedirectionCommand;                \
+    friend class ForkedBuiltinCommand;              \
+    friend class PipeCommand;                       \
+    friend class MemoCommand;                       \
+    friend class SmashServer;                       \
+    friend class SmashEngine;                       \
+                                                    \
+    std::string _name;                              \
+    char *_cwd;                                     \
+    bool _cd_called;                                \
+    JobsList _job_list;                             \
+    Command* _running_cmd;                          \
+    pid_t _pgid;                                    \
+    bool _serving;                                  \
+    int _interrupts;                                \
+    Command* _detached_cmd;                         \
+    int _status;                                    \
+    bool _subreaper;                                \
+    /* command name to path, for PATH as it was */  \
+    std::map<std::string, std::string> _commands;   \
+    std::string _commands_path;                     \
+    /* stdin read ahead of the line being run */    \
+    std::string _input;                             \
+    static SmallShell *_current;                    \
+                                                    \
+public:                                             \
+    static SmallShell& getInstance();               \
+    static SmallShell *makeCurrent(SmallShell*);    \
+    SmallShell(SmallShell const&)      = delete;    \
+    void operator=(SmallShell const&)  = delete;    \
+    ~SmallShell() { delete[] _cwd; }                \
+                                                    \
+    Command *CreateCommand(const char* cmd_line);   \
+    Command *CreateCommand(const char* cmd_line,    \
+                           CommandKind kind,        \
+                           char* args[]);           \
+    CommandKind classify(const char* cmd_line,      \
+                         char* args[]);             \
+    bool executeCommand(const char* cmd_line);      \
+    bool executeCommand(const char* cmd_line,       \
+                        CommandKind kind,           \
+                        char* args[]);              \
+    int executeOnce(const char* cmd_line);          \
+    int lastStatus() const;                         \
+    const std::string& name() const;                \
+    std::string& input();                           \
+    void handle_ctrl_z(int sig_num);                \
+    void handle_ctrl_c(int sig_num);                \
+    void handle_io(int sig_num);                    \
+    int interrupts() const;                         \
+    bool setJobGroup(pid_t pid);                    \
+    void waitForeground(Command *cmd);              \
+    bool becomeSubreaper();                         \
+    void reapOrphans();                             \
+    bool openJobDb(const std::string& path);        \
+    bool openJobTable(const std::string& name);     \
+    void runQueue();                                \
+    void refreshJobs();                             \
+    std::string lookupCommand(const char *name);    \
+};
+
+
+class BuiltInCommand : public Command {
+protected:
+    std::string& smash_name();
+    char *smash_cwd();
+    bool &smash_cd_called();
+    Command* &smash_running_cmd();
+    int &smash_status();
+public:
+    BuiltInCommand(const char* cmd_line);
+    virtual ~BuiltInCommand() {}
+};
+
+class ExternalCommand : public Command {
+public:
+    ExternalCommand(const char* cmd_line);
+    virtual ~ExternalCommand() {
+        delete[] _args;
+        delete _command;
+    }
+    void execute() override;
+    bool background() const;
+    void replaceProcess();
+private:
+    bool _background_cmd;
+    char** _args;
+    char* _command;
+};
+
+// A job left behind by a previous smash and re-adopted from the job journal.
+// It is not our child, so it is watched and reaped through its pidfd.
+class AdoptedCommand : public Command {
+public:
+    AdoptedCommand(const char* cmd_line, pid_t pid, int pidfd);
+    virtual ~AdoptedCommand();
+    void execute() override {}
+    bool reap(int *status) override;
+    int pidfd() const;
+private:
+    int _pidfd;
+};
+
+class ChpromptCommand : public BuiltInCommand {
+private:
+    std::string _new_name;
+public:
+    ChpromptCommand(const char* cmd_line, char* args[]);
+    virtual ~ChpromptCommand() {}
+    void execute() override;
+};
+
+class ShowPidCommand : public BuiltInCommand {
+public:
+    ShowPidCommand(const char* cmd_line, char* args[]);
+    virtual ~ShowPidCommand() {}
+    void execute() override;
+};
+
+class GetCurrDirCommand : public BuiltInCommand {
+public:
+    GetCurrDirCommand(const char* cmd_line, char* args[]);
+    virtual ~GetCurrDirCommand() {}
+    void execute() override;
+};
+
+class ChangeDirCommand : public BuiltInCommand {
+private:
+    char *_new_dir;
+public:
+    ChangeDirCommand(const char* cmd_line, char* args[]);
+    virtual ~ChangeDirCommand() {}
+    void execute() override;
+};
+
+// Bounded in-memory log of a background job's stdout/stderr. The job writes
+// into a pipe which the smash drains, on SIGIO, into a ring buffer backed by a
+// memfd that is mapped twice back to back, so any window of the ring can be
+// handed to write() as one contiguous range.
+class OutputCapture {
+public:
+    static OutputCapture *create(size_t capacity);
+    OutputCapture(const OutputCapture&)  = delete;
+    void operator=(const OutputCapture&) = delete;
+    ~OutputCapture();
+
+    void attach();
+    void closeWriter();
+    ssize_t fill(size_t len);
+    bool drain();
+    bool eof() const;
+    size_t size() const;
+    unsigned long long head() const;
+    void evict(size_t bytes);
+    void print(unsigned long long from, int lines = -1);
+
+private:
+    OutputCapture();
+
+    int _memfd;
+    int _pipe[2];
+    char *_base;
+    size_t _capacity;
+    unsigned long long _head;
+    unsigned long long _tail;
+    bool _eof;
+};
+
+// Scheduling settings for a job: nice level, CPU scheduling policy and I/O
+// priority, each only applied when set.
+struct JobPriority {
+    JobPriority();
+    bool empty() const;
+    void parse(char* args[], const std::string& cmd);
+    bool apply(pid_t pid, bool group) const;
+    static std::string describe(pid_t pid);
+
+    bool set_nice;
+    int nice;
+    int policy;
+    int rt_priority;
+    int ioprio;
+};
+
+// Admission limits of the submit queue, a limit of 0 is disabled. The load
+// is the 1 minute load average, cpu and mem are the "some avg10" percentages
+// from /proc/pressure.
+struct QueueLimits {
+    QueueLimits();
+    bool overloaded() const;
+
+    int max_jobs;
+    double max_load;
+    double max_cpu;
+    double max_mem;
+};
+
+// How pipelines size their pipes with F_SETPIPE_SZ: the kernel default, a
+// static size, sized to the throughput measured while they run, or the
+// largest size allowed. Sizes never exceed /proc/sys/fs/pipe-max-size.
+struct PipePolicy {
+    enum Mode { DEFAULT, STATIC, ADAPTIVE, MAX };
+
+    PipePolicy();
+    void parse(const std::string& policy);
+    int initialSize() const;
+    int adaptedSize(double rate) const;
+    std::string describe() const;
+    static int maxSize();
+
+    Mode mode;
+    int size;
+};
+
+class JobsList {
+public:
+    JobsList();
+    JobsList(const JobsList& jl)            = delete;
+    JobsList& operator=(const JobsList& jl) = delete;
+    ~JobsList();
+
+    void addJob(Command* cmd, bool stopped = false, OutputCapture *capture = nullptr);
+    void removeJobById(int jobId);
+    void removeFinishedJobs();
+    void printJobsList(bool verbose = false);
+    void killAllJobs(int grace_ms = 0);
+
+    class JobEntry;
+    // a job reaped before anything waited for it, kept for wait to report
+    struct FinishedJob {
+        int jid;
+        std::string cmd_line;
+        int status;
+    };
+    bool waitJobs(std::vector<JobEntry *> jobs, bool any, int timeout_ms,
+                  std::vector<std::pair<int, int>>& reaped);
+    JobEntry *getJobById(int jobId);
+    std::vector<JobEntry *> getJobsBySpec(const std::string& spec,
+                                          std::vector<FinishedJob> *finished = nullptr);
+    std::vector<JobEntry *> getAllJobs();
+    std::vector<FinishedJob> getFinishedJobs() const;
+    void forgetFinished(int jid);
+    JobEntry *getLastJob(int* lastJobId);
+    JobEntry *getLastStoppedJob(int *jobId);
+    void setReapedHook(std::function<void(JobEntry *, int)> hook);
+    void setCapture(bool on, size_t limit = 0);
+    void setJobDb(JobDb *db);
+    JobPriority& defaultPriority();
+    void journal(Command *cmd, JobState state);
+    void setJobTable(JobTable *table);
+    void publish();
+    OutputCapture *startCapture();
+    void drainCaptures();
+    int enqueue(const std::string& cmd_line, int priority);
+    bool dequeue(std::string& cmd_line, int& jid, bool& pressure);
+    std::vector<int> getQueuedBySpec(const std::string& spec);
+    void cancelQueued(int jid);
+    bool queueEmpty() const;
+    QueueLimits& queueLimits();
+    PipePolicy& pipePolicy();
+
+private:
+    void freeCapture(JobEntry *job);
+
+    struct QueuedJob {
+        int jid;
+        int priority;
+        std::string cmd_line;
+        time_t submitted;
+    };
+
+    std::list<JobEntry *> _jobs;
+    int _next_jid;
+    bool _capture_on;
+    size_t _capture_limit;
+    std::map<pid_t, OutputCapture *> _detached_captures;
+    JobDb *_db;
+    pid_t _db_owner;
+    JobTable *_table;
+    pid_t _table_owner;
+    JobPriority _default_priority;
+    std::map<pid_t, uint64_t> _start_times;
+    std::function<void(JobEntry *, int)> _reaped_hook;
+    // in the order they were reaped
+    std::list<FinishedJob> _finished;
+    // sorted by jid, which is also the order of submission
+    std::list<QueuedJob> _queue;
+    QueueLimits _queue_limits;
+    PipePolicy _pipe_policy;
+};
+
+class JobsList::JobEntry {
+public:
+    JobEntry(Command *cmd, bool stopped);
+    JobEntry(const JobEntry&)       = delete;
+    void operator=(const JobEntry&) = delete;
+    ~JobEntry()                     = default;
+
+    Command *cmd();
+    bool &stopped();
+    bool &awaited();
+    pid_t pid() const;
+    OutputCapture *capture();
+    void sendSignal(int sig_num);
+
+private:
+    void closePidfd();
+
+    int _jid;
+    pid_t _pid;
+    // opened while the process was still known to be the job's, so a signal
+    // sent through it can never reach a process that reused the pid
+    int _pidfd;
+    bool _stopped;
+    // a builtin collects this job itself, so the list must not reap it
+    bool _awaited;
+    time_t _start;
+    Command *_cmd;
+    OutputCapture *_capture;
+
+    friend JobsList;
+};
+
+DECLARE_SMALL_SHELL()
+
+class JobsCommand : public BuiltInCommand {
+    JobsList *_jobs;
+    bool _verbose;
+public:
+    JobsCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~JobsCommand() {}
+    void execute() override;
+};
+
+class ForegroundCommand : public BuiltInCommand {
+public:
+    ForegroundCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~ForegroundCommand() {}
+    void execute() override;
+private:
+    Command *_cmd;
+};
+
+class BackgroundCommand : public BuiltInCommand {
+public:
+    BackgroundCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~BackgroundCommand() {}
+    void execute() override;
+private:
+    std::vector<JobsList::JobEntry *> _targets;
+};
+
+class WaitCommand : public BuiltInCommand {
+public:
+    WaitCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~WaitCommand() {}
+    void execute() override;
+private:
+    JobsList *_jobs;
+    std::vector<JobsList::JobEntry *> _targets;
+    std::vector<JobsList::FinishedJob> _finished;
+    bool _all;
+    bool _any;
+    int _timeout_ms;
+};
+
+class QuitCommand : public BuiltInCommand {
+    bool _kill;
+    int _grace_ms;
+    JobsList* _jobs;
+public:
+    QuitCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~QuitCommand() {}
+    void execute() override;
+};
+
+class KillCommand : public BuiltInCommand {
+public:
+    KillCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~KillCommand() {}
+    void execute() override;
+private:
+    JobsList *_jobs;
+    std::vector<JobsList::JobEntry *> _targets;
+    std::vector<int> _queued;
+    int _signum;
+};
+
+// pgrep, and pkill, which is pgrep with a signal for what it finds: reaches
+// any process, not just jobs (see procscan.h).
+class PgrepCommand : public BuiltInCommand {
+public:
+    PgrepCommand(const char* cmd_line, char* args[]);
+    virtual ~PgrepCommand();
+    void execute() override;
+private:
+    ProcQuery _query;
+    regex_t _pattern;
+    bool _long;
+    int _signum;                // 0 for pgrep
+};
+
+// Runs a builtin that can keep the smash busy for long in a child of its own,
+// as an external command would run, so that a server goes on serving its
+// other sessions meanwhile.
+class ForkedBuiltinCommand : public Command {
+public:
+    ForkedBuiltinCommand(const char* cmd_line, Command *cmd);
+    virtual ~ForkedBuiltinCommand() {}
+    void execute() override;
+private:
+    Command *_cmd;
+};
+
+class RedirectionCommand : public Command {
+public:
+    RedirectionCommand(const char* cmd_line);
+    virtual ~RedirectionCommand() {}
+    void execute() override;
+private:
+    struct Target {
+        std::string filename;
+        bool append;
+    };
+    static int openTarget(const Target& target);
+    void fanOut();
+
+    std::vector<Target> _targets;
+    Command *_cmd;
+    bool _background_cmd;
+};
+
+class PipeCommand : public Command {
+public:
+    PipeCommand(const char* cmd_line);
+    virtual ~PipeCommand();
+    void execute() override;
+    std::string details() override;
+    void printStats();
+private:
+    void runStages();
+    void sample(pid_t pids[2], long elapsed_ms);
+    std::vector<PipeCommand *> chain();
+    std::string bottleneck();
+
+    // What the job's leader measures on the pipe between the two stages,
+    // shared with the smash for pipestat. A stage's figures cover all the
+    // processes it forked.
+    struct Stats {
+        volatile bool sampled;
+        volatile int capacity;
+        volatile int fill;
+        volatile double fill_avg;       // share of the capacity in use, smoothed
+        volatile long long bytes;       // written by the first stage so far
+        volatile double rate;           // bytes per second, smoothed
+        volatile double cpu[2];         // CPUs used by each stage, smoothed
+        volatile int resizes;
+    };
+
+    Command* _cmds[2];
+    bool _background_cmd;
+    Stats *_stats;
+    // the leader's previous readings
+    unsigned long long _last_ticks[2];
+    unsigned long long _last_written;
+};
+
+class PipeStatCommand : public BuiltInCommand {
+public:
+    PipeStatCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~PipeStatCommand() {}
+    void execute() override;
+private:
+    JobsList *_jobs;
+    int _jid;
+    bool _policy;
+    std::string _new_policy;
+};
+
+class GetFileTypeCommand : public BuiltInCommand {
+public:
+    GetFileTypeCommand(const char* cmd_line, char* args[]);
+    virtual ~GetFileTypeCommand() {}
+    void execute() override;
+private:
+    std::vector<std::string> _paths;
+};
+
+class ChmodCommand : public BuiltInCommand {
+public:
+    ChmodCommand(const char* cmd_line, char* args[]);
+    virtual ~ChmodCommand() {}
+    void execute() override;
+private:
+    mode_t _new_mode;
+    std::vector<std::string> _paths;
+};
+
+// cp -r|-R source... target copies through AsyncIo, the files of whole
+// directory trees at once on its thread pool. create() returns nullptr for a
+// plain cp, which the binary does as fast with no pool to set up, and for
+// other options and background jobs, which then run the external binary.
+class CpCommand : public BuiltInCommand {
+public:
+    static Command *create(const char* cmd_line, char* args[]);
+    virtual ~CpCommand() {}
+    void execute() override;
+private:
+    CpCommand(const char* cmd_line);
+    void copy(const std::string& source, const std::string& target, const struct stat& st);
+    void copyTree(const std::string& source, const std::string& target, const struct stat& st);
+    void runCopies();
+    void error(const std::string& message, int error_number = 0);
+
+    std::vector<std::string> _sources;
+    std::string _target;
+    AsyncIo *_io;
+    std::vector<IoRequest> _copies;     // pending file copies
+    std::vector<IoRequest> _modes;      // the copied directories' modes
+    int _status;
+};
+
+class TailCommand : public BuiltInCommand {
+public:
+    static Command *create(const char* cmd_line, char* args[]);
+    virtual ~TailCommand() {}
+    void execute() override;
+private:
+    TailCommand(const char* cmd_line);
+
+    size_t _lines;
+    std::string _path;
+};
+
+class TouchCommand : public BuiltInCommand {
+public:
+    static Command *create(const char* cmd_line, char* args[]);
+    virtual ~TouchCommand() {}
+    void execute() override;
+private:
+    TouchCommand(const char* cmd_line);
+
+    std::vector<std::string> _paths;
+    time_t _time;
+};
+
+class CaptureCommand : public BuiltInCommand {
+public:
+    CaptureCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~CaptureCommand() {}
+    void execute() override;
+private:
+    JobsList *_jobs;
+    bool _on;
+    size_t _limit;
+};
+
+class JobLogCommand : public BuiltInCommand {
+public:
+    JobLogCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~JobLogCommand() {}
+    void execute() override;
+private:
+    JobsList *_jobs;
+    JobsList::JobEntry *_job;
+    bool _follow;
+    int _lines;
+};
+
+class SetcoreCommand : public BuiltInCommand {
+public:
+    SetcoreCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~SetcoreCommand() {}
+    void execute() override;
+private:
+    int _core;
+    std::vector<JobsList::JobEntry *> _targets;
+};
+
+class SetprioCommand : public BuiltInCommand {
+public:
+    SetprioCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~SetprioCommand() {}
+    void execute() override;
+private:
+    JobsList *_jobs;
+    std::vector<JobsList::JobEntry *> _targets;
+    JobPriority _priority;
+    bool _default;
+};
+
+class SubmitCommand : public BuiltInCommand {
+public:
+    SubmitCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~SubmitCommand() {}
+    void execute() override;
+private:
+    JobsList *_jobs;
+    QueueLimits _limits;
+    int _priority;
+    std::string _cmd_line;
+    bool _show;
+};
+
+class RunDagCommand : public BuiltInCommand {
+public:
+    RunDagCommand(const char* cmd_line, char* args[], JobsList* jobs);
+    virtual ~RunDagCommand() {}
+    void execute() override;
+private:
+    enum NodeState { WAITING, RUNNING, DONE, FAILED, SKIPPED };
+    struct Node {
+        std::string name;
+        std::string cmd_line;
+        std::vector<size_t> deps;
+        std::vector<size_t> dependents;
+        size_t pending;
+        NodeState state;
+        long start_ms;
+        long end_ms;
+        // longest chain of work ending with this node, and its previous node
+        long path_ms;
+        int path_prev;
+    };
+    void parse(std::istream& file);
+    void launch(size_t node);
+    void finish(size_t node, int status);
+    void skip(size_t node, const std::string& cause);
+    void summary(long elapsed_ms);
+
+    JobsList *_jobs;
+    int _max_jobs;
+    std::vector<Node> _nodes;
+    std::map<int, size_t> _running;
+    std::list<size_t> _ready;
+};
+
+class XargsCommand : public BuiltInCommand {
+public:
+    XargsCommand(const char* cmd_line, char* args[]);
+    virtual ~XargsCommand() {}
+    void execute() override;
+private:
+    ssize_t input(char *buf, size_t len);
+    void addItem(const char *data, size_t len);
+    void launch();
+    void reapOne();
+
+    char _delim;
+    int _max_procs;
+    size_t _max_args;
+    std::vector<std::string> _cmd;
+    size_t _budget;
+    // the pending invocation's arguments, NUL-separated, and where each starts
+    std::string _batch;
+    std::vector<size_t> _offsets;
+    size_t _batch_cost;
+    std::vector<std::pair<pid_t, int>> _running;
+    int _failures;
+    bool _too_long;
+    int _interrupts;
+    bool _interrupted;
+};
+
+// repeat and watch plan the command line once, through CreateCommand, and
+// execute the same Command object on every run.
+class RepeatCommand : public BuiltInCommand {
+public:
+    RepeatCommand(const char* cmd_line, char* args[]);
+    virtual ~RepeatCommand() {}
+    void execute() override;
+private:
+    bool runOnce(int memfd, std::string& last, long& elapsed_ns);
+    bool stopped() const;
+
+    std::string _name;
+    long _count;            // runs to make, 0 until Ctrl-C
+    long _interval_ns;      // between run starts, 0 for back to back
+    bool _changes;          // print a run's output only when it changed
+    Command *_cmd;
+    int _interrupts;
+};
+
+// memo [-d dir] [-e var]... [-i file]... cmd_line: replays the stdout and exit
+// status the command line had the last time it ran with the same key, made of
+// the command line, the working directory, the variables named with -e and
+// the files named with -i. The command line may be a pipeline or a
+// redirection; with "&" the whole memo runs as a job.
+class MemoCommand : public Command {
+public:
+    MemoCommand(const char* cmd_line, char* args[]);
+    virtual ~MemoCommand() {}
+    void execute() override;
+private:
+    std::string key() const;
+    void memoize();
+    bool replay(const std::string& path, const std::string& key);
+    void record(const std::string& path, const std::string& key);
+    bool interrupted() const;
+
+    std::string _dir;
+    std::vector<std::string> _vars;
+    std::vector<std::string> _inputs;
+    std::string _line;
+    Command *_cmd;
+    bool _background_cmd;
+    int _interrupts;
+};
+
+// cat, head, wc and grep -F run in-process on the SIMD kernels of textscan.h,
+// in a pipeline stage or directly on files. Each one only takes over the
+// options it implements; create() returns nullptr for anything else, which
+// then runs the external binary.
+class TextCommand : public BuiltInCommand {
+public:
+    static Command *create(const char* cmd_line, char* args[]);
+    virtual ~TextCommand() {}
+    void execute() override;
+protected:
+    TextCommand(const char* cmd_line, const char* name);
+    // Called for each input in turn, name is empty for stdin
+    virtual void process(int fd, const std::string& name) = 0;
+    virtual void finish() {}
+    ssize_t input(int fd, char *buf, size_t len, const std::string& name);
+    void output(const char *data, size_t len);
+    void output(const std::string& data);
+    void flush();
+    bool stopped();
+
+    std::string _name;
+    std::vector<std::string> _files;
+    bool _supported;
+    bool _closed;
+    int _status;            // the exit status, _failure after an error
+    int _failure;
+private:
+    void writeAll(const char *data, size_t len);
+
+    std::string _out;
+    int _interrupts;
+};
+
+class CatCommand : public TextCommand {
+public:
+    CatCommand(const char* cmd_line, char* args[]);
+    virtual ~CatCommand() {}
+protected:
+    void process(int fd, const std::string& name) override;
+};
+
+class HeadCommand : public TextCommand {
+public:
+    HeadCommand(const char* cmd_line, char* args[]);
+    virtual ~HeadCommand() {}
+protected:
+    void process(int fd, const std::string& name) override;
+private:
+    size_t _lines;
+    bool _first;
+};
+
+class WcCommand : public TextCommand {
+public:
+    WcCommand(const char* cmd_line, char* args[]);
+    virtual ~WcCommand() {}
+protected:
+    void process(int fd, const std::string& name) override;
+    void finish() override;
+private:
+    struct Counts {
+        size_t lines, words, bytes;
+    };
+    size_t columnWidth();
+    void print(const Counts& counts, const std::string& name);
+
+    bool _show_lines, _show_words, _show_bytes;
+    size_t _width;
+    Counts _total;
+};
+
+class GrepCommand : public TextCommand {
+public:
+    GrepCommand(const char* cmd_line, char* args[]);
+    virtual ~GrepCommand() {}
+protected:
+    void process(int fd, const std::string& name) override;
+    void finish() override;
+private:
+    void scan(const char *begin, const char *end, const std::string& prefix);
+    void emit(const char *begin, const char *end, const std::string& prefix);
+
+    std::string _pattern;
+    bool _invert, _count, _number;
+    size_t _lineno, _matches, _selected;
+};
+
+class ParallelCommand : public Command {
+public:
+    ParallelCommand(const char* cmd_line);
+    virtual ~ParallelCommand();
+    void execute() override;
+    std::string progress() override;
+private:
+    void coordinate();
+    pid_t spawn(const std::string& input);
+
+    struct Progress {
+        volatile int total;
+        volatile int running;
+        volatile int done;
+        volatile int failed;
+    };
+
+    bool _background_cmd;
+    int _max_jobs;
+    std::vector<std::string> _template;
+    std::vector<std::string> _inputs;
+    bool _read_stdin;
+    Progress *_progress;
+};
+
 #endif //SMASH_COMMAND_H_
\ No newline at end of file
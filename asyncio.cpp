@@ -0,0 +1,428 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include "asyncio.h"
+
+using namespace std;
+
+#define ASYNCIO_DEPTH (256)
+#define ASYNCIO_MAX_THREADS (16)
+// copy_file_range() and sendfile() move at most this much per call, reads
+// and writes go through a buffer this large
+#define ASYNCIO_COPY_CHUNK (1L << 30)
+#define ASYNCIO_COPY_BUFFER (1 << 20)
+
+/* -------------- IoRequest -------------- */
+
+static IoRequest _request(IoOp op) {
+    IoRequest request = IoRequest();
+    request.op = op;
+    request.dirfd = AT_FDCWD;
+    request.fd = -1;
+    return request;
+}
+
+IoRequest IoRequest::statx(const std::string& path, int flags) {
+    IoRequest request = _request(IO_STATX);
+    request.path = path;
+    request.flags = flags;
+    return request;
+}
+
+IoRequest IoRequest::fstatx(int fd) {
+    IoRequest request = _request(IO_STATX);
+    request.dirfd = fd;
+    request.flags = AT_EMPTY_PATH;
+    return request;
+}
+
+IoRequest IoRequest::openat(const std::string& path, int flags) {
+    IoRequest request = _request(IO_OPENAT);
+    request.path = path;
+    request.flags = flags | O_CLOEXEC;
+    return request;
+}
+
+IoRequest IoRequest::read(int fd, char *buf, size_t len, off_t offset) {
+    IoRequest request = _request(IO_READ);
+    request.fd = fd;
+    request.buf = buf;
+    request.len = len;
+    request.offset = offset;
+    return request;
+}
+
+IoRequest IoRequest::close(int fd) {
+    IoRequest request = _request(IO_CLOSE);
+    request.fd = fd;
+    return request;
+}
+
+IoRequest IoRequest::chmod(const std::string& path, mode_t mode) {
+    IoRequest request = _request(IO_CHMOD);
+    request.path = path;
+    request.mode = mode;
+    return request;
+}
+
+IoRequest IoRequest::utimens(const std::string& path, const struct timespec times[2]) {
+    IoRequest request = _request(IO_UTIMENS);
+    request.path = path;
+    request.times[0] = times[0];
+    request.times[1] = times[1];
+    return request;
+}
+
+IoRequest IoRequest::copy(const std::string& path, const std::string& target) {
+    IoRequest request = _request(IO_COPY);
+    request.path = path;
+    request.target = target;
+    return request;
+}
+
+static ssize_t _copyFileRange(int in, int out, size_t len) {
+#if defined(SYS_copy_file_range)
+    return syscall(SYS_copy_file_range, in, nullptr, out, nullptr, len, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static ssize_t _writeAll(int fd, const char *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+        done += max<ssize_t>(n, 0);
+    }
+    return done;
+}
+
+// copy_file_range() copies inside the kernel and lets the filesystem share
+// extents or copy server-side, sendfile() covers file pairs it rejects, and
+// reads and writes cover files whose size stat() does not know, like those
+// in /proc. Which of them works is found out on the first call.
+static long _copyData(int in, int out) {
+    long copied = 0;
+    int method = 0;
+    vector<char> buf;
+    while (true) {
+        ssize_t n;
+        if (method == 0) {
+            n = _copyFileRange(in, out, ASYNCIO_COPY_CHUNK);
+        } else if (method == 1) {
+            n = sendfile(out, in, nullptr, ASYNCIO_COPY_CHUNK);
+        } else {
+            buf.resize(ASYNCIO_COPY_BUFFER);
+            n = read(in, buf.data(), buf.size());
+            if (n > 0) {
+                n = _writeAll(out, buf.data(), n);
+            }
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (copied == 0 && method < 2 &&
+            (n == 0 || (n < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                                  errno == EOPNOTSUPP)))) {
+            method++;
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 ? -1 : copied;
+        }
+        copied += n;
+    }
+}
+
+// A reflink shares the file's extents and copies nothing, so it is tried
+// before any copying. The permission bits are set with fchmod(), which the
+// umask does not apply to, the way chmod sets them.
+static long _copyFile(IoRequest& request) {
+    struct stat st;
+    long copied = -1;
+    int out = -1;
+    int in = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        request.failed = "open";
+    } else if (fstat(in, &st) < 0) {
+        request.failed = "stat";
+    } else if ((out = open(request.target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+        request.failed = "create";
+#if defined(FICLONE)
+    } else if (st.st_size > 0 && ioctl(out, FICLONE, in) == 0) {
+        copied = st.st_size;
+#endif
+    } else if ((copied = _copyData(in, out)) < 0) {
+        request.failed = "copy";
+    }
+    if (copied >= 0 && fchmod(out, st.st_mode & 07777) < 0) {
+        request.failed = "chmod";
+        copied = -1;
+    }
+    int saved_errno = errno;
+    if (in >= 0) {
+        close(in);
+    }
+    if (out >= 0) {
+        close(out);
+    }
+    errno = saved_errno;
+    return copied;
+}
+
+static void _runBlocking(IoRequest& request) {
+    long ret = -1;
+    switch (request.op) {
+    case IO_STATX:
+        ret = statx(request.dirfd, request.path.c_str(), request.flags, STATX_BASIC_STATS,
+                    &request.stx);
+        break;
+    case IO_OPENAT:
+        ret = openat(request.dirfd, request.path.c_str(), request.flags, request.mode);
+        break;
+    case IO_READ:
+        ret = request.offset < 0 ? ::read(request.fd, request.buf, request.len)
+                                 : pread(request.fd, request.buf, request.len, request.offset);
+        break;
+    case IO_CLOSE:
+        ret = close(request.fd);
+        break;
+    case IO_CHMOD:
+        ret = fchmodat(request.dirfd, request.path.c_str(), request.mode, 0);
+        break;
+    case IO_UTIMENS:
+        ret = utimensat(request.dirfd, request.path.c_str(), request.times, 0);
+        break;
+    case IO_COPY:
+        ret = _copyFile(request);
+        break;
+    }
+    request.result = ret < 0 ? -errno : ret;
+}
+
+static void _prepare(struct io_uring_sqe& sqe, IoRequest& request, size_t id) {
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.user_data = id;
+    switch (request.op) {
+    case IO_STATX:
+        sqe.opcode = IORING_OP_STATX;
+        sqe.fd = request.dirfd;
+        sqe.addr = (uintptr_t)request.path.c_str();
+        sqe.len = STATX_BASIC_STATS;
+        sqe.off = (uintptr_t)&request.stx;
+        sqe.statx_flags = request.flags;
+        break;
+    case IO_OPENAT:
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.fd = request.dirfd;
+        sqe.addr = (uintptr_t)request.path.c_str();
+        sqe.len = request.mode;
+        sqe.open_flags = request.flags;
+        break;
+    case IO_READ:
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = request.fd;
+        sqe.addr = (uintptr_t)request.buf;
+        sqe.len = request.len;
+        sqe.off = request.offset;
+        break;
+    default:
+        sqe.opcode = IORING_OP_CLOSE;
+        sqe.fd = request.fd;
+        break;
+    }
+}
+
+/* -------------- AsyncIo -------------- */
+
+AsyncIo::AsyncIo():
+    _ring_fd(-1),
+    _sq_map(MAP_FAILED),
+    _cq_map(MAP_FAILED),
+    _sqes(MAP_FAILED) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    _threads = min<long>(ASYNCIO_MAX_THREADS, max<long>(4, 2 * cpus));
+    const char *forced = getenv("SMASH_IO");
+    string want = forced ? forced : "";
+    if (want == "serial") {
+        _engine = SERIAL;
+    } else if (want == "threads" || !setupUring()) {
+        _engine = THREADS;
+    } else {
+        _engine = URING;
+    }
+}
+
+AsyncIo::~AsyncIo() {
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sq_entries * sizeof(struct io_uring_sqe));
+    }
+    if (_cq_map != MAP_FAILED && _cq_map != _sq_map) {
+        munmap(_cq_map, _cq_map_size);
+    }
+    if (_sq_map != MAP_FAILED) {
+        munmap(_sq_map, _sq_map_size);
+    }
+    if (_ring_fd >= 0) {
+        close(_ring_fd);
+    }
+}
+
+const char *AsyncIo::engine() const {
+    switch (_engine) {
+    case URING:
+        return "io_uring";
+    case THREADS:
+        return "threads";
+    default:
+        return "serial";
+    }
+}
+
+// Fails quietly when io_uring is missing, disabled by sysctl or seccomp, or
+// lacks one of the opcodes, and the thread pool takes over.
+bool AsyncIo::setupUring() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, ASYNCIO_DEPTH, &params);
+    if (fd < 0) {
+        return false;
+    }
+    _ring_fd = fd;
+
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probe_size);
+    bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) >= 0;
+    for (int op : {IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE}) {
+        supported = supported && op < probe->ops_len &&
+                    (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    if (!supported) {
+        return false;
+    }
+
+    _sq_entries = params.sq_entries;
+    _sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        _sq_map_size = _cq_map_size = max(_sq_map_size, _cq_map_size);
+    }
+    _sq_map = mmap(nullptr, _sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQ_RING);
+    if (_sq_map == MAP_FAILED) {
+        return false;
+    }
+    _cq_map = single ? _sq_map : mmap(nullptr, _cq_map_size, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    _sqes = mmap(nullptr, _sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (_cq_map == MAP_FAILED || _sqes == MAP_FAILED) {
+        return false;
+    }
+    char *sq = (char *)_sq_map, *cq = (char *)_cq_map;
+    _sq_head = (unsigned *)(sq + params.sq_off.head);
+    _sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    _sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    _sq_array = (unsigned *)(sq + params.sq_off.array);
+    _cq_head = (unsigned *)(cq + params.cq_off.head);
+    _cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    _cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    _cqes = cq + params.cq_off.cqes;
+    return true;
+}
+
+void AsyncIo::run(std::vector<IoRequest>& batch) {
+    vector<size_t> uring, blocking;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        bool has_opcode = batch[i].op == IO_STATX || batch[i].op == IO_OPENAT ||
+                          batch[i].op == IO_READ || batch[i].op == IO_CLOSE;
+        (_engine == URING && has_opcode ? uring : blocking).push_back(i);
+    }
+    if (!uring.empty()) {
+        runUring(batch, uring);
+    }
+    if (!blocking.empty()) {
+        runThreads(batch, blocking);
+    }
+}
+
+// Keeps the submission queue topped up and makes one io_uring_enter() per
+// round, which submits everything queued and waits for a completion. The
+// completion queue is twice as deep as the submission queue, so it cannot
+// overflow with at most one ring's worth in flight.
+void AsyncIo::runUring(std::vector<IoRequest>& batch, const std::vector<size_t>& which) {
+    struct io_uring_sqe *sqes = (struct io_uring_sqe *)_sqes;
+    struct io_uring_cqe *cqes = (struct io_uring_cqe *)_cqes;
+    size_t next = 0, done = 0;
+    unsigned inflight = 0;
+    for (size_t i : which) {
+        batch[i].result = -ECANCELED;
+    }
+    while (done < which.size()) {
+        unsigned tail = *_sq_tail;
+        for (; next < which.size() && inflight < _sq_entries; ++next, ++inflight, ++tail) {
+            unsigned index = tail & *_sq_mask;
+            _prepare(sqes[index], batch[which[next]], which[next]);
+            _sq_array[index] = index;
+        }
+        __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+
+        unsigned pending = tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (syscall(__NR_io_uring_enter, _ring_fd, pending, 1, IORING_ENTER_GETEVENTS,
+                    nullptr, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("smash error: io_uring_enter failed");
+            break;
+        }
+
+        unsigned head = *_cq_head;
+        unsigned cq_tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; ++head, ++done, --inflight) {
+            struct io_uring_cqe& cqe = cqes[head & *_cq_mask];
+            batch[cqe.user_data].result = cqe.res;
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+// The pool lives for one batch: its threads are joined before run() returns,
+// so none is ever alive when the smash forks.
+void AsyncIo::runThreads(std::vector<IoRequest>& batch, const std::vector<size_t>& which) {
+    size_t workers = _engine == SERIAL ? 1 : min<size_t>(_threads, which.size());
+    atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t k; (k = next++) < which.size();) {
+            _runBlocking(batch[which[k]]);
+        }
+    };
+    vector<thread> pool;
+    for (size_t t = 1; t < workers; ++t) {
+        try {
+            pool.emplace_back(work);
+        } catch (const system_error&) {
+            // the calling thread finishes the batch on its own
+            break;
+        }
+    }
+    work();
+    for (thread& worker : pool) {
+        worker.join();
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef SMASH__ASYNCIO_H_
+#define SMASH__ASYNCIO_H_
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+// Batched file operations for the file builtins. A builtin fills a vector of
+// requests and hands the whole batch to AsyncIo::run(), which keeps as many
+// of them in flight as it can and returns once all are complete.
+//
+// Requests run on io_uring when the kernel offers it, with submissions
+// batched into one io_uring_enter() that also waits for completions.
+// Otherwise, and for operations io_uring has no opcode for (chmod, utimes,
+// copy), a pool of threads issues the blocking syscalls. SMASH_IO=uring|threads|serial
+// in the environment forces an engine; serial is one syscall at a time.
+enum IoOp {
+    IO_STATX,
+    IO_OPENAT,
+    IO_READ,
+    IO_CLOSE,
+    IO_CHMOD,
+    IO_UTIMENS,
+    IO_COPY,
+};
+
+struct IoRequest {
+    IoOp op;
+    // statx, openat, chmod, utimens, copy
+    int dirfd;
+    std::string path;
+    std::string target;     // copy
+    int flags;
+    mode_t mode;
+    // read, close and statx with AT_EMPTY_PATH
+    int fd;
+    char *buf;
+    size_t len;
+    off_t offset;
+    struct timespec times[2];
+    // outputs
+    struct statx stx;
+    long result;            // the syscall's return value, or -errno
+    const char *failed;     // copy: the step that failed
+
+    static IoRequest statx(const std::string& path, int flags = 0);
+    static IoRequest fstatx(int fd);
+    static IoRequest openat(const std::string& path, int flags);
+    // An offset of -1 reads from the file position, for files that cannot seek.
+    static IoRequest read(int fd, char *buf, size_t len, off_t offset);
+    static IoRequest close(int fd);
+    static IoRequest chmod(const std::string& path, mode_t mode);
+    static IoRequest utimens(const std::string& path, const struct timespec times[2]);
+    // Copies a file's contents to target, created or truncated, and gives it
+    // the file's permission bits. result is the number of bytes copied.
+    static IoRequest copy(const std::string& path, const std::string& target);
+};
+
+class AsyncIo {
+public:
+    AsyncIo();
+    AsyncIo(const AsyncIo&)        = delete;
+    void operator=(const AsyncIo&) = delete;
+    ~AsyncIo();
+
+    void run(std::vector<IoRequest>& batch);
+    const char *engine() const;
+
+private:
+    enum Engine { URING, THREADS, SERIAL };
+
+    bool setupUring();
+    void runUring(std::vector<IoRequest>& batch, const std::vector<size_t>& which);
+    void runThreads(std::vector<IoRequest>& batch, const std::vector<size_t>& which);
+
+    Engine _engine;
+    unsigned _threads;
+    // io_uring state, only set up for the URING engine
+    int _ring_fd;
+    void *_sq_map, *_cq_map;
+    size_t _sq_map_size, _cq_map_size;
+    void *_sqes;
+    unsigned _sq_entries;
+    unsigned *_sq_head, *_sq_tail, *_sq_mask, *_sq_array;
+    unsigned *_cq_head, *_cq_tail, *_cq_mask;
+    void *_cqes;
+};
+
+#endif //SMASH__ASYNCIO_H_
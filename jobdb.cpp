@@ -0,0 +1,181 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jobdb.h"
+
+using namespace std;
+
+int _pidfdOpen(pid_t pid);
+
+JobDb::JobDb(int fd):
+    _fd(fd),
+    _records(nullptr),
+    _count(0),
+    _capacity(0) {}
+
+JobDb::~JobDb() {
+    if (_records) {
+        munmap(_records, _capacity * sizeof(JobRecord));
+    }
+    for (auto& survivor : _survivors) {
+        close(survivor.second);
+    }
+    close(_fd);
+}
+
+JobDb *JobDb::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("smash error: open failed");
+        return nullptr;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        cerr << "smash error: jobdb: " << path << " is used by another smash" << endl;
+        close(fd);
+        return nullptr;
+    }
+    JobDb *db = new JobDb(fd);
+    db->replay(path);
+    if (db->_fd < 0 || !db->reserve(db->_survivors.size())) {
+        delete db;
+        return nullptr;
+    }
+    return db;
+}
+
+// Finds the jobs that outlived the previous smash and compacts the journal
+// down to them.
+void JobDb::replay(const std::string& path) {
+    struct stat st;
+    size_t count = fstat(_fd, &st) == 0 ? st.st_size / sizeof(JobRecord) : 0;
+    void *data = count ? mmap(nullptr, count * sizeof(JobRecord), PROT_READ, MAP_SHARED, _fd, 0)
+                       : MAP_FAILED;
+    map<pair<int32_t, uint64_t>, JobRecord> latest;
+    if (data != MAP_FAILED) {
+        const JobRecord *records = (const JobRecord *)data;
+        for (size_t i = 0; i < count && records[i].magic == JOBDB_RECORD_MAGIC; ++i) {
+            latest[make_pair(records[i].pid, records[i].start_time)] = records[i];
+        }
+        munmap(data, count * sizeof(JobRecord));
+    }
+
+    for (auto& entry : latest) {
+        const JobRecord& record = entry.second;
+        if (record.state == JOB_DONE) {
+            continue;
+        }
+        // the pidfd pins the process, so the start time read after opening
+        // it tells whether it is still the recorded one
+        int pidfd = _pidfdOpen(record.pid);
+        if (pidfd < 0) {
+            continue;
+        }
+        if (startTime(record.pid) != record.start_time) {
+            close(pidfd);
+            continue;
+        }
+        _survivors.push_back(make_pair(record, pidfd));
+    }
+
+    string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool ok = fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0;
+    for (size_t i = 0; ok && i < _survivors.size(); ++i) {
+        ok = write(fd, &_survivors[i].first, sizeof(JobRecord)) == sizeof(JobRecord);
+    }
+    if (!ok || rename(tmp.c_str(), path.c_str()) < 0) {
+        perror("smash error: jobdb: compaction failed");
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp.c_str());
+        }
+        close(_fd);
+        _fd = -1;
+        return;
+    }
+    close(_fd);
+    _fd = fd;
+    _count = _survivors.size();
+}
+
+std::vector<std::pair<JobRecord, int>> JobDb::takeSurvivors() {
+    vector<pair<JobRecord, int>> survivors;
+    survivors.swap(_survivors);
+    return survivors;
+}
+
+// Grows the file and its mapping geometrically, so appends stay amortized
+// O(1) and never move records that are already written.
+bool JobDb::reserve(size_t count) {
+    if (count <= _capacity && _records) {
+        return true;
+    }
+    size_t capacity = max<size_t>(64, max(count, 2 * _capacity));
+    if (ftruncate(_fd, capacity * sizeof(JobRecord)) < 0) {
+        perror("smash error: ftruncate failed");
+        return false;
+    }
+    void *map = mmap(nullptr, capacity * sizeof(JobRecord), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        return false;
+    }
+    if (_records) {
+        munmap(_records, _capacity * sizeof(JobRecord));
+    }
+    _records = (JobRecord *)map;
+    _capacity = capacity;
+    return true;
+}
+
+void JobDb::append(int jid, pid_t pid, uint64_t start_time, JobState state,
+                   const char* cmd_line) {
+    if (!reserve(_count + 1)) {
+        return;
+    }
+    JobRecord& record = _records[_count++];
+    record.state = state;
+    record.jid = jid;
+    record.pid = pid;
+    record.start_time = start_time;
+    strncpy(record.cmd_line, cmd_line, JOBDB_CMD_LENGTH - 1);
+    record.cmd_line[JOBDB_CMD_LENGTH - 1] = '\0';
+    __atomic_store_n(&record.magic, JOBDB_RECORD_MAGIC, __ATOMIC_RELEASE);
+}
+
+// Returns the fields of /proc/<pid>/stat that follow the command name, which
+// may itself contain spaces and parentheses.
+vector<string> _procStat(pid_t pid) {
+    ifstream file("/proc/" + to_string(pid) + "/stat");
+    string line;
+    getline(file, line);
+    size_t end = line.rfind(')');
+    vector<string> fields;
+    if (end != string::npos) {
+        istringstream rest(line.substr(end + 1));
+        for (string field; rest >> field;) {
+            fields.push_back(field);
+        }
+    }
+    return fields;
+}
+
+uint64_t JobDb::startTime(pid_t pid) {
+    // starttime is field 22, the 20th after the command name
+    vector<string> fields = _procStat(pid);
+    return fields.size() > 19 ? stoull(fields[19]) : 0;
+}
+
+bool JobDb::stopped(pid_t pid) {
+    vector<string> fields = _procStat(pid);
+    return !fields.empty() && fields[0] == "T";
+}
@@ -0,0 +1,68 @@
+#ifndef SMASH__JOBDB_H_
+#define SMASH__JOBDB_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Persistent journal of the jobs list, enabled with "smash --jobdb FILE".
+//
+// The file is a sequence of fixed-size records, mapped shared and only ever
+// appended to: a job gets a record when it is added to the list and another
+// one when it is reaped, so the latest record per job describes it. The
+// magic is stored last, which makes a record torn by a crash invisible.
+//
+// A restarted smash replays the journal, keeps the jobs whose process still
+// has the recorded start time (checked through a pidfd, so a recycled pid is
+// never adopted) and rewrites the file with just those. The journal therefore
+// only holds what happened since the last start, and reopening it costs a
+// single sequential scan.
+#define JOBDB_RECORD_MAGIC (0x4a424f53)
+#define JOBDB_CMD_LENGTH (200)
+
+enum JobState : uint32_t {
+    JOB_RUNNING = 1,
+    JOB_STOPPED = 2,
+    JOB_DONE    = 3,
+    JOB_QUEUED  = 4,    // only in the exported job table
+};
+
+struct JobRecord {
+    uint32_t magic;
+    uint32_t state;
+    int32_t jid;
+    int32_t pid;
+    uint64_t start_time;
+    char cmd_line[JOBDB_CMD_LENGTH];
+};
+
+class JobDb {
+public:
+    static JobDb *open(const std::string& path);
+    JobDb(const JobDb&)         = delete;
+    void operator=(const JobDb&) = delete;
+    ~JobDb();
+
+    // Hands over the jobs that were alive when the journal was opened, each
+    // with a pidfd the caller now owns.
+    std::vector<std::pair<JobRecord, int>> takeSurvivors();
+    void append(int jid, pid_t pid, uint64_t start_time, JobState state,
+                const char* cmd_line);
+    // Start time of a process in clock ticks since boot, 0 if it is gone.
+    static uint64_t startTime(pid_t pid);
+    static bool stopped(pid_t pid);
+
+private:
+    JobDb(int fd);
+    bool reserve(size_t count);
+    void replay(const std::string& path);
+
+    int _fd;
+    JobRecord *_records;
+    size_t _count;
+    size_t _capacity;
+    std::vector<std::pair<JobRecord, int>> _survivors;
+};
+
+#endif //SMASH__JOBDB_H_
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <system_error>
+#include "jobtable.h"
+
+using namespace std;
+
+static const size_t SEGMENT_SIZE = sizeof(JobTableHeader) +
+                                   JOBTABLE_CAPACITY * sizeof(JobTableEntry);
+
+std::string jobTableSegment(const std::string& name) {
+    return name[0] == '/' ? name : "/" + name;
+}
+
+/* -------------- JobTable -------------- */
+
+JobTable::JobTable(const std::string& name, void *segment):
+    _name(name),
+    _owner(getpid()),
+    _header((JobTableHeader *)segment),
+    _entries((JobTableEntry *)(_header + 1)) {}
+
+JobTable::~JobTable() {
+    munmap(_header, SEGMENT_SIZE);
+    // forked job leaders run the destructors too
+    if (getpid() == _owner) {
+        shm_unlink(_name.c_str());
+    }
+}
+
+JobTable *JobTable::create(const std::string& name) {
+    string segment = jobTableSegment(name);
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("smash error: shm_open failed");
+        return nullptr;
+    }
+    if (ftruncate(fd, SEGMENT_SIZE) < 0) {
+        perror("smash error: ftruncate failed");
+        close(fd);
+        shm_unlink(segment.c_str());
+        return nullptr;
+    }
+    void *map = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("smash error: mmap failed");
+        shm_unlink(segment.c_str());
+        return nullptr;
+    }
+    JobTable *table = new JobTable(segment, map);
+    JobTableHeader *header = table->_header;
+    header->version = JOBTABLE_VERSION;
+    header->entry_size = sizeof(JobTableEntry);
+    header->capacity = JOBTABLE_CAPACITY;
+    header->smash_pid = getpid();
+    table->publish(vector<JobTableEntry>());
+    __atomic_store_n(&header->magic, JOBTABLE_MAGIC, __ATOMIC_RELEASE);
+    return table;
+}
+
+void JobTable::publish(const std::vector<JobTableEntry>& entries) {
+    uint64_t seq = _header->seq;
+    __atomic_store_n(&_header->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    size_t count = min<size_t>(entries.size(), JOBTABLE_CAPACITY);
+    memcpy(_entries, entries.data(), count * sizeof(JobTableEntry));
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    _header->count = count;
+    _header->total = entries.size();
+    _header->updated_ms = now.tv_sec * 1000LL + now.tv_usec / 1000;
+
+    __atomic_store_n(&_header->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* -------------- JobTableReader -------------- */
+
+JobTableReader::JobTableReader(const std::string& name) {
+    string segment = jobTableSegment(name);
+    int fd = shm_open(segment.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "shm_open " + segment);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < SEGMENT_SIZE) {
+        close(fd);
+        throw system_error(EPROTO, generic_category(), segment + " is not a job table");
+    }
+    void *map = mmap(nullptr, SEGMENT_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw system_error(errno, generic_category(), "mmap " + segment);
+    }
+    _header = (const JobTableHeader *)map;
+    _entries = (const JobTableEntry *)(_header + 1);
+    if (__atomic_load_n(&_header->magic, __ATOMIC_ACQUIRE) != JOBTABLE_MAGIC ||
+        _header->version != JOBTABLE_VERSION ||
+        _header->entry_size != sizeof(JobTableEntry)) {
+        munmap(map, SEGMENT_SIZE);
+        throw system_error(EPROTO, generic_category(), segment + " is not a job table");
+    }
+}
+
+JobTableReader::~JobTableReader() {
+    munmap((void *)_header, SEGMENT_SIZE);
+}
+
+void JobTableReader::snapshot(JobTableHeader& header, std::vector<JobTableEntry>& entries) const {
+    while (true) {
+        uint64_t seq = __atomic_load_n(&_header->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(&header, _header, sizeof(header));
+        size_t count = min<size_t>(header.count, JOBTABLE_CAPACITY);
+        entries.assign(_entries, _entries + count);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&_header->seq, __ATOMIC_RELAXED) == seq) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef SMASH__JOBTABLE_H_
+#define SMASH__JOBTABLE_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+#include "jobdb.h"
+
+// Job table published in POSIX shared memory, enabled with
+// "smash --export NAME" and read by external monitors such as smash-top.
+//
+// The segment holds a header followed by a fixed array of entries. The smash
+// rewrites the whole table whenever the jobs list changes and after every
+// command, under a seqlock: seq is odd while a write is in progress and is
+// bumped again once it is complete. Readers copy the table and retry when seq
+// changed meanwhile, so they never block the smash and never see a torn
+// snapshot. A reader must check magic and version before trusting the layout.
+#define JOBTABLE_MAGIC (0x4a544253)
+#define JOBTABLE_VERSION (1)
+#define JOBTABLE_CAPACITY (1024)
+#define JOBTABLE_CMD_LENGTH (200)
+
+struct JobTableEntry {
+    int32_t jid;
+    int32_t pid;            // 0 while queued
+    uint32_t state;         // JobState
+    uint32_t reserved;
+    int64_t start;          // seconds since the epoch, submission for queued jobs
+    uint64_t utime_ms;      // CPU time of the job's leader
+    uint64_t stime_ms;
+    uint64_t rss_kb;
+    char cmd_line[JOBTABLE_CMD_LENGTH];
+};
+
+struct JobTableHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t capacity;
+    int32_t smash_pid;
+    uint32_t count;         // entries in this snapshot
+    uint32_t total;         // jobs in the list, more than count if it overflowed
+    uint32_t reserved;
+    uint64_t seq;
+    int64_t updated_ms;     // time of the snapshot, milliseconds since the epoch
+};
+
+// Writer side, owned by the smash's jobs list.
+class JobTable {
+public:
+    static JobTable *create(const std::string& name);
+    JobTable(const JobTable&)       = delete;
+    void operator=(const JobTable&) = delete;
+    ~JobTable();
+
+    void publish(const std::vector<JobTableEntry>& entries);
+
+private:
+    JobTable(const std::string& name, void *segment);
+
+    std::string _name;
+    pid_t _owner;
+    JobTableHeader *_header;
+    JobTableEntry *_entries;
+};
+
+// Reader side. Opening a missing or foreign segment throws std::system_error.
+class JobTableReader {
+public:
+    explicit JobTableReader(const std::string& name);
+    JobTableReader(const JobTableReader&) = delete;
+    void operator=(const JobTableReader&) = delete;
+    ~JobTableReader();
+
+    // Copies a consistent snapshot of the table.
+    void snapshot(JobTableHeader& header, std::vector<JobTableEntry>& entries) const;
+
+private:
+    const JobTableHeader *_header;
+    const JobTableEntry *_entries;
+};
+
+std::string jobTableSegment(const std::string& name);
+
+#endif //SMASH__JOBTABLE_H_
@@ -0,0 +1,308 @@
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <system_error>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "libsmash.h"
+#include "Commands.h"
+
+using namespace std;
+
+int _memfdCreate(const char* name);
+
+SmashOutput::SmashOutput():
+    out_fd(STDOUT_FILENO),
+    err_fd(STDERR_FILENO) {}
+
+static int _exitStatus(int status) {
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 0;
+}
+
+/* -------------- SmashEngine::Worker -------------- */
+
+// Calls of all engines run one at a time, since the smash keeps process-wide
+// state such as the current smash.
+static mutex _engines;
+
+// The thread an engine's calls run on. It unshares its file descriptor table
+// and working directory from the caller's threads, so it can point fds 1 and
+// 2 at the engine's output and cd for the engine's commands once and for all.
+// Only the fds the engine needs are kept in its table: any other would stay
+// open there after the caller closed it.
+class SmashEngine::Worker {
+public:
+    Worker(int out_fd, int err_fd);
+    ~Worker();
+    // Runs the task on the thread and waits for it, passing on its exception.
+    void call(const std::function<void()>& task);
+private:
+    void main(int out_fd, int err_fd);
+
+    thread _thread;
+    mutex _mutex;
+    condition_variable _cond;
+    std::function<void()> _task;
+    exception_ptr _error;
+    int _errno;                 // why the thread could not start, or 0
+    bool _started;
+    bool _stop;
+};
+
+SmashEngine::Worker::Worker(int out_fd, int err_fd):
+    _errno(0),
+    _started(false),
+    _stop(false) {
+    _thread = thread(&Worker::main, this, out_fd, err_fd);
+    unique_lock<mutex> lock(_mutex);
+    _cond.wait(lock, [this] { return _started; });
+    if (_errno) {
+        lock.unlock();
+        _thread.join();
+        throw system_error(_errno, generic_category(), "smash engine: unshare failed");
+    }
+}
+
+SmashEngine::Worker::~Worker() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cond.notify_all();
+    _thread.join();
+}
+
+void SmashEngine::Worker::call(const std::function<void()>& task) {
+    lock_guard<mutex> serial(_engines);
+    // what the caller left in the streams' buffers is its own output
+    cout.flush();
+    cerr.flush();
+    unique_lock<mutex> lock(_mutex);
+    _task = task;
+    _cond.notify_all();
+    _cond.wait(lock, [this] { return !_task; });
+    if (_error) {
+        exception_ptr error = _error;
+        _error = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+void SmashEngine::Worker::main(int out_fd, int err_fd) {
+    unique_lock<mutex> lock(_mutex);
+    if (unshare(CLONE_FILES | CLONE_FS) < 0) {
+        _errno = errno;
+    } else {
+        vector<int> fds;
+        DIR *dir = opendir("/proc/thread-self/fd");
+        for (struct dirent *entry; dir && (entry = readdir(dir));) {
+            int fd = atoi(entry->d_name);
+            if (entry->d_name[0] != '.' && fd > STDERR_FILENO && fd != out_fd &&
+                fd != err_fd && fd != dirfd(dir)) {
+                fds.push_back(fd);
+            }
+        }
+        if (dir) {
+            closedir(dir);
+        }
+        for (int fd : fds) {
+            close(fd);
+        }
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(err_fd, STDERR_FILENO);
+    }
+    _started = true;
+    _cond.notify_all();
+    while (!_errno) {
+        _cond.wait(lock, [this] { return _task || _stop; });
+        if (!_task) {
+            break;
+        }
+        lock.unlock();
+        try {
+            _task();
+        } catch (...) {
+            _error = current_exception();
+        }
+        cout.flush();
+        cerr.flush();
+        lock.lock();
+        _task = nullptr;
+        _cond.notify_all();
+    }
+}
+
+/* -------------- SmashEngine::Scope -------------- */
+
+// Makes the engine the current smash, the one SmallShell::getInstance()
+// returns, for as long as it lives.
+class SmashEngine::Scope {
+public:
+    Scope(SmashEngine& engine);
+    ~Scope();
+private:
+    SmallShell *_previous;
+};
+
+SmashEngine::Scope::Scope(SmashEngine& engine) {
+    _previous = SmallShell::makeCurrent(engine._smash);
+}
+
+SmashEngine::Scope::~Scope() {
+    SmallShell::makeCurrent(_previous);
+}
+
+/* -------------- SmashEngine -------------- */
+
+SmashEngine::SmashEngine(const SmashOutput& output):
+    _smash(nullptr),
+    _output(output),
+    _out_read(0),
+    _err_read(0) {
+    // output for a callback collects in a memfd, which the jobs share
+    _out_fd = output.out_fd >= 0 ? output.out_fd : _memfdCreate("smash-engine-out");
+    _err_fd = output.err_fd >= 0 ? output.err_fd : _memfdCreate("smash-engine-err");
+    try {
+        _worker.reset(new Worker(_out_fd, _err_fd));
+    } catch (const system_error&) {
+        closeOutput();
+        throw;
+    }
+    _worker->call([this] {
+        _smash = new SmallShell();
+        _smash->_job_list.setReapedHook([this](JobsList::JobEntry *job, int status) {
+            _finished.push_back(make_pair(job->cmd()->_jid, _exitStatus(status)));
+        });
+    });
+}
+
+SmashEngine::~SmashEngine() {
+    _worker->call([this] {
+        Scope scope(*this);
+        vector<JobsList::JobEntry *> jobs = _smash->_job_list.getAllJobs();
+        for (JobsList::JobEntry *job : jobs) {
+            job->sendSignal(SIGKILL);
+        }
+        vector<pair<int, int>> reaped;
+        _smash->_job_list.waitJobs(jobs, false, -1, reaped);
+        delete _smash;
+    });
+    _worker.reset();
+    closeOutput();
+}
+
+void SmashEngine::closeOutput() {
+    if (_output.out_fd < 0) {
+        close(_out_fd);
+    }
+    if (_output.err_fd < 0) {
+        close(_err_fd);
+    }
+}
+
+SmashResult SmashEngine::run(const std::string& cmd_line) {
+    SmashResult result = {0, -1, false};
+    _worker->call([&] {
+        Scope scope(*this);
+        vector<JobsList::JobEntry *> before = _smash->_job_list.getAllJobs();
+        _smash->_status = 0;
+        result.quit = !_smash->executeCommand(cmd_line.c_str());
+        result.status = _smash->lastStatus();
+        // a new job at the end of the list is the one the line started
+        vector<JobsList::JobEntry *> after = _smash->_job_list.getAllJobs();
+        if (!after.empty() && (before.empty() || after.back() != before.back())) {
+            result.jid = after.back()->cmd()->_jid;
+            result.status = 0;
+        }
+    });
+    deliver();
+    return result;
+}
+
+std::vector<std::pair<int, int>> SmashEngine::poll() {
+    _worker->call([this] {
+        Scope scope(*this);
+        // with no SIGIO to prompt it, captured output is pulled in here
+        _smash->_job_list.drainCaptures();
+        _smash->refreshJobs();
+    });
+    deliver();
+    vector<pair<int, int>> finished;
+    finished.swap(_finished);
+    return finished;
+}
+
+int SmashEngine::wait(int jid) {
+    int status = -1;
+    bool waited = false;
+    _worker->call([&] {
+        Scope scope(*this);
+        vector<pair<int, int>> reaped;
+        try {
+            JobsList::JobEntry *job = _smash->_job_list.getJobById(jid);
+            waited = _smash->_job_list.waitJobs({job}, false, -1, reaped);
+        } catch (const Command::CommandError& e) {
+            // no such job, or no longer: poll() may not have reported it yet
+        }
+        if (waited && !reaped.empty()) {
+            status = _exitStatus(reaped[0].second);
+        }
+    });
+    deliver();
+    // jids are reused, so a job that is gone is the latest one by that id
+    for (auto it = _finished.rbegin(); !waited && it != _finished.rend(); ++it) {
+        if (it->first == jid) {
+            status = it->second;
+            _finished.erase(next(it).base());
+            break;
+        }
+    }
+    return status;
+}
+
+const std::string& SmashEngine::prompt() const {
+    return _smash->name();
+}
+
+// Hands whatever the commands wrote since the last time to the callbacks. Once
+// everything was delivered and no job is left to write more, the memfds are
+// emptied again.
+void SmashEngine::deliver() {
+    if (_output.out_fd < 0) {
+        deliver(_out_fd, _out_read, _output.on_out);
+    }
+    if (_output.err_fd < 0) {
+        deliver(_err_fd, _err_read, _output.on_err);
+    }
+    if (_smash->_job_list.getAllJobs().empty()) {
+        for (int fd : {_output.out_fd < 0 ? _out_fd : -1, _output.err_fd < 0 ? _err_fd : -1}) {
+            if (fd >= 0 && ftruncate(fd, 0) == 0) {
+                lseek(fd, 0, SEEK_SET);
+            }
+        }
+        _out_read = _err_read = 0;
+    }
+}
+
+void SmashEngine::deliver(int fd, off_t& offset,
+                          const std::function<void(const char *, size_t)>& callback) {
+    char buf[65536];
+    ssize_t n;
+    while ((n = pread(fd, buf, sizeof(buf), offset)) > 0) {
+        offset += n;
+        if (callback) {
+            callback(buf, n);
+        }
+    }
+}
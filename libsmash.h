@@ -0,0 +1,83 @@
+#ifndef SMASH__LIBSMASH_H_
+#define SMASH__LIBSMASH_H_
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Runs smash command lines inside the calling process, built as libsmash.a and
+// libsmash.so ("make libsmash.a libsmash.so").
+//
+// Each SmashEngine is a smash of its own, with its own jobs, prompt, status
+// and working directory, and any number of them can coexist. Builtins run in
+// the caller's process; only external commands, pipelines and redirections
+// fork. A line ending in "&" returns at once with the job's id, whose exit
+// status poll() or wait() collect later.
+//
+// An engine's calls run on a thread of its own, whose fds and working
+// directory are its own too: fds 1 and 2 point at the engine's output, and
+// cd changes only the engine's directory, whatever the caller's other
+// threads do meanwhile. Only cout and cerr are shared, so output another
+// thread leaves unflushed in them during a call may reach the engine's
+// output. Calls of all engines, from any thread, run one at a time. The
+// engine installs no signal handlers and does not reap children that are not
+// its jobs.
+struct SmashOutput {
+    // where the commands' stdout and stderr go: a file descriptor of the
+    // caller's or, when the fd is -1, the callback, which is handed the output
+    // of a line before run() returns and that of background jobs in poll()
+    // and wait()
+    int out_fd;
+    int err_fd;
+    std::function<void(const char *data, size_t len)> on_out;
+    std::function<void(const char *data, size_t len)> on_err;
+
+    SmashOutput();
+};
+
+struct SmashResult {
+    int status;                 // as $? would have it, 0 for a background line
+    int jid;                    // the job a background line started, or -1
+    bool quit;                  // the line was quit
+};
+
+class SmallShell;
+
+class SmashEngine {
+public:
+    explicit SmashEngine(const SmashOutput& output = SmashOutput());
+    SmashEngine(const SmashEngine&)    = delete;
+    void operator=(const SmashEngine&) = delete;
+    // Kills the engine's remaining jobs.
+    ~SmashEngine();
+
+    SmashResult run(const std::string& cmd_line);
+    // Collects the jobs that finished since the last call, without blocking,
+    // as (jid, exit status) pairs.
+    std::vector<std::pair<int, int>> poll();
+    // Blocks until the job finishes and returns its exit status, or -1 if the
+    // engine has no such job.
+    int wait(int jid);
+    const std::string& prompt() const;
+
+private:
+    class Worker;
+    class Scope;
+    void deliver();
+    void closeOutput();
+    void deliver(int fd, off_t& offset, const std::function<void(const char *, size_t)>& callback);
+
+    SmallShell *_smash;
+    SmashOutput _output;
+    int _out_fd;                // what stdout and stderr are pointed at
+    int _err_fd;
+    off_t _out_read;            // how much of the callback memfds was delivered
+    off_t _err_read;
+    std::vector<std::pair<int, int>> _finished;
+    std::unique_ptr<Worker> _worker;
+};
+
+#endif //SMASH__LIBSMASH_H_
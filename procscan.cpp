@@ -0,0 +1,190 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "procscan.h"
+
+using namespace std;
+
+int _pidfdOpen(pid_t pid);
+int _pidfdSendSignal(int pidfd, int sig_num);
+
+// enough for about 8k processes per getdents64()
+#define PROC_DENTS_SIZE (1 << 18)
+#define PROC_STAT_SIZE (1024)
+#define PROC_CMDLINE_SIZE (4096)
+
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+ProcQuery::ProcQuery():
+    pattern(nullptr),
+    full(false),
+    by_uid(false),
+    uid(0),
+    ppid(-1),
+    cmdlines(false),
+    identify(false) {}
+
+// Reads dir/file, relative to dir_fd, into buf and NUL-terminates it. Returns
+// its length, or -1 once the process is gone.
+static ssize_t _readProcFile(int dir_fd, const char *dir, const char *file, char *buf, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t len = read(fd, buf, size);
+    close(fd);
+    if (len >= 0) {
+        buf[len] = '\0';
+    }
+    return len;
+}
+
+// Picks the name, parent and start time out of /proc/PID/stat. The name is in
+// parentheses and may itself hold spaces and parentheses, so the fields after
+// it are counted from the last ')': state, ppid, and starttime 19 after that.
+static bool _parseStat(const char *buf, string& name, pid_t& ppid, unsigned long long& start) {
+    const char *open = strchr(buf, '(');
+    const char *close = strrchr(buf, ')');
+    if (!open || !close || close < open || !close[1]) {
+        return false;
+    }
+    name.assign(open + 1, close - open - 1);
+    const char *field = close + 2;
+    for (int i = 0; i < 19; i++) {
+        if (i == 1) {
+            ppid = strtol(field, nullptr, 10);
+        }
+        if (!(field = strchr(field, ' '))) {
+            return false;
+        }
+        field++;
+    }
+    start = strtoull(field, nullptr, 10);
+    return true;
+}
+
+bool procScan(const ProcQuery& query, std::vector<ProcMatch>& matches) {
+    int proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (proc_fd < 0) {
+        return false;
+    }
+    pid_t self = getpid();
+    bool need_stat = (query.pattern && !query.full) || query.ppid >= 0 || query.identify;
+    bool need_cmdline = (query.pattern && query.full) || query.cmdlines;
+    vector<char> dents(PROC_DENTS_SIZE);
+    char buf[PROC_CMDLINE_SIZE + 1];
+    ProcMatch match;
+    pid_t ppid;
+    auto readStat = [&](const char *pid) {
+        return _readProcFile(proc_fd, pid, "stat", buf, PROC_STAT_SIZE) > 0 &&
+               _parseStat(buf, match.name, ppid, match.start);
+    };
+
+    long n;
+    while ((n = syscall(SYS_getdents64, proc_fd, dents.data(), dents.size())) > 0) {
+        for (long offset = 0; offset < n;) {
+            struct linux_dirent64 *dent = (struct linux_dirent64 *)(dents.data() + offset);
+            offset += dent->d_reclen;
+            // the processes are the directories with numeric names
+            const char *c = dent->d_name;
+            pid_t pid = 0;
+            for (; *c >= '0' && *c <= '9'; c++) {
+                pid = pid * 10 + (*c - '0');
+            }
+            if (*c || c == dent->d_name || pid == self) {
+                continue;
+            }
+            if (query.by_uid) {
+                struct stat st;
+                if (fstatat(proc_fd, dent->d_name, &st, 0) < 0 || st.st_uid != query.uid) {
+                    continue;
+                }
+            }
+
+            match.pid = pid;
+            match.start = 0;
+            match.name.clear();
+            match.cmdline.clear();
+            ppid = -1;
+            if (need_stat && (!readStat(dent->d_name) || (query.ppid >= 0 && ppid != query.ppid))) {
+                continue;
+            }
+            if (need_cmdline) {
+                ssize_t len = _readProcFile(proc_fd, dent->d_name, "cmdline", buf, PROC_CMDLINE_SIZE);
+                if (len < 0) {
+                    continue;
+                }
+                // the arguments are NUL-terminated, one after the other
+                while (len > 0 && buf[len - 1] == '\0') {
+                    len--;
+                }
+                for (ssize_t i = 0; i < len; i++) {
+                    if (buf[i] == '\0') {
+                        buf[i] = ' ';
+                    }
+                }
+                match.cmdline.assign(buf, len);
+            }
+            if (query.pattern) {
+                // kernel threads and zombies have no command line, only a name
+                const string *subject = &match.name;
+                if (query.full && !match.cmdline.empty()) {
+                    subject = &match.cmdline;
+                } else if (query.full && !need_stat && !readStat(dent->d_name)) {
+                    continue;
+                }
+                if (regexec(query.pattern, subject->c_str(), 0, nullptr, 0) != 0) {
+                    continue;
+                }
+            }
+            matches.push_back(match);
+        }
+    }
+    close(proc_fd);
+    return n == 0;
+}
+
+int procSignal(const ProcMatch& match, int sig_num) {
+    int pidfd = _pidfdOpen(match.pid);
+    if (pidfd < 0 && errno != ENOSYS) {
+        return -1;
+    }
+    // from here on the pidfd holds on to whichever process has the pid now, so
+    // if that one started when the matched one did, it is the matched one
+    char dir[32];
+    char buf[PROC_STAT_SIZE + 1];
+    string name;
+    pid_t ppid;
+    unsigned long long start = 0;
+    snprintf(dir, sizeof(dir), "/proc/%d", match.pid);
+    if (_readProcFile(AT_FDCWD, dir, "stat", buf, PROC_STAT_SIZE) <= 0 ||
+        !_parseStat(buf, name, ppid, start) || start != match.start) {
+        if (pidfd >= 0) {
+            close(pidfd);
+        }
+        errno = ESRCH;
+        return -1;
+    }
+    if (pidfd < 0) {
+        return kill(match.pid, sig_num);
+    }
+    int ret = _pidfdSendSignal(pidfd, sig_num);
+    int saved_errno = errno;
+    close(pidfd);
+    errno = saved_errno;
+    return ret;
+}
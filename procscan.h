@@ -0,0 +1,47 @@
+#ifndef SMASH__PROCSCAN_H_
+#define SMASH__PROCSCAN_H_
+
+#include <string>
+#include <vector>
+#include <regex.h>
+#include <sys/types.h>
+
+// The /proc scan behind the pgrep and pkill builtins.
+//
+// /proc is listed with getdents64() into a large buffer and every process is
+// read with openat() relative to the /proc fd, so a process costs no path
+// lookup from the root. Only the files the query needs are read: the owner
+// comes from a stat of the process's directory, the name, parent and start
+// time from /proc/PID/stat, and /proc/PID/cmdline only when matching or
+// printing whole command lines.
+
+// What a process must match. A field left at its default matches anything.
+struct ProcQuery {
+    const regex_t *pattern;     // against the name, or the command line if full
+    bool full;
+    bool by_uid;
+    uid_t uid;                  // effective
+    pid_t ppid;                 // -1 for any
+    bool cmdlines;              // fill in cmdline even without full
+    bool identify;              // fill in start, to signal the process later
+
+    ProcQuery();
+};
+
+struct ProcMatch {
+    pid_t pid;
+    unsigned long long start;   // ticks after boot, which tells a reused pid apart
+    std::string name;
+    std::string cmdline;        // arguments joined by spaces
+};
+
+// Appends the processes that match the query, in pid order and leaving out
+// the caller. Returns false if /proc cannot be listed.
+bool procScan(const ProcQuery& query, std::vector<ProcMatch>& matches);
+
+// Sends a signal to a process found with query.identify set, through a pidfd
+// that is checked to still refer to the process that matched. Returns -1 with
+// errno ESRCH if the process is gone, even if its pid was reused since.
+int procSignal(const ProcMatch& match, int sig_num);
+
+#endif //SMASH__PROCSCAN_H_
@@ -0,0 +1,220 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "script.h"
+#include "signals.h"
+
+using namespace std;
+
+int _parseCommandLine(const char* cmd_line, char** args);
+string _trim(const std::string& s);
+uint64_t _fnv1a(const std::string& data);
+
+ScriptPlan::ScriptPlan():
+    _data(nullptr),
+    _size(0) {}
+
+// main() keeps the plan until the smash exits: commands keep pointers to their
+// arguments, and jobs started by the script may outlive its last line.
+ScriptPlan::~ScriptPlan() {
+    if (_data && _compiled.empty()) {
+        munmap(_data, _size);
+    }
+}
+
+ScriptPlan *ScriptPlan::load(const std::string& path, const std::string& cache_dir) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        perror("smash error: open failed");
+        return nullptr;
+    }
+    stringstream contents;
+    contents << file.rdbuf();
+    string script = contents.str();
+    uint64_t hash = _fnv1a(script);
+
+    string plan_path = path + ".plan";
+    if (!cache_dir.empty()) {
+        mkdir(cache_dir.c_str(), 0700);
+        stringstream name;
+        name << cache_dir << "/" << hex << setw(16) << setfill('0') << hash << ".plan";
+        plan_path = name.str();
+    }
+    ScriptPlan *plan = new ScriptPlan();
+    if (plan->map(plan_path, hash, script.size())) {
+        return plan;
+    }
+
+    // a plan that cannot be written is still run, from memory
+    string compiled = compile(script, hash);
+    string tmp_path = plan_path + "." + to_string(getpid());
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd >= 0 && write(fd, compiled.data(), compiled.size()) == (ssize_t)compiled.size();
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (written && rename(tmp_path.c_str(), plan_path.c_str()) == 0 &&
+        plan->map(plan_path, hash, script.size())) {
+        return plan;
+    }
+    unlink(tmp_path.c_str());
+    plan->_compiled.swap(compiled);
+    plan->_data = &plan->_compiled[0];
+    plan->_size = plan->_compiled.size();
+    return plan;
+}
+
+string ScriptPlan::compile(const std::string& script, uint64_t hash) {
+    vector<ScriptPlanLine> lines;
+    vector<uint32_t> arg_offsets;
+    string strings;
+    // strings are laid out after the tables, so their offsets are fixed up
+    // once the tables' sizes are known
+    size_t start = 0;
+    while (start < script.size()) {
+        size_t end = script.find('\n', start);
+        if (end == string::npos) {
+            end = script.size();
+        }
+        string cmd_line = script.substr(start, end - start);
+        start = end + 1;
+
+        ScriptPlanLine line = ScriptPlanLine();
+        line.cmd_line = strings.size();
+        line.first_arg = arg_offsets.size();
+        line.kind = CMD_NONE;
+        strings.append(cmd_line.c_str(), strlen(cmd_line.c_str()) + 1);
+        if (!_trim(cmd_line).empty()) {
+            char* args[COMMAND_MAX_ARGS];
+            int argc = _parseCommandLine(cmd_line.c_str(), args);
+            line.kind = SmallShell::getInstance().classify(cmd_line.c_str(), args);
+            line.argc = argc;
+            for (int i = 0; i < argc; ++i) {
+                arg_offsets.push_back(strings.size());
+                strings.append(args[i], strlen(args[i]) + 1);
+                free(args[i]);
+            }
+        }
+        lines.push_back(line);
+    }
+
+    ScriptPlanHeader header = ScriptPlanHeader();
+    header.magic = SCRIPT_PLAN_MAGIC;
+    header.version = SCRIPT_PLAN_VERSION;
+    header.hash = hash;
+    header.script_size = script.size();
+    header.lines = lines.size();
+    header.args_offset = sizeof(header) + lines.size() * sizeof(ScriptPlanLine);
+    uint32_t strings_offset = header.args_offset + arg_offsets.size() * sizeof(uint32_t);
+    for (ScriptPlanLine& line : lines) {
+        line.cmd_line += strings_offset;
+    }
+    for (uint32_t& offset : arg_offsets) {
+        offset += strings_offset;
+    }
+
+    string plan((const char *)&header, sizeof(header));
+    plan.append((const char *)lines.data(), lines.size() * sizeof(ScriptPlanLine));
+    plan.append((const char *)arg_offsets.data(), arg_offsets.size() * sizeof(uint32_t));
+    plan.append(strings);
+    return plan;
+}
+
+// Maps the plan privately and writable: constructors get their arguments as
+// char*, and whatever they write stays in our copy of the pages.
+bool ScriptPlan::map(const std::string& path, uint64_t hash, uint64_t script_size) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat stats;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &stats) == 0 && stats.st_size > 0) {
+        data = mmap(nullptr, stats.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    _data = (char *)data;
+    _size = stats.st_size;
+    if (!validate(hash, script_size)) {
+        munmap(_data, _size);
+        _data = nullptr;
+        _size = 0;
+        return false;
+    }
+    return true;
+}
+
+// A plan of another script, of another version or truncated is recompiled.
+bool ScriptPlan::validate(uint64_t hash, uint64_t script_size) const {
+    if (_size < sizeof(ScriptPlanHeader) || _data[_size - 1] != '\0') {
+        return false;
+    }
+    const ScriptPlanHeader *header = (const ScriptPlanHeader *)_data;
+    if (header->magic != SCRIPT_PLAN_MAGIC || header->version != SCRIPT_PLAN_VERSION ||
+        header->hash != hash || header->script_size != script_size ||
+        header->lines > (_size - sizeof(ScriptPlanHeader)) / sizeof(ScriptPlanLine) ||
+        header->args_offset != sizeof(ScriptPlanHeader) + header->lines * sizeof(ScriptPlanLine)) {
+        return false;
+    }
+    const ScriptPlanLine *lines = (const ScriptPlanLine *)(_data + sizeof(ScriptPlanHeader));
+    size_t arg_count = 0;
+    for (uint32_t i = 0; i < header->lines; ++i) {
+        if (lines[i].first_arg != arg_count || lines[i].argc >= COMMAND_MAX_ARGS ||
+            lines[i].kind > CMD_EXTERNAL || (lines[i].kind != CMD_NONE && lines[i].argc == 0)) {
+            return false;
+        }
+        arg_count += lines[i].argc;
+    }
+    size_t strings_offset = header->args_offset + arg_count * sizeof(uint32_t);
+    if (strings_offset > _size) {
+        return false;
+    }
+    const uint32_t *arg_offsets = (const uint32_t *)(_data + header->args_offset);
+    for (size_t i = 0; i < arg_count; ++i) {
+        if (arg_offsets[i] < strings_offset || arg_offsets[i] >= _size) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->lines; ++i) {
+        if (lines[i].cmd_line < strings_offset || lines[i].cmd_line >= _size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replays the script the way main() reads stdin, prompts included, so that
+// its output is the same as "smash < FILE".
+int ScriptPlan::run(SmallShell& smash) {
+    const ScriptPlanHeader *header = (const ScriptPlanHeader *)_data;
+    const ScriptPlanLine *lines = (const ScriptPlanLine *)(_data + sizeof(ScriptPlanHeader));
+    const uint32_t *arg_offsets = (const uint32_t *)(_data + header->args_offset);
+    char* args[COMMAND_MAX_ARGS];
+    for (uint32_t i = 0; i < header->lines; ++i) {
+        cout << smash.name() << flush;
+        dispatchSignalEvents();
+        smash.refreshJobs();
+        const ScriptPlanLine& line = lines[i];
+        for (uint16_t a = 0; a < line.argc; ++a) {
+            args[a] = _data + arg_offsets[line.first_arg + a];
+        }
+        args[line.argc] = nullptr;
+        if (!smash.executeCommand(_data + line.cmd_line, (CommandKind)line.kind, args)) {
+            return 0;
+        }
+    }
+    cout << smash.name() << flush;
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef SMASH__SCRIPT_H_
+#define SMASH__SCRIPT_H_
+
+#include <string>
+#include <stdint.h>
+#include "Commands.h"
+
+// Runs a script file with "smash --script FILE", each line as if it had been
+// typed at the prompt.
+//
+// The script is first compiled into a plan: every line tokenized the way
+// _parseCommandLine() does it and classified by SmallShell::classify(). The
+// plan is written next to the script as FILE.plan, or with
+// "--plan-cache DIR" to DIR/<hash>.plan, and is keyed by a hash of the
+// script's contents. A later run whose script hashes the same maps the plan
+// and hands each line's tokens and kind straight to
+// SmallShell::executeCommand(), so a line costs no parsing or lookup.
+//
+// Layout: a ScriptPlanHeader, one ScriptPlanLine per line, a table of
+// uint32_t string offsets for the lines' arguments and the NUL-terminated
+// strings themselves. Offsets are from the start of the file.
+#define SCRIPT_PLAN_MAGIC (0x4e4c5053)
+#define SCRIPT_PLAN_VERSION (4)
+
+struct ScriptPlanHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;              // FNV-1a of the script
+    uint64_t script_size;
+    uint32_t lines;
+    uint32_t args_offset;       // the argument offset table
+};
+
+struct ScriptPlanLine {
+    uint32_t cmd_line;          // offset of the line's text
+    uint32_t first_arg;         // index into the argument offset table
+    uint16_t argc;
+    uint8_t kind;               // CommandKind
+    uint8_t unused;
+};
+
+class ScriptPlan {
+public:
+    // Loads the cached plan for the script or compiles and caches a new one.
+    // Returns nullptr if the script cannot be read.
+    static ScriptPlan *load(const std::string& path, const std::string& cache_dir);
+    ScriptPlan(const ScriptPlan&)       = delete;
+    void operator=(const ScriptPlan&)   = delete;
+    ~ScriptPlan();
+
+    // Runs the lines in order until the end or quit. Returns the exit code.
+    int run(SmallShell& smash);
+
+private:
+    ScriptPlan();
+    static std::string compile(const std::string& script, uint64_t hash);
+    bool map(const std::string& path, uint64_t hash, uint64_t script_size);
+    bool validate(uint64_t hash, uint64_t script_size) const;
+
+    char *_data;
+    size_t _size;
+    std::string _compiled;      // the plan, when it could not be cached
+};
+
+#endif //SMASH__SCRIPT_H_
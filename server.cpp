@@ -0,0 +1,405 @@
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "server.h"
+#include "signals.h"
+
+using namespace std;
+
+static SmashServer *_server = nullptr;
+
+SmashServer::SmashServer(const std::string& path):
+    _path(path),
+    _listen_fd(-1),
+    _stdout(fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0)),
+    _stderr(fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0)),
+    _smash(SmallShell::getInstance()) {}
+
+SmashServer::~SmashServer() {
+    if (_server == this) {
+        _server = nullptr;
+    }
+    for (auto& entry : _sessions) {
+        close(entry.first);
+        for (int *pipe_fds : {entry.second.cmd_pipe, entry.second.job_pipe}) {
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+        }
+    }
+    if (_listen_fd >= 0) {
+        close(_listen_fd);
+        unlink(_path.c_str());
+    }
+    close(_stdout);
+    close(_stderr);
+}
+
+int SmashServer::run() {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (_path.length() >= sizeof(addr.sun_path)) {
+        cerr << "smash error: serve: socket path too long" << endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, _path.c_str());
+    char cwd[COMMAND_ARGS_MAX_LENGTH];
+    _home = getcwd(cwd, sizeof(cwd)) ? cwd : "/";
+    unlink(_path.c_str());
+    _listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_listen_fd < 0) {
+        perror("smash error: socket failed");
+        return 1;
+    }
+    if (bind(_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("smash error: bind failed");
+        close(_listen_fd);
+        _listen_fd = -1;
+        return 1;
+    }
+    if (listen(_listen_fd, SOMAXCONN) < 0) {
+        perror("smash error: listen failed");
+        return 1;
+    }
+
+    // commands never read the daemon's stdin
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+    }
+    _smash._serving = true;
+    _server = this;
+    static bool registered = false;
+    if (!registered) {
+        pthread_atfork(nullptr, nullptr, closeInChild);
+        registered = true;
+    }
+    _smash._job_list.setReapedHook([this](JobsList::JobEntry *job, int status) {
+        onReaped(job, status);
+    });
+
+    while (true) {
+        // sessions[i] owns fds[i + 2]
+        vector<struct pollfd> fds;
+        vector<int> sessions;
+        fds.push_back({_listen_fd, POLLIN, 0});
+        fds.push_back({signalEventsFd(), POLLIN, 0});
+        for (auto& entry : _sessions) {
+            Session& session = entry.second;
+            short events = (session.eof || session.quit ? 0 : POLLIN) |
+                           (session.output.empty() ? 0 : POLLOUT);
+            if (events) {
+                fds.push_back({entry.first, events, 0});
+                sessions.push_back(entry.first);
+            }
+            if (session.output.size() < SERVE_BACKLOG) {
+                fds.push_back({session.cmd_pipe[0], POLLIN, 0});
+                fds.push_back({session.job_pipe[0], POLLIN, 0});
+                sessions.insert(sessions.end(), 2, entry.first);
+            }
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("smash error: poll failed");
+            return 1;
+        }
+        dispatchSignalEvents();
+        reap();
+        _smash.refreshJobs();
+        if (fds[0].revents & POLLIN) {
+            acceptSession();
+        }
+        for (size_t i = 2; i < fds.size(); ++i) {
+            auto it = _sessions.find(sessions[i - 2]);
+            if (!fds[i].revents || it == _sessions.end()) {
+                continue;
+            }
+            Session& session = it->second;
+            if (fds[i].fd != session.fd) {
+                relay(session, fds[i].fd, SERVE_BACKLOG - min<size_t>(session.output.size(), SERVE_BACKLOG));
+                flush(session);
+                continue;
+            }
+            if (fds[i].revents & (POLLOUT | POLLHUP | POLLERR)) {
+                flush(session);
+            }
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !session.eof && !session.quit) {
+                readSession(session);
+            }
+            service(fds[i].fd);
+        }
+    }
+}
+
+void SmashServer::acceptSession() {
+    int fd = accept4(_listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        perror("smash error: accept failed");
+        return;
+    }
+    Session session;
+    session.fd = fd;
+    if (pipe2(session.cmd_pipe, O_CLOEXEC) < 0) {
+        perror("smash error: pipe failed");
+        close(fd);
+        return;
+    }
+    if (pipe2(session.job_pipe, O_CLOEXEC) < 0) {
+        perror("smash error: pipe failed");
+        close(session.cmd_pipe[0]);
+        close(session.cmd_pipe[1]);
+        close(fd);
+        return;
+    }
+    // a bigger pipe lets more output wait for a slow client; the default
+    // capacity is used where the system limits it
+    for (int *pipe_fds : {session.cmd_pipe, session.job_pipe}) {
+        fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(pipe_fds[0], F_SETPIPE_SZ, SERVE_PIPE_SIZE);
+    }
+    session.prompt = "smash> ";
+    session.cwd = _home;
+    session.cd_called = false;
+    session.foreground = nullptr;
+    session.eof = false;
+    session.quit = false;
+    _sessions[fd] = session;
+}
+
+void SmashServer::readSession(Session& session) {
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(session.fd, buf, sizeof(buf))) < 0 && errno == EINTR) {}
+    if (n < 0 && errno == EAGAIN) {
+        return;
+    }
+    if (n <= 0) {
+        session.eof = true;
+        return;
+    }
+    session.input.append(buf, n);
+}
+
+// Runs what the session has queued and drops it once it quit, or once it hung
+// up and everything it sent has completed, as soon as its output is sent.
+void SmashServer::service(int fd) {
+    auto it = _sessions.find(fd);
+    if (it == _sessions.end()) {
+        return;
+    }
+    Session& session = it->second;
+    if (!session.quit && !runPending(session)) {
+        session.quit = true;
+    }
+    flush(session);
+    if ((session.quit || (session.eof && !session.foreground)) && session.output.empty()) {
+        closeSession(fd);
+    }
+}
+
+void SmashServer::closeSession(int fd) {
+    auto it = _sessions.find(fd);
+    if (it == _sessions.end()) {
+        return;
+    }
+    // an abandoned foreground command becomes a shared background job
+    if (it->second.foreground) {
+        _smash._job_list.addJob(it->second.foreground);
+    }
+    for (auto owner = _owners.begin(); owner != _owners.end();) {
+        owner = owner->second == fd ? _owners.erase(owner) : next(owner);
+    }
+    close(fd);
+    for (int *pipe_fds : {it->second.cmd_pipe, it->second.job_pipe}) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+    }
+    _sessions.erase(it);
+}
+
+// Executes the session's complete lines until one leaves a foreground command
+// running or its client falls behind. Returns false when the session quit.
+bool SmashServer::runPending(Session& session) {
+    size_t pos;
+    while (!session.foreground && session.output.size() < SERVE_BACKLOG &&
+           (pos = session.input.find('\n')) != string::npos) {
+        string line = session.input.substr(0, pos);
+        session.input.erase(0, pos + 1);
+
+        // the server's own builtins write to the pipe with no one reading it
+        // meanwhile, so it must start out empty
+        relay(session, session.cmd_pipe[0], SIZE_MAX);
+        size_t last = line.find_last_not_of(" \t\r");
+        enter(session, last != string::npos && line[last] == '&');
+        bool keep = _smash.executeCommand(line.c_str());
+        leave(session);
+
+        for (JobsList::JobEntry *job : _smash._job_list.getAllJobs()) {
+            if (_owners.find(job->pid()) == _owners.end()) {
+                _owners[job->pid()] = session.fd;
+            }
+        }
+        session.foreground = _smash._detached_cmd;
+        _smash._detached_cmd = nullptr;
+        if (!session.foreground) {
+            reply(session);
+        }
+        if (!keep) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SmashServer::enter(Session& session, bool background) {
+    int out = background ? session.job_pipe[1] : session.cmd_pipe[1];
+    cout.flush();
+    dup2(out, STDOUT_FILENO);
+    dup2(out, STDERR_FILENO);
+    if (chdir(session.cwd.c_str()) < 0) {
+        perror("smash error: chdir failed");
+    }
+    _smash._name = session.prompt;
+    strcpy(_smash._cwd, session.old_cwd.c_str());
+    _smash._cd_called = session.cd_called;
+}
+
+void SmashServer::leave(Session& session) {
+    char cwd[COMMAND_ARGS_MAX_LENGTH];
+    cout.flush();
+    if (getcwd(cwd, sizeof(cwd))) {
+        session.cwd = cwd;
+    }
+    session.prompt = _smash._name;
+    session.old_cwd = _smash._cwd;
+    session.cd_called = _smash._cd_called;
+    dup2(_stdout, STDOUT_FILENO);
+    dup2(_stderr, STDERR_FILENO);
+}
+
+// Ends the reply to a command line, after whatever its command left in the
+// pipes.
+void SmashServer::reply(Session& session) {
+    for (int fd : {session.cmd_pipe[0], session.job_pipe[0]}) {
+        int pending;
+        if (ioctl(fd, FIONREAD, &pending) == 0) {
+            relay(session, fd, pending);
+        }
+    }
+    frame(session, SMASH_FRAME_REPLY, session.prompt);
+    flush(session);
+}
+
+// Collects finished foreground commands, resuming their sessions, and lets
+// the jobs list reap background jobs, which reports them through onReaped.
+void SmashServer::reap() {
+    vector<int> resumed;
+    for (auto& entry : _sessions) {
+        Session& session = entry.second;
+        if (session.foreground &&
+            waitpid(session.foreground->pid(), nullptr, WNOHANG) != 0) {
+            session.foreground = nullptr;
+            reply(session);
+            resumed.push_back(entry.first);
+        }
+    }
+    _smash._job_list.removeFinishedJobs();
+    for (int fd : resumed) {
+        service(fd);
+    }
+}
+
+void SmashServer::onReaped(JobsList::JobEntry *job, int status) {
+    auto owner = _owners.find(job->pid());
+    if (owner == _owners.end()) {
+        return;
+    }
+    auto it = _sessions.find(owner->second);
+    if (it != _sessions.end()) {
+        string event = "[" + to_string(job->cmd()->_jid) + "] " + job->cmd()->cmd_line();
+        if (WIFSIGNALED(status)) {
+            event += " : killed by signal " + to_string(WTERMSIG(status));
+        } else {
+            event += " : exited with status " + to_string(WEXITSTATUS(status));
+        }
+        // the job's last output comes first
+        int pending;
+        if (ioctl(it->second.job_pipe[0], FIONREAD, &pending) == 0) {
+            relay(it->second, it->second.job_pipe[0], pending);
+        }
+        frame(it->second, SMASH_FRAME_EVENT, event);
+        flush(it->second);
+    }
+    _owners.erase(owner);
+}
+
+// Builtins forked by the server do not exec, so they would hold every
+// session's fds open: a session closed by the server would then never make
+// the builtin writing to its pipe fail. Fds 1 and 2 are the child's own.
+void SmashServer::closeInChild() {
+    if (!_server) {
+        return;
+    }
+    close(_server->_listen_fd);
+    for (auto& entry : _server->_sessions) {
+        close(entry.first);
+        for (int *pipe_fds : {entry.second.cmd_pipe, entry.second.job_pipe}) {
+            close(pipe_fds[0]);
+            close(pipe_fds[1]);
+        }
+    }
+}
+
+// Frames up to max bytes that wait in one of the session's pipes as output.
+void SmashServer::relay(Session& session, int fd, size_t max) {
+    char buf[65536];
+    while (max > 0) {
+        ssize_t n = read(fd, buf, min(sizeof(buf), max));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        frame(session, SMASH_FRAME_OUTPUT, string(buf, n));
+        max -= n;
+    }
+}
+
+void SmashServer::frame(Session& session, char kind, const std::string& data) {
+    session.output += kind + to_string(data.length()) + "\n" + data;
+}
+
+// Sends as much output as the socket takes without blocking. A session whose
+// client is gone drops its output, and is closed once its commands finish.
+void SmashServer::flush(Session& session) {
+    size_t done = 0;
+    while (done < session.output.length()) {
+        ssize_t n = ::send(session.fd, session.output.data() + done,
+                           session.output.length() - done, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                done = session.output.length();
+                session.eof = true;
+            }
+            break;
+        }
+        done += n;
+    }
+    session.output.erase(0, done);
+}
@@ -0,0 +1,88 @@
+#ifndef SMASH__SERVER_H_
+#define SMASH__SERVER_H_
+
+#include <string>
+#include <map>
+#include "Commands.h"
+
+// Serves one SmallShell to many local clients over a Unix stream socket.
+//
+// A client sends newline-terminated command lines. Everything the server
+// sends back is framed: a kind byte, the payload's length in decimal, a
+// newline and the payload. The command's output (stdout and stderr of
+// builtins and of the processes it starts) comes in SMASH_FRAME_OUTPUT
+// frames, followed by a SMASH_FRAME_REPLY frame holding the session's
+// prompt. When a background job started by the session finishes, a
+// SMASH_FRAME_EVENT frame is pushed to it at any time. Output is never
+// parsed, so it may hold any bytes.
+//
+// Sessions are multiplexed on a single thread, so the shared jobs list is
+// only ever touched from the event loop. Each session has its own cwd,
+// OLDPWD and prompt, starting out as the server's and swapped in around its
+// commands. A session whose foreground command is still running queues its
+// input until the command is reaped, without holding up the other sessions.
+// For the same reason builtins that can run for long (repeat, watch, rundag,
+// xargs, cp, memo, parallel) or print much (cat, head, wc, grep, tail,
+// getfileinfo, pgrep, joblog) run in a child of their own, and wait and
+// joblog -f, which need the server's loop, are refused. The PATH lookup
+// cache, like the jobs list, is shared by all sessions.
+//
+// Commands write to pipes of their session, which the loop relays to the
+// non-blocking socket, so a client that stops reading only holds up its own
+// commands: once SERVE_BACKLOG bytes wait for it, the pipes are left full
+// and its next lines wait. Background jobs get a pipe of their own, so that
+// they cannot fill the one the server's builtins write to.
+#define SMASH_FRAME_OUTPUT 'o'
+#define SMASH_FRAME_REPLY 'p'
+#define SMASH_FRAME_EVENT 'e'
+#define SERVE_BACKLOG (1 << 20)
+#define SERVE_PIPE_SIZE (1 << 20)
+
+class SmashServer {
+public:
+    SmashServer(const std::string& path);
+    ~SmashServer();
+    int run();
+
+private:
+    struct Session {
+        int fd;
+        int cmd_pipe[2];            // output of the session's commands
+        int job_pipe[2];            // output of its background jobs
+        std::string input;
+        std::string output;         // frames not sent yet
+        std::string prompt;
+        std::string cwd;
+        std::string old_cwd;
+        bool cd_called;
+        Command *foreground;
+        bool eof;
+        bool quit;
+    };
+
+    void acceptSession();
+    void readSession(Session& session);
+    void service(int fd);
+    void closeSession(int fd);
+    bool runPending(Session& session);
+    void enter(Session& session, bool background);
+    void leave(Session& session);
+    void reply(Session& session);
+    void reap();
+    void onReaped(JobsList::JobEntry *job, int status);
+    static void relay(Session& session, int fd, size_t max);
+    static void frame(Session& session, char kind, const std::string& data);
+    static void flush(Session& session);
+    static void closeInChild();
+
+    std::string _path;
+    std::string _home;
+    int _listen_fd;
+    int _stdout;
+    int _stderr;
+    std::map<int, Session> _sessions;
+    std::map<pid_t, int> _owners;
+    SmallShell& _smash;
+};
+
+#endif //SMASH__SERVER_H_
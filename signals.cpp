@@ -1,18 +1,105 @@
-#include <iostream>
-#include <signal.h>
-#include "signals.h"
-#include "Commands.h"
-
-using namespace std;
-
-void ctrlZHandler(int sig_num) {
-    SmallShell::getInstance().handle_ctrl_z(sig_num);
-}
-
-void ctrlCHandler(int sig_num) {
-    SmallShell::getInstance().handle_ctrl_c(sig_num);
-}
-
-void alarmHandler(int sig_num) {
-
-}
+#include <iostream>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "signals.h"
+#include "Commands.h"
+
+using namespace std;
+
+// The handlers only record the signal in a self-pipe. The main loop and the
+// foreground wait poll its read end and act on the signals from normal
+// context, where printing and touching the jobs list are safe.
+static int event_pipe[2] = {-1, -1};
+
+static void notify(int sig_num) {
+    int saved_errno = errno;
+    unsigned char byte = sig_num;
+    if (event_pipe[1] >= 0) {
+        write(event_pipe[1], &byte, 1);
+    }
+    errno = saved_errno;
+}
+
+void ctrlZHandler(int sig_num) {
+    notify(sig_num);
+}
+
+void ctrlCHandler(int sig_num) {
+    notify(sig_num);
+}
+
+void alarmHandler(int sig_num) {
+    notify(sig_num);
+}
+
+void childHandler(int sig_num) {
+    notify(sig_num);
+}
+
+void ioHandler(int sig_num) {
+    notify(sig_num);
+}
+
+// Unlike SIG_IGN, a handler is reset by exec, so commands still die on a
+// broken pipe while the smash itself just sees EPIPE.
+void pipeHandler(int sig_num) {}
+
+int setupSignalEvents() {
+    if (pipe(event_pipe) < 0) {
+        return -1;
+    }
+    for (int fd : event_pipe) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return 0;
+}
+
+int setSignalHandler(int sig_num, void (*handler)(int)) {
+    struct sigaction sa;
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    return sigaction(sig_num, &sa, nullptr);
+}
+
+int signalEventsFd() {
+    return event_pipe[0];
+}
+
+void dispatchSignalEvents() {
+    unsigned char sigs[64];
+    ssize_t n;
+    while ((n = read(event_pipe[0], sigs, sizeof(sigs))) > 0) {
+        for (ssize_t i = 0; i < n; ++i) {
+            switch (sigs[i]) {
+            case SIGTSTP:
+                SmallShell::getInstance().handle_ctrl_z(SIGTSTP);
+                break;
+            case SIGINT:
+                SmallShell::getInstance().handle_ctrl_c(SIGINT);
+                break;
+            case SIGIO:
+                SmallShell::getInstance().handle_io(SIGIO);
+                break;
+            default:
+                // SIGCHLD and SIGALRM only wake up whoever is polling
+                break;
+            }
+        }
+    }
+}
+
+// Forked children that keep running smash code (job leaders) must not report
+// into the parent's pipe.
+void resetSignalEvents() {
+    signal(SIGCHLD, SIG_DFL);
+    for (int& fd : event_pipe) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
@@ -1,8 +1,17 @@
-#ifndef SMASH__SIGNALS_H_
-#define SMASH__SIGNALS_H_
-
-void ctrlZHandler(int sig_num);
-void ctrlCHandler(int sig_num);
-void alarmHandler(int sig_num);
-
-#endif //SMASH__SIGNALS_H_
+#ifndef SMASH__SIGNALS_H_
+#define SMASH__SIGNALS_H_
+
+void ctrlZHandler(int sig_num);
+void ctrlCHandler(int sig_num);
+void alarmHandler(int sig_num);
+void childHandler(int sig_num);
+void ioHandler(int sig_num);
+void pipeHandler(int sig_num);
+
+int setupSignalEvents();
+int setSignalHandler(int sig_num, void (*handler)(int));
+int signalEventsFd();
+void dispatchSignalEvents();
+void resetSignalEvents();
+
+#endif //SMASH__SIGNALS_H_
@@ -1,26 +1,130 @@
 #include <iostream>
+#include <string>
 #include <unistd.h>
+#include <poll.h>
+#include <errno.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include "Commands.h"
 #include "signals.h"
+#include "server.h"
+#include "script.h"
 
 using namespace std;
 
+// Reads the next line from stdin while multiplexing the signal self-pipe, so
+// Ctrl-C/Ctrl-Z are handled even while waiting for input. Returns false on EOF.
+static bool readCommandLine(string& line) {
+    string& pending = SmallShell::getInstance().input();
+    while (true) {
+        // Lines may already be buffered; signals that arrived before them must
+        // still be handled first, as they would be with a synchronous handler.
+        // The wakeups also refresh the jobs list and start queued jobs.
+        dispatchSignalEvents();
+        SmallShell::getInstance().refreshJobs();
+        size_t pos = pending.find('\n');
+        if (pos != string::npos) {
+            line = pending.substr(0, pos);
+            pending.erase(0, pos + 1);
+            return true;
+        }
+
+        struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {signalEventsFd(), POLLIN, 0}};
+        if (poll(fds, fds[1].fd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("smash error: poll failed");
+            return false;
+        }
+        if (fds[1].revents & POLLIN) {
+            dispatchSignalEvents();
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            char buf[4096];
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                line = pending;
+                pending.clear();
+                return !line.empty();
+            }
+            pending.append(buf, n);
+        }
+    }
+}
 
 int main(int argc, char* argv[]) {
-    if (signal(SIGTSTP , ctrlZHandler) == SIG_ERR) {
+    // smash -c CMD_LINE runs one line, with no prompt, and exits with its
+    // status. Nothing waits for input, so the signal self-pipe and handlers
+    // are not set up: the smash waits for the command with a plain waitpid()
+    // and keyboard signals reach both, as with "sh -c". Nor is the smash a
+    // subreaper, as it does not outlive the command to reap anything.
+    if (argc == 3 && string(argv[1]) == "-c") {
+        return SmallShell::getInstance().executeOnce(argv[2]);
+    }
+    if (setupSignalEvents() < 0) {
+        perror("smash error: pipe failed");
+    }
+    if (setSignalHandler(SIGTSTP , ctrlZHandler) < 0) {
         perror("smash error: failed to set ctrl-Z handler");
     }
-    if(signal(SIGINT , ctrlCHandler)==SIG_ERR) {
+    if (setSignalHandler(SIGINT , ctrlCHandler) < 0) {
         perror("smash error: failed to set ctrl-C handler");
     }
+    if (setSignalHandler(SIGCHLD , childHandler) < 0) {
+        perror("smash error: failed to set SIGCHLD handler");
+    }
+    if (setSignalHandler(SIGIO , ioHandler) < 0) {
+        perror("smash error: failed to set SIGIO handler");
+    }
+    if (setSignalHandler(SIGALRM , alarmHandler) < 0) {
+        perror("smash error: failed to set SIGALRM handler");
+    }
 
     SmallShell& smash = SmallShell::getInstance();
+    smash.becomeSubreaper();
+    const char *serve_path = nullptr;
+    const char *script_path = nullptr;
+    string plan_cache;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (string(argv[i]) == "--serve") {
+            serve_path = argv[i + 1];
+        } else if (string(argv[i]) == "--script") {
+            script_path = argv[i + 1];
+        } else if (string(argv[i]) == "--plan-cache") {
+            plan_cache = argv[i + 1];
+        } else if (string(argv[i]) == "--jobdb") {
+            if (!smash.openJobDb(argv[i + 1])) {
+                return 1;
+            }
+        } else if (string(argv[i]) == "--export") {
+            if (!smash.openJobTable(argv[i + 1])) {
+                return 1;
+            }
+        }
+    }
+
+    if (serve_path) {
+        if (setSignalHandler(SIGPIPE , pipeHandler) < 0) {
+            perror("smash error: failed to set SIGPIPE handler");
+        }
+        return SmashServer(serve_path).run();
+    }
+
+    if (script_path) {
+        ScriptPlan *plan = ScriptPlan::load(script_path, plan_cache);
+        return plan ? plan->run(smash) : 1;
+    }
+
     string cmd_line;
     do {
-        cout << smash.name();
-        getline(std::cin, cmd_line);
+        cout << smash.name() << flush;
+        if (!readCommandLine(cmd_line)) {
+            break;
+        }
     } while (smash.executeCommand(cmd_line.c_str()));
     return 1;
-}
\ No newline at end of file
+}
@@ -0,0 +1,134 @@
+#include <system_error>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "smash_client.h"
+#include "server.h"
+
+using namespace std;
+
+static system_error _systemError(const char* what) {
+    return system_error(errno, generic_category(), what);
+}
+
+SmashClient::SmashClient(const std::string& path):
+    _prompt("smash> ") {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        throw _systemError("smash client: connect failed");
+    }
+    strcpy(addr.sun_path, path.c_str());
+    _fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_fd < 0) {
+        throw _systemError("smash client: socket failed");
+    }
+    if (connect(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        system_error error = _systemError("smash client: connect failed");
+        close(_fd);
+        throw error;
+    }
+}
+
+SmashClient::~SmashClient() {
+    close(_fd);
+}
+
+std::string SmashClient::run(const std::string& line) {
+    string data = line + "\n";
+    for (size_t done = 0; done < data.length();) {
+        ssize_t n = send(_fd, data.data() + done, data.length() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno != EINTR) {
+            throw _systemError("smash client: send failed");
+        }
+        done += n > 0 ? n : 0;
+    }
+    while (!parse()) {
+        if (!receive(-1)) {
+            errno = ECONNRESET;
+            throw _systemError("smash client: server closed the session");
+        }
+    }
+    string output;
+    output.swap(_reply);
+    return output;
+}
+
+const std::string& SmashClient::prompt() const {
+    return _prompt;
+}
+
+bool SmashClient::waitEvent(int timeout_ms) {
+    parse();
+    while (_events.empty()) {
+        if (!receive(timeout_ms)) {
+            return false;
+        }
+        parse();
+    }
+    return true;
+}
+
+std::vector<std::string> SmashClient::takeEvents() {
+    vector<string> events;
+    events.swap(_events);
+    return events;
+}
+
+// Reads whatever the server sent within timeout_ms. Returns false on timeout
+// or when the server hung up.
+bool SmashClient::receive(int timeout_ms) {
+    struct pollfd pfd = {_fd, POLLIN, 0};
+    int ret;
+    while ((ret = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR) {}
+    if (ret <= 0) {
+        return false;
+    }
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(_fd, buf, sizeof(buf))) < 0 && errno == EINTR) {}
+    if (n <= 0) {
+        return false;
+    }
+    _buf.append(buf, n);
+    return true;
+}
+
+// Moves complete frames out of the buffer: events into _events and command
+// output into _output, up to the first reply. Returns true once a reply is
+// complete.
+bool SmashClient::parse() {
+    size_t pos = 0;
+    bool done = false;
+    while (!done) {
+        size_t eol = _buf.find('\n', pos);
+        if (eol == string::npos) {
+            break;
+        }
+        char kind = _buf[pos];
+        size_t len = strtoul(_buf.c_str() + pos + 1, nullptr, 10);
+        if (_buf.length() - eol - 1 < len) {
+            break;
+        }
+        string data = _buf.substr(eol + 1, len);
+        if (kind == SMASH_FRAME_OUTPUT) {
+            _output += data;
+        } else if (kind == SMASH_FRAME_EVENT) {
+            _events.push_back(data);
+        } else if (kind == SMASH_FRAME_REPLY) {
+            _prompt = data;
+            _reply.swap(_output);
+            _output.clear();
+            done = true;
+        }
+        pos = eol + 1 + len;
+    }
+    _buf.erase(0, pos);
+    return done;
+}
@@ -0,0 +1,37 @@
+#ifndef SMASH__CLIENT_H_
+#define SMASH__CLIENT_H_
+
+#include <string>
+#include <vector>
+
+// Client side of "smash --serve", see server.h for the protocol. Failures to
+// connect or to talk to the server throw std::system_error.
+class SmashClient {
+public:
+    explicit SmashClient(const std::string& path);
+    SmashClient(const SmashClient&)     = delete;
+    void operator=(const SmashClient&)  = delete;
+    ~SmashClient();
+
+    // Runs one command line and returns everything it printed.
+    std::string run(const std::string& line);
+    // Prompt of the session as of the last reply.
+    const std::string& prompt() const;
+    // Waits up to timeout_ms (-1 for ever) for a job event to arrive.
+    bool waitEvent(int timeout_ms);
+    // Returns and forgets the job events received so far.
+    std::vector<std::string> takeEvents();
+
+private:
+    bool receive(int timeout_ms);
+    bool parse();
+
+    int _fd;
+    std::string _buf;
+    std::string _output;
+    std::string _reply;
+    std::string _prompt;
+    std::vector<std::string> _events;
+};
+
+#endif //SMASH__CLIENT_H_
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <system_error>
+#include "jobtable.h"
+
+using namespace std;
+
+static const char *stateName(uint32_t state) {
+    switch (state) {
+    case JOB_RUNNING:
+        return "running";
+    case JOB_STOPPED:
+        return "stopped";
+    case JOB_QUEUED:
+        return "queued";
+    default:
+        return "done";
+    }
+}
+
+static void print(const JobTableHeader& header, const vector<JobTableEntry>& entries) {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    long long now_ms = now.tv_sec * 1000LL + now.tv_usec / 1000;
+    cout << "smash " << header.smash_pid << ": " << header.total << " jobs, updated "
+         << fixed << setprecision(1) << (now_ms - header.updated_ms) / 1000.0 << "s ago";
+    if (kill(header.smash_pid, 0) < 0 && errno == ESRCH) {
+        cout << " (smash is gone)";
+    }
+    if (header.total > header.count) {
+        cout << ", showing " << header.count;
+    }
+    cout << endl;
+    cout << "  JID      PID  STATE      TIME       CPU        RSS  COMMAND" << endl;
+    for (const JobTableEntry& entry : entries) {
+        cout << setw(5) << entry.jid << " " << setw(8) << entry.pid << "  "
+             << left << setw(8) << stateName(entry.state) << right
+             << setw(7) << (now.tv_sec - entry.start) << "s "
+             << setw(8) << setprecision(2) << (entry.utime_ms + entry.stime_ms) / 1000.0 << "s "
+             << setw(8) << entry.rss_kb << " KB  " << entry.cmd_line << endl;
+    }
+}
+
+// Shows the job table a "smash --export NAME" publishes, refreshed every
+// -d seconds, -n times (for ever by default).
+int main(int argc, char* argv[]) {
+    string name;
+    double delay = 1;
+    long count = -1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            delay = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else if (name.empty() && argv[i][0] != '-') {
+            name = argv[i];
+        } else {
+            name.clear();
+            break;
+        }
+    }
+    if (name.empty()) {
+        cerr << "usage: smash-top NAME [-d seconds] [-n count]" << endl;
+        return 1;
+    }
+
+    try {
+        JobTableReader reader(name);
+        JobTableHeader header;
+        vector<JobTableEntry> entries;
+        bool tty = isatty(STDOUT_FILENO);
+        for (long i = 0; count < 0 || i < count; ++i) {
+            if (i > 0) {
+                usleep(delay * 1000000);
+            }
+            reader.snapshot(header, entries);
+            if (tty) {
+                cout << "\033[H\033[2J";
+            }
+            print(header, entries);
+            cout << flush;
+        }
+    } catch (const system_error& e) {
+        cerr << "smash-top: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
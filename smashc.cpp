@@ -0,0 +1,29 @@
+#include <iostream>
+#include <string>
+#include <system_error>
+#include "smash_client.h"
+
+using namespace std;
+
+// Feeds stdin to a "smash --serve" session line by line and prints the
+// replies like an interactive smash would, with job events as they arrive.
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        cerr << "usage: smashc SOCKET" << endl;
+        return 1;
+    }
+    try {
+        SmashClient client(argv[1]);
+        string line;
+        while (cout << client.prompt() << flush, getline(cin, line)) {
+            cout << client.run(line) << flush;
+            for (const string& event : client.takeEvents()) {
+                cout << "smash: job " << event << endl;
+            }
+        }
+    } catch (const system_error& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+#! /bin/bash
+# Times the batched file builtins over many small files on each AsyncIo
+# engine. Run from the repository root after "make smash"; as root, COLD=1
+# drops the page cache before every run so the metadata has to be read back.
+SMASH=`pwd`/smash
+FILES=${FILES:-100000}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+
+mkdir $DIR/f
+(cd $DIR/f && seq -f "%06g" $FILES | xargs -n 1000 sh -c 'for f; do echo $f > $f; done' sh)
+
+run() {
+    if [ -n "$COLD" ]; then
+        sync
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+    local start=`date +%s%N`
+    printf '%s\nquit\n' "$2" | SMASH_IO=$3 $SMASH > $DIR/out 2>&1
+    local ms=$(( (`date +%s%N` - start) / 1000000 ))
+    printf '%-8s %-24s %6d ms  %s lines\n' "$3" "$1" $ms `wc -l < $DIR/out`
+}
+
+bench() {
+    for engine in uring threads serial; do
+        run "$1" "$2" $engine
+    done
+}
+
+bench "getfileinfo" "getfileinfo $DIR/f/*"
+bench "chmod" "chmod 644 $DIR/f/*"
+bench "touch" "touch $DIR/f/* 00:30:14:6:10:2022"
+bench "wc -c" "wc -c $DIR/f/*"
+rm -rf $DIR
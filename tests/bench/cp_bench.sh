@@ -0,0 +1,45 @@
+#! /bin/bash
+# Times copying a tree of many small files and a few huge files with the cp
+# builtin, on its thread pool and with SMASH_IO=serial, against coreutils cp.
+# Each is run REPEAT times and the best time is printed. Run from the
+# repository root after "make smash".
+SMASH=`pwd`/smash
+SMALL=${SMALL:-20000}
+HUGE=${HUGE:-4}
+HUGE_MB=${HUGE_MB:-256}
+REPEAT=${REPEAT:-3}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+
+mkdir -p $DIR/small $DIR/huge
+for ((d = 0; d < 100; d++)); do
+    mkdir $DIR/small/d$d
+done
+head -c 4096 /dev/urandom > $DIR/block
+for ((i = 0; i < SMALL; i++)); do
+    cp $DIR/block $DIR/small/d$((i % 100))/f$i
+done
+for ((i = 0; i < HUGE; i++)); do
+    head -c ${HUGE_MB}M /dev/urandom > $DIR/huge/f$i
+done
+
+run() {
+    local best=0
+    for ((r = 0; r < REPEAT; r++)); do
+        rm -rf $DIR/copy
+        sync
+        local start=`date +%s%N`
+        "${@:2}" > /dev/null 2>&1
+        local us=$(( (`date +%s%N` - start) / 1000 ))
+        if [ $best = 0 ] || [ $us -lt $best ]; then
+            best=$us
+        fi
+    done
+    awk -v name="$1" -v us=$best 'BEGIN { printf "%-40s %10.1f ms\n", name, us / 1000 }'
+}
+
+for set in small huge; do
+    run "$set: coreutils cp -r" `command -v cp` -r $DIR/$set $DIR/copy
+    run "$set: smash cp -r" $SMASH -c "cp -r $DIR/$set $DIR/copy"
+    run "$set: smash cp -r, SMASH_IO=serial" env SMASH_IO=serial $SMASH -c "cp -r $DIR/$set $DIR/copy"
+done
+rm -rf $DIR
@@ -0,0 +1,29 @@
+#! /bin/bash
+# Compares smash's native fan-out redirection ("cmd |> a b c") against piping
+# through an external tee. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+SIZE_MB=${SIZE_MB:-512}
+RUNS=${RUNS:-3}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+
+head -c ${SIZE_MB}M /dev/urandom > $DIR/input
+
+run() {
+    local best=
+    for ((i = 0; i < RUNS; i++)); do
+        rm -f $DIR/a $DIR/b $DIR/c
+        local start=`date +%s%N`
+        printf '%s\nquit\n' "$1" | $SMASH > /dev/null
+        local ms=$(( (`date +%s%N` - start) / 1000000 ))
+        if [ -z "$best" ] || [ $ms -lt $best ]; then
+            best=$ms
+        fi
+    done
+    printf '%-10s %6d ms  %6d MB/s\n' "$2" $best $(( SIZE_MB * 1000 / (best > 0 ? best : 1) ))
+}
+
+echo "fan-out of ${SIZE_MB}MB to 3 files, best of $RUNS"
+run "cat $DIR/input |> $DIR/a $DIR/b $DIR/c" "|>"
+run "cat $DIR/input | tee $DIR/a $DIR/b > $DIR/c" "| tee"
+cmp -s $DIR/input $DIR/c || echo "output mismatch"
+rm -rf $DIR
@@ -0,0 +1,48 @@
+// Times a builtin and an external command run through an engine against the
+// same lines through popen("smash -c ..."); built and run by
+// libsmash_bench.sh.
+#include <iostream>
+#include <string>
+#include <stdio.h>
+#include <time.h>
+#include "libsmash.h"
+
+using namespace std;
+
+static long nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void report(const string& name, long ns, int runs) {
+    printf("%-28s %8.1f us/run\n", name.c_str(), ns / 1000.0 / runs);
+}
+
+int main(int argc, char *argv[]) {
+    string smash = argv[1];
+    int runs = stoi(argv[2]);
+    size_t bytes = 0;
+    SmashOutput output;
+    output.out_fd = output.err_fd = -1;
+    output.on_out = [&](const char *, size_t len) { bytes += len; };
+    SmashEngine engine(output);
+
+    for (string line : {"pwd", "true"}) {
+        long start = nanos();
+        for (int i = 0; i < runs; i++) {
+            FILE *f = popen((smash + " -c " + line).c_str(), "r");
+            char buf[4096];
+            while (fread(buf, 1, sizeof(buf), f) > 0) {
+            }
+            pclose(f);
+        }
+        report("popen smash -c " + line, nanos() - start, runs);
+        start = nanos();
+        for (int i = 0; i < runs; i++) {
+            engine.run(line);
+        }
+        report("engine " + line, nanos() - start, runs);
+    }
+    return bytes ? 0 : 1;
+}
@@ -0,0 +1,10 @@
+#! /bin/bash
+# Times command lines run in-process through libsmash against popen of
+# "smash -c". Run from the repository root after "make smash libsmash.a".
+COMPILER=${COMPILER:-g++}
+RUNS=${RUNS:-2000}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+
+$COMPILER --std=c++11 -O2 -pthread -I. tests/bench/libsmash_bench.cpp libsmash.a \
+    -o $DIR/libsmash_bench && $DIR/libsmash_bench `pwd`/smash $RUNS
+rm -rf $DIR
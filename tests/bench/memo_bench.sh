@@ -0,0 +1,37 @@
+#! /bin/bash
+# Times a checksum of a large file run plainly, through memo the first time
+# and replayed from the cache, and JOBS identical background memos against as
+# many plain background runs. Run from the repository root after
+# "make smash".
+SMASH=`pwd`/smash
+SIZE_MB=${SIZE_MB:-256}
+JOBS=${JOBS:-8}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+export SMASH_MEMO_DIR=$DIR/cache
+
+head -c ${SIZE_MB}M /dev/urandom > $DIR/data
+LINE="sha256sum $DIR/data"
+
+run() {
+    local start=`date +%s%N`
+    "${@:2}" > /dev/null 2>&1
+    local us=$(( (`date +%s%N` - start) / 1000 ))
+    awk -v name="$1" -v us=$us 'BEGIN { printf "%-34s %10.1f ms\n", name, us / 1000 }'
+}
+
+repeated() {
+    for ((i = 0; i < JOBS; i++)); do
+        echo "$1&"
+    done
+    printf 'wait\nquit\n'
+}
+
+run "plain" $SMASH -c "$LINE"
+run "memo, first run" $SMASH -c "memo -i $DIR/data $LINE"
+run "memo, replayed" $SMASH -c "memo -i $DIR/data $LINE"
+touch $DIR/data
+repeated "$LINE" > $DIR/plain.txt
+repeated "memo -i $DIR/data $LINE" > $DIR/memo.txt
+run "$JOBS plain jobs" $SMASH --script $DIR/plain.txt
+run "$JOBS memo jobs, single flight" $SMASH --script $DIR/memo.txt
+rm -rf $DIR
@@ -0,0 +1,31 @@
+#! /bin/bash
+# Times "smash -c" one-shot invocations against "sh -c" and "bash -c", for an
+# external command (exec'd in place), a builtin and a pipeline, and against
+# feeding the same line to an interactive smash. Run from the repository root
+# after "make smash".
+SMASH=`pwd`/smash
+RUNS=${RUNS:-500}
+
+run() {
+    local start=`date +%s%N`
+    for ((i = 0; i < RUNS; i++)); do
+        "${@:2}" > /dev/null 2>&1
+    done
+    local us=$(( (`date +%s%N` - start) / 1000 ))
+    awk -v name="$1" -v us=$us -v runs=$RUNS 'BEGIN { printf "%-28s %8.1f us/run\n", name, us / runs }'
+}
+
+stdin_smash() {
+    printf '%s\nquit\n' "$1" | $SMASH
+}
+
+run "sh -c true" sh -c true
+run "bash -c true" bash -c true
+run "smash -c true" $SMASH -c true
+run "smash < true" stdin_smash true
+run "sh -c pwd" sh -c pwd
+run "bash -c pwd" bash -c pwd
+run "smash -c pwd" $SMASH -c pwd
+run "sh -c 'echo a | cat'" sh -c "echo a | cat"
+run "bash -c 'echo a | cat'" bash -c "echo a | cat"
+run "smash -c 'echo a | cat'" $SMASH -c "echo a | cat"
@@ -0,0 +1,36 @@
+#! /bin/bash
+# Times the pgrep builtin against the procps pgrep with PROCS extra processes
+# running, matching by name, by command line and by user. Run from the
+# repository root after "make smash".
+SMASH=`pwd`/smash
+PROCS=${PROCS:-5000}
+RUNS=${RUNS:-20}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+
+cp `command -v sleep` $DIR/pgbench_sleep
+for ((i = 0; i < PROCS; i++)); do
+    $DIR/pgbench_sleep 600 &
+done
+sleep 1
+
+run() {
+    local start=`date +%s%N`
+    for ((i = 0; i < RUNS; i++)); do
+        "${@:2}" > /dev/null 2>&1
+    done
+    local us=$(( (`date +%s%N` - start) / 1000 ))
+    awk -v name="$1" -v us=$us -v runs=$RUNS 'BEGIN { printf "%-32s %8.1f us/run\n", name, us / runs }'
+}
+
+echo "`ls /proc | grep -c '^[0-9]'` processes"
+run "pgrep pgbench" pgrep pgbench
+run "smash -c 'pgrep pgbench'" $SMASH -c "pgrep pgbench"
+run "pgrep -f pgbench_sleep.600" pgrep -f pgbench_sleep.600
+run "smash -c 'pgrep -f ...'" $SMASH -c "pgrep -f pgbench_sleep.600"
+run "pgrep -u `id -un` pgbench" pgrep -u `id -un` pgbench
+run "smash -c 'pgrep -u ...'" $SMASH -c "pgrep -u `id -un` pgbench"
+
+# SIGTERM, which bash does not report the way it reports SIGKILL
+pkill -f $DIR/pgbench_sleep
+wait
+rm -rf $DIR
@@ -0,0 +1,32 @@
+#! /bin/bash
+# Times a large script fed on stdin against script mode, with the plan compiled
+# on the first run and mapped from the cache on the next. The script only
+# runs builtins, so the time goes to the smash itself rather than to the
+# processes it starts. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+LINES=${LINES:-200000}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+
+printf '%s\n' "jobs" "showpid" "pwd" "chprompt bench" "cd $DIR" "chprompt" "" "cd -" \
+    "getfileinfo $DIR" "jobs -v" |
+    awk -v lines=$LINES '{ body[n++] = $0 } END { for (i = 0; i < lines; i++) print body[i % n] }' \
+    > $DIR/script.txt
+echo "quit" >> $DIR/script.txt
+
+run() {
+    local start=`date +%s%N`
+    $SMASH "${@:3}" > /dev/null 2>&1
+    local us=$(( (`date +%s%N` - start) / 1000 ))
+    awk -v name="$1" -v us=$us -v lines=$2 \
+        'BEGIN { printf "%-26s %8d ms %8.2f us/line\n", name, us / 1000, us / lines }'
+}
+
+# startup alone: an empty script
+printf 'quit\n' > $DIR/empty.txt
+run "startup, stdin" 1 < $DIR/empty.txt
+run "startup, plan" 1 --script $DIR/empty.txt
+run "stdin" $LINES < $DIR/script.txt
+rm -f $DIR/script.txt.plan
+run "script, compiling the plan" $LINES --script $DIR/script.txt
+run "script, cached plan" $LINES --script $DIR/script.txt
+rm -rf $DIR
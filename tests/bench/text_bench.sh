@@ -0,0 +1,47 @@
+#! /bin/bash
+# Times the in-process text builtins on each kernel version against the
+# coreutils binaries, which the smash runs when they are named by full path.
+# Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+MB=${MB:-200}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+CAT=`command -v cat`
+WC=`command -v wc`
+GREP=`command -v grep`
+HEAD=`command -v head`
+
+# words of a few letters, one line in 500 holds the needle
+awk -v mb=$MB 'BEGIN {
+    srand(1); size = 0;
+    while (size < mb * 1048576) {
+        line = "";
+        for (w = int(rand() * 12); w > 0; w--) {
+            line = line substr("abcdefghijklmnopqrstuvwxyz", int(rand() * 20) + 1, int(rand() * 6) + 1) " ";
+        }
+        if (rand() < 0.002) line = line "needle";
+        print line; size += length(line) + 1;
+    }
+}' > $DIR/data
+
+run() {
+    local start=`date +%s%N`
+    local out=`printf '%s\nquit\n' "$2" | SMASH_SIMD=$3 $SMASH | sed -n '1s/^smash> //p' | sed 's| /.*||'`
+    local ms=$(( (`date +%s%N` - start) / 1000000 ))
+    printf '%-10s %-30s %6d ms  %s\n' "$3" "$1" $ms "$out"
+}
+
+bench() {
+    for kernel in avx2 sse2 scalar; do
+        run "$1" "$2" $kernel
+    done
+    run "$1" "$3" coreutils
+}
+
+bench "wc -l" "wc -l $DIR/data" "$WC -l $DIR/data"
+bench "wc" "wc $DIR/data" "$WC $DIR/data"
+bench "grep -F -c needle" "grep -F -c needle $DIR/data" "$GREP -F -c needle $DIR/data"
+bench "cat | grep -F needle | wc -l" "cat $DIR/data | grep -F needle | wc -l" \
+      "$CAT $DIR/data | $GREP -F needle | $WC -l"
+bench "head -n 1000000 | wc -w" "head -n 1000000 $DIR/data | wc -w" \
+      "$HEAD -n 1000000 $DIR/data | $WC -w"
+rm -rf $DIR
@@ -0,0 +1,22 @@
+#! /bin/bash
+# Feeds a million paths through the xargs builtin, which packs them up to
+# ARG_MAX per exec, and compares that with one exec per item on a smaller
+# input. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+ITEMS=${ITEMS:-1000000}
+DIR=`mktemp -d /tmp/smash_bench.XXXXXX`
+
+seq -f "$DIR/some/fairly/long/directory/file%07g.txt" $ITEMS > $DIR/items
+head -n 10000 $DIR/items > $DIR/items10k
+
+run() {
+    local start=`date +%s%N`
+    local lines=`printf '%s\nquit\n' "$1" | $SMASH | grep -c "$DIR"`
+    local ms=$(( (`date +%s%N` - start) / 1000000 ))
+    printf '%-28s %7d items %6d execs %7d ms\n' "$2" $3 $lines $ms
+}
+
+run "cat $DIR/items | xargs echo" "xargs (packed)" $ITEMS
+run "cat $DIR/items | xargs -P 4 echo" "xargs -P 4 (packed)" $ITEMS
+run "cat $DIR/items10k | xargs -n 1 echo" "xargs -n 1" 10000
+rm -rf $DIR
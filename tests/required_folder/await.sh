@@ -0,0 +1,4 @@
+# waits until the file named by $1 exists
+while [ ! -e "$1" ]; do
+    sleep 0.01
+done
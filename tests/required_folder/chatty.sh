@@ -0,0 +1,11 @@
+for i in 1 2 3 4 5; do
+    echo line $i
+done
+echo oops >&2
+# tell the test the output is there, and go on once it has been read
+touch ${1:-chatty}.ready
+while [ -e ${1:-chatty}.ready ]; do
+    sleep 0.01
+done
+sleep 1
+echo done
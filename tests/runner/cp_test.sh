@@ -0,0 +1,68 @@
+#! /bin/bash
+# Checks the cp builtin: copies of files and trees match their sources in
+# contents, modes and links, with every I/O engine, and errors leave the
+# exit status at 1. A plain cp is left to the binary. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_cp.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+# mode, type, file size and link target of everything in a tree
+listing() {
+    (cd $1 && find . \( -type f -printf '%m %y %s %p\n' \) -o -printf '%m %y %p %l\n' | sort)
+}
+
+mkdir -p $DIR/src/a/b $DIR/src/readonly $DIR/src/empty
+for i in `seq 1 300`; do
+    echo "file $i" > $DIR/src/a/f$i
+done
+head -c 3000000 /dev/urandom > $DIR/src/a/b/big
+: > $DIR/src/zero
+echo x > $DIR/src/readonly/inside
+chmod 751 $DIR/src/a/f1
+chmod 4755 $DIR/src/a/f2
+chmod 600 $DIR/src/a/b/big
+chmod 555 $DIR/src/readonly
+ln -s a/f3 $DIR/src/link
+ln -s /no/such/target $DIR/src/dangling
+
+cd $DIR
+for engine in uring threads serial; do
+    SMASH_IO=$engine $SMASH -c "cp -r src $engine" || fail "$engine: cp -r failed"
+    [ "`listing src`" = "`listing $engine`" ] || fail "$engine: the tree differs"
+    cmp -s src/a/b/big $engine/a/b/big || fail "$engine: the big file differs"
+done
+
+# into an existing directory, several sources at once
+mkdir into
+$SMASH -c "cp -r src/a/f1 src/zero into" || fail "cp into a directory failed"
+[ "`cat into/f1`" = "file 1" ] && [ -f into/zero ] || fail "cp into a directory"
+[ "`stat -c %a into/f1`" = 751 ] || fail "the mode was not preserved"
+$SMASH -c "cp -r src into" && [ "`listing src`" = "`listing into/src`" ] ||
+    fail "cp -r into a directory"
+$SMASH -c "cp -r src/a/f1* into" && [ -f into/f199 ] || fail "a wildcard was not expanded"
+$SMASH -c "cp -r src/a/f4 copy" && [ "`cat copy`" = "file 4" ] || fail "cp to a new name"
+$SMASH -c "cp -r src/a/f5 copy" && [ "`cat copy`" = "file 5" ] || fail "cp over a file"
+$SMASH -c "cp src/a/f6 plain" && [ "`cat plain`" = "file 6" ] || fail "a plain cp"
+
+# errors
+$SMASH -c "cp -r no_such_file x" 2> /dev/null
+[ $? = 1 ] || fail "a missing source did not fail"
+$SMASH -c "cp src x" 2> /dev/null
+[ $? = 1 ] && [ ! -e x ] || fail "a directory was copied without -r"
+$SMASH -c "cp -r src src/a" 2> /dev/null
+[ $? = 1 ] && [ ! -e src/a/src ] || fail "a directory was copied into itself"
+$SMASH -c "cp -r src/a/f1 src/zero copy" 2> /dev/null
+[ $? = 1 ] || fail "several sources to a file did not fail"
+
+chmod -R u+w $DIR
+cd - > /dev/null
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "cp test passed"
+fi
+exit $STATUS
@@ -0,0 +1,48 @@
+#! /bin/bash
+# Checks "smash --export": smash-top sees running, stopped and queued jobs,
+# snapshots stay consistent while the smash churns through jobs, and the
+# segment goes away with the smash. Run from the repository root after
+# "make smash smash-top".
+SMASH=`pwd`/smash
+TOP=`pwd`/smash-top
+NAME=smash_export_test.$$
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+(printf 'sleep 5&\nsleep 5&\nkill -19 2\nsubmit -j 1 sleep 1\n'; sleep 2; printf 'quit kill\n') \
+    | $SMASH --export $NAME > /dev/null &
+sleep 0.5
+OUT=`$TOP $NAME -n 1`
+echo "$OUT" | grep -q "^smash [0-9]*: 3 jobs" || fail "wrong job count"
+echo "$OUT" | grep -q "^ *1 *[0-9]* *running .* sleep 5&$" || fail "running job missing"
+echo "$OUT" | grep -q "^ *2 *[0-9]* *stopped .* sleep 5&$" || fail "stopped job missing"
+echo "$OUT" | grep -q "^ *3 *0 *queued .* sleep 1&$" || fail "queued job missing"
+wait
+$TOP $NAME -n 1 > /dev/null 2>&1 && fail "segment left behind after quit"
+
+# a reader polling as fast as it can while jobs come and go
+(for i in `seq 300`; do echo "sleep 0.0$((i % 10))&"; done; sleep 0.5; echo quit) \
+    | $SMASH --export $NAME > /dev/null &
+sleep 0.1
+$TOP $NAME -d 0 -n 2000 2>/dev/null | awk '
+    /^smash/ { if (seen != want) bad++; want = $3; seen = 0; last = 0; next }
+    /^ *[0-9]+ / { seen++; if ($1 <= last) bad++; last = $1 }
+    END { if (seen != want) bad++; exit bad != 0 }' || fail "torn snapshot"
+wait
+
+(printf 'sleep 5&\n'; sleep 3) | $SMASH --export $NAME > /dev/null &
+SMASH_PID=$!
+sleep 0.3
+{ kill -9 $SMASH_PID; wait $SMASH_PID; } 2> /dev/null
+$TOP $NAME -n 1 | grep -q "(smash is gone)" || fail "dead smash not detected"
+rm -f /dev/shm/$NAME
+pkill -x -f "sleep 5"
+
+if [ $STATUS -eq 0 ]; then
+    echo "export test passed"
+fi
+exit $STATUS
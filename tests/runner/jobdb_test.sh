@@ -0,0 +1,43 @@
+#! /bin/bash
+# Checks "smash --jobdb": a smash that is killed leaves its jobs behind, the
+# next one re-adopts them, and reopening a journal with 10k entries stays
+# fast. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_jobdb.XXXXXX`
+DB=$DIR/jobs.db
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+(printf 'sleep 30&\nsleep 0.1&\n'; sleep 5) | $SMASH --jobdb $DB > /dev/null &
+sleep 0.5
+SMASH_PID=`pgrep -n -x smash`
+kill -9 $SMASH_PID
+sleep 0.2
+
+OUT=`printf 'jobs\nkill -9 1\nsleep 0.1\njobs\nquit\n' | $SMASH --jobdb $DB`
+echo "$OUT" | grep -q "\[1\] sleep 30& : [0-9]* [0-9]* secs$" || fail "running job was not re-adopted"
+echo "$OUT" | grep -q "sleep 0.1&" && fail "finished job was re-adopted"
+echo "$OUT" | grep -q "signal number 9 was sent" || fail "adopted job could not be killed"
+[ `echo "$OUT" | grep -c "sleep 30&"` -eq 1 ] || fail "killed adopted job is still listed"
+
+# 10k journal entries of jobs that are long gone
+python3 - $DB <<'PY'
+import struct, sys
+with open(sys.argv[1], "wb") as db:
+    for i in range(10000):
+        db.write(struct.pack("<IIiiQ200s", 0x4a424f53, 1, i + 1, 4000000 + i, 1, b"sleep 1000&"))
+PY
+START=`date +%s%N`
+printf 'jobs\nquit\n' | $SMASH --jobdb $DB > $DIR/big.out
+ELAPSED=$(( (`date +%s%N` - START) / 1000000 ))
+grep -q "sleep 1000&" $DIR/big.out && fail "dead jobs were re-adopted"
+[ $ELAPSED -lt 500 ] || fail "restart with 10k entries took ${ELAPSED}ms"
+[ `stat -c %s $DB` -lt 100000 ] || fail "journal was not compacted"
+
+[ $STATUS -eq 0 ] && echo "jobdb test passed (10k-entry restart: ${ELAPSED}ms)"
+rm -rf $DIR
+exit $STATUS
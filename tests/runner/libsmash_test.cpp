@@ -0,0 +1,145 @@
+// Drives two SmashEngines side by side through libsmash.a; built and run by
+// libsmash_test.sh.
+#include <iostream>
+#include <string>
+#include <climits>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "libsmash.h"
+
+using namespace std;
+
+static int failures = 0;
+static pid_t host_pid;
+static string atexit_log;
+
+// a child of the engine that ran it would hand the host's cleanup a copy of
+// the host's state
+static void onExit() {
+    if (getpid() != host_pid) {
+        FILE *log = fopen(atexit_log.c_str(), "a");
+        if (log) {
+            fprintf(log, "%d\n", getpid());
+            fclose(log);
+        }
+    }
+}
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+struct Collected {
+    string out;
+    string err;
+    SmashOutput output;
+
+    Collected() {
+        output.out_fd = output.err_fd = -1;
+        output.on_out = [this](const char *data, size_t len) { out.append(data, len); };
+        output.on_err = [this](const char *data, size_t len) { err.append(data, len); };
+    }
+    void clear() {
+        out.clear();
+        err.clear();
+    }
+};
+
+int main(int argc, char *argv[]) {
+    string dir = argv[1];
+    char cwd[PATH_MAX];
+    getcwd(cwd, sizeof(cwd));
+    host_pid = getpid();
+    atexit_log = dir + "/atexit.log";
+    atexit(onExit);
+
+    Collected a_io, b_io;
+    SmashEngine a(a_io.output), b(b_io.output);
+
+    // each engine has its own prompt and working directory, the caller's
+    // stays where it was
+    a.run("chprompt alpha");
+    check(a.prompt() == "alpha> ", "chprompt did not change the prompt");
+    check(b.prompt() == "smash> ", "chprompt leaked into the other engine");
+    a.run("cd " + dir);
+    a.run("pwd");
+    b.run("pwd");
+    check(a_io.out == dir + "\n", "cd did not stick: " + a_io.out);
+    check(b_io.out == string(cwd) + "\n", "cd leaked into the other engine: " + b_io.out);
+    char now[PATH_MAX];
+    check(getcwd(now, sizeof(now)) && string(now) == cwd, "cd changed the caller's directory");
+
+    // while a call runs, the caller's other threads keep their fds and
+    // working directory
+    struct stat out_before, out_during;
+    fstat(STDOUT_FILENO, &out_before);
+    thread caller([&a] { a.run("sleep 0.5"); });
+    usleep(200000);
+    fstat(STDOUT_FILENO, &out_during);
+    check(getcwd(now, sizeof(now)) && string(now) == cwd, "a call changed another thread's directory");
+    check(out_during.st_ino == out_before.st_ino && out_during.st_dev == out_before.st_dev,
+          "a call redirected another thread's stdout");
+    caller.join();
+
+    // builtins run in the caller's process
+    a_io.clear();
+    a.run("showpid");
+    check(a_io.out == "smash pid is " + to_string(getpid()) + "\n", "showpid: " + a_io.out);
+
+    // exit statuses, and output of what the engine forks
+    a_io.clear();
+    SmashResult result = a.run("echo hello");
+    check(result.status == 0 && result.jid == -1 && a_io.out == "hello\n", "echo: " + a_io.out);
+    check(a.run("sh exit3.sh").status == 3, "an external command's status was lost");
+    check(a.run("echo a | false").status == 1, "a pipeline's status was lost");
+    check(a.run("").status == 0, "an empty line failed");
+    a_io.clear();
+    check(a.run("kill").status == 1, "a failing builtin succeeded");
+    check(a_io.err == "smash error: kill: invalid arguments\n", "kill: " + a_io.err);
+
+    // background jobs belong to their engine
+    SmashResult sleeper = a.run("sleep 0.2&");
+    check(sleeper.status == 0 && sleeper.jid == 1, "a background line got no job id");
+    result = a.run("sh exit3.sh&");
+    check(result.jid == 2, "the second job got id " + to_string(result.jid));
+    b_io.clear();
+    b.run("jobs");
+    check(b_io.out.empty(), "jobs leaked into the other engine: " + b_io.out);
+    check(a.wait(sleeper.jid) == 0, "wait did not return the job's status");
+    check(a.wait(sleeper.jid) == -1, "a job was waited for twice");
+    vector<pair<int, int>> finished;
+    for (int i = 0; i < 100 && finished.empty(); i++) {
+        finished = a.poll();
+        usleep(10000);
+    }
+    check(finished.size() == 1 && finished[0] == make_pair(2, 3), "poll did not report the job");
+
+    // the engine leaves the caller's own children alone
+    pid_t child = fork();
+    if (child == 0) {
+        _exit(7);
+    }
+    usleep(50000);
+    a.run("pwd");
+    a.poll();
+    int status = 0;
+    check(waitpid(child, &status, 0) == child && WEXITSTATUS(status) == 7,
+          "the engine reaped a child of the caller");
+
+    // forked children leave the host's atexit handlers alone
+    a.run("showpid | cat");
+    a.run("showpid > showpid.out");
+    a.run("nosuchcommand | cat");
+    check(access(atexit_log.c_str(), F_OK) != 0, "a child ran the host's atexit handler");
+
+    check(a.run("quit").quit, "quit was not reported");
+    b.run("sleep 30&");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+#! /bin/bash
+# Checks the embeddable engine: builds tests/runner/libsmash_test.cpp against
+# libsmash.a and runs it. Run from the repository root after
+# "make libsmash.a".
+COMPILER=${COMPILER:-g++}
+DIR=`mktemp -d /tmp/smash_libsmash.XXXXXX`
+DIR=`cd $DIR && pwd -P`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+$COMPILER --std=c++11 -Wall -pthread -I. tests/runner/libsmash_test.cpp libsmash.a \
+    -o $DIR/libsmash_test || fail "the test did not build"
+printf 'exit 3\n' > $DIR/exit3.sh
+if [ $STATUS -eq 0 ]; then
+    $DIR/libsmash_test $DIR || fail "the engines misbehaved"
+fi
+# the engine that was destroyed with a job left killed it
+pgrep -f "^sleep 30$" > /dev/null && fail "a destroyed engine left its job running"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "libsmash test passed"
+fi
+exit $STATUS
@@ -0,0 +1,72 @@
+#! /bin/bash
+# Checks memo: a repeated command line replays its stdout and exit status, the
+# key follows the working directory, -e variables and -i files, and
+# identical memos running at once do the work only once. Run from the
+# repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_memo.XXXXXX`
+export SMASH_MEMO_DIR=$DIR/cache
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+# counts its runs, takes a while and fails with 3
+printf 'echo run >> %s/runs\nsleep 0.3\necho out $1 $FOO\nexit 3\n' $DIR > $DIR/work.sh
+runs() {
+    cat $DIR/runs 2> /dev/null | wc -l
+}
+memo() {
+    (cd ${CWD:-$DIR} && $SMASH -c "memo $1")
+}
+
+[ "`memo "sh $DIR/work.sh a"`" = "out a" ] || fail "the first run printed the wrong output"
+memo "sh $DIR/work.sh a" > $DIR/out
+[ $? = 3 ] || fail "the exit status was not replayed"
+[ "`cat $DIR/out`" = "out a" ] || fail "the output was not replayed"
+[ `runs` = 1 ] || fail "the command ran again"
+START=`date +%s%N`
+memo "sh $DIR/work.sh a" > /dev/null
+MS=$(( (`date +%s%N` - START) / 1000000 ))
+[ $MS -lt 200 ] || fail "a replay took $MS ms"
+
+# what goes into the key
+memo "sh $DIR/work.sh b" > /dev/null
+[ `runs` = 2 ] || fail "other arguments replayed a cached result"
+CWD=/ memo "sh $DIR/work.sh a" > /dev/null
+[ `runs` = 3 ] || fail "another directory replayed a cached result"
+[ "`FOO=1 memo "-e FOO sh $DIR/work.sh a"`" = "out a 1" ] || fail "-e did not run the command"
+[ "`FOO=2 memo "-e FOO sh $DIR/work.sh a"`" = "out a 2" ] || fail "-e ignored the variable"
+[ "`FOO=2 memo "-e FOO sh $DIR/work.sh a"`" = "out a 2" ] || fail "-e did not replay"
+[ `runs` = 5 ] || fail "-e: `runs` runs instead of 5"
+echo 1 > $DIR/input
+memo "-i $DIR/input sh $DIR/work.sh a" > /dev/null
+memo "-i $DIR/input sh $DIR/work.sh a" > /dev/null
+[ `runs` = 6 ] || fail "-i did not replay"
+touch -d "1 minute ago" $DIR/input
+memo "-i $DIR/input sh $DIR/work.sh a" > /dev/null
+[ `runs` = 7 ] || fail "-i ignored the file's mtime"
+[ "`memo "echo a b | wc -w"`" = "2" ] || fail "a memoized pipeline"
+
+# single flight: memos of one line at once, from one smash and from several
+OUT=`printf '%s\n' "memo sh $DIR/work.sh c&" "memo sh $DIR/work.sh c&" "memo sh $DIR/work.sh c&" \
+    "wait" "quit" | $SMASH 2>&1`
+[ `runs` = 8 ] || fail "background memos ran the command `expr \`runs\` - 7` times"
+[ `echo "$OUT" | grep -c "out c"` = 3 ] || fail "background memos did not all print the output"
+[ `echo "$OUT" | grep -c "exited with status 3"` = 3 ] || fail "background memos lost the status"
+for i in 1 2 3 4; do
+    memo "sh $DIR/work.sh d" > $DIR/out.$i &
+done
+wait
+[ `runs` = 9 ] || fail "concurrent smashes ran the command `expr \`runs\` - 8` times"
+[ "`cat $DIR/out.*`" = "`printf 'out d\nout d\nout d\nout d'`" ] ||
+    fail "concurrent smashes did not all print the output"
+[ -z "`ls $DIR/cache | grep -v '\.memo$'`" ] || fail "the cache holds more than its entries"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "memo test passed"
+fi
+exit $STATUS
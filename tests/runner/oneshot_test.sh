@@ -0,0 +1,48 @@
+#! /bin/bash
+# Checks "smash -c": no prompt, the exit status of the line, and an external
+# command exec'd in place of the smash. Run from the repository root after
+# "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_oneshot.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+status() {
+    $SMASH -c "$1" > /dev/null 2>&1
+    [ $? = $2 ] || fail "\"$1\" did not exit with $2"
+}
+
+[ "`$SMASH -c pwd`" = "`pwd`" ] || fail "pwd printed more than the directory"
+[ "`$SMASH -c 'echo a | cat'`" = "a" ] || fail "a pipeline printed more than its output"
+printf 'exit 3\n' > $DIR/exit3.sh
+status "true" 0
+status "false" 1
+status "sh $DIR/exit3.sh" 3
+status "echo a | false" 1
+status "false | cat" 0
+status "sh $DIR/exit3.sh > $DIR/out" 3
+status "kill" 1
+status "no_such_command" 1
+status "cat $DIR/no_such_file" 1
+status "grep -F zzz $DIR/exit3.sh" 1
+status "grep -F exit $DIR/exit3.sh" 0
+status "" 0
+[ "`$SMASH -c kill 2>&1`" = "smash error: kill: invalid arguments" ] ||
+    fail "a builtin's error was not reported"
+
+# the external command takes over the smash's pid
+printf 'echo $$\n' > $DIR/pid.sh
+$SMASH -c "sh $DIR/pid.sh" > $DIR/pid &
+PID=$!
+wait
+[ "`cat $DIR/pid`" = "$PID" ] || fail "the command was not exec'd in place"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "oneshot test passed"
+fi
+exit $STATUS
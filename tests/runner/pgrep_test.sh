@@ -0,0 +1,52 @@
+#! /bin/bash
+# Checks pgrep and pkill: matching by name, command line, user and parent,
+# the exit status, and that pkill only signals what matched. Run from the
+# repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_pgrep.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+# processes with a name nothing else on the host has
+cp `command -v sleep` $DIR/pgtest_sleeper
+$DIR/pgtest_sleeper 1000 &
+FIRST=$!
+$DIR/pgtest_sleeper 1001 &
+SECOND=$!
+sleep 0.1
+BOTH=`printf '%s\n' $FIRST $SECOND | sort -n`
+
+[ "`$SMASH -c 'pgrep ^pgtest_sleeper$'`" = "$BOTH" ] || fail "pgrep by name"
+[ "`$SMASH -c 'pgrep -l pgtest'`" = "`echo "$BOTH" | sed 's/$/ pgtest_sleeper/'`" ] ||
+    fail "pgrep -l does not print the name"
+[ "`$SMASH -c 'pgrep -f pgtest_sleeper.1001'`" = "$SECOND" ] || fail "pgrep -f"
+[ "`$SMASH -c 'pgrep -f -l pgtest_sleeper.1001'`" = "$SECOND $DIR/pgtest_sleeper 1001" ] ||
+    fail "pgrep -f -l does not print the command line"
+[ "`$SMASH -c "pgrep -P $$ pgtest"`" = "$BOTH" ] || fail "pgrep -P"
+[ -z "`$SMASH -c 'pgrep -P 1 pgtest'`" ] || fail "pgrep -P matched another parent's children"
+[ "`$SMASH -c "pgrep -u \`id -un\` pgtest"`" = "$BOTH" ] || fail "pgrep -u by name"
+[ "`$SMASH -c "pgrep -u \`id -u\` pgtest"`" = "$BOTH" ] || fail "pgrep -u by uid"
+$SMASH -c "pgrep no_such_process_name"
+[ $? = 1 ] || fail "pgrep without a match did not exit with 1"
+[ -z "`$SMASH -c 'pgrep smash'`" ] || fail "pgrep matched itself"
+
+# pkill signals only what matched, with SIGTERM unless told otherwise
+$SMASH -c "pkill -f pgtest_sleeper.1001" || fail "pkill did not succeed"
+wait $SECOND
+[ $? = 143 ] || fail "pkill did not send SIGTERM"
+kill -0 $FIRST 2> /dev/null || fail "pkill killed a process that did not match"
+# (bash would report the SIGKILL on stderr)
+{ $SMASH -c "pkill -9 ^pgtest_sleeper$"; wait $FIRST; } 2> /dev/null
+[ $? = 137 ] || fail "pkill -9 did not send SIGKILL"
+$SMASH -c "pkill ^pgtest_sleeper$"
+[ $? = 1 ] || fail "pkill without a match did not exit with 1"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "pgrep test passed"
+fi
+exit $STATUS
@@ -0,0 +1,44 @@
+#! /bin/bash
+# Checks the pipeline telemetry: pipestat names the stage that holds the
+# others up, the adaptive policy grows a busy pipe, and a static size is
+# applied to new pipes. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_pipestat.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+head -c 400000000 /dev/zero > $DIR/zero
+
+OUT=`printf '%s\n' "yes | sleep 4&" "sleep 5 | wc -c&" "/bin/cat $DIR/zero | sha256sum&" \
+    "sleep 1.5" "pipestat" "jobs -v" "pipestat -p 512K" "yes | sleep 3&" "sleep 1" "pipestat 4" \
+    "quit kill" | $SMASH 2>&1 | sed 's/^\(smash> \)*//'`
+echo "$OUT" | grep -A4 "^\[1\] yes | sleep 4&" | grep -q "bottleneck: sleep 4$" ||
+    fail "a slow reader is not the bottleneck"
+echo "$OUT" | grep -A4 "^\[1\] yes | sleep 4&" | grep -q "fill 100% of 64.0 KB" ||
+    fail "a pipe nobody reads is not full"
+echo "$OUT" | grep -A4 "^\[2\] sleep 5 | wc -c&" | grep -q "bottleneck: sleep 5$" ||
+    fail "a slow writer is not the bottleneck"
+echo "$OUT" | grep -A4 "^\[3\] /bin/cat" | grep -q "MB/s, fill .* of 1.0 MB, resized" ||
+    fail "the adaptive policy did not grow a busy pipe"
+echo "$OUT" | grep -q "^\[3\] .* \[[0-9.]* MB/s, bottleneck: sha256sum\]$" ||
+    fail "jobs -v does not show the throughput"
+echo "$OUT" | grep -q "^\[2\] .* \[.*/s" && fail "jobs -v shows an idle pipe"
+echo "$OUT" | grep -A4 "^\[4\] yes | sleep 3&" | grep -q "fill 100% of 512.0 KB" ||
+    fail "a static pipe size was not applied"
+
+# the leader must not hold the pipe open, or the writer would never get EPIPE
+START=`date +%s%N`
+printf 'yes | head -c 1\n' | timeout 5 $SMASH > /dev/null
+[ $(( (`date +%s%N` - START) / 1000000 )) -lt 2000 ] || fail "a writer did not get EPIPE"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "pipestat test passed"
+else
+    echo "$OUT"
+fi
+exit $STATUS
@@ -0,0 +1,40 @@
+#! /bin/bash
+# Checks "quit kill --grace": every job gets SIGTERM at once, only the jobs
+# still alive when the grace period ends get SIGKILL, and quit returns once
+# all of them are reaped. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_quitkill.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+# the second job ignores SIGTERM and the sleep it runs inherits that
+printf "trap '' TERM\ntouch $DIR/ready\nsleep 100\n" > $DIR/stubborn.sh
+START=`date +%s%N`
+OUT=`(printf '%s\n' "sleep 100&" "sh $DIR/stubborn.sh&"
+      while [ ! -e $DIR/ready ]; do sleep 0.01; done
+      echo "quit kill --grace 1") | $SMASH`
+MS=$(( (`date +%s%N` - START) / 1000000 ))
+echo "$OUT" | grep -q "smash: sending SIGTERM signal to 2 jobs:" || fail "SIGTERM was not sent to both jobs"
+echo "$OUT" | grep -q "^[0-9]*: sleep 100&$" || fail "the SIGTERM listing lacks the first job"
+echo "$OUT" | grep -q "smash: sending SIGKILL signal to 1 jobs:" || fail "SIGKILL was not sent to one job"
+[ "`echo "$OUT" | sed -n '/SIGKILL/,$p' | grep -c '^[0-9]*: '`" = 1 ] &&
+    echo "$OUT" | sed -n '/SIGKILL/,$p' | grep -q "^[0-9]*: sh $DIR/stubborn.sh&$" ||
+    fail "SIGKILL went to a job that had exited"
+[ $MS -ge 1000 ] && [ $MS -lt 3000 ] || fail "quit took $MS ms with a 1 s grace period"
+
+# without a job that holds out, quit returns as soon as all have exited
+START=`date +%s%N`
+OUT=`printf '%s\n' "sleep 100&" "sleep 100&" "quit kill --grace 5" | $SMASH`
+MS=$(( (`date +%s%N` - START) / 1000000 ))
+echo "$OUT" | grep -q "SIGKILL" && fail "SIGKILL was sent after every job exited"
+[ $MS -lt 1000 ] || fail "quit took $MS ms after every job exited"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "quitkill test passed"
+fi
+exit $STATUS
@@ -0,0 +1,50 @@
+#! /bin/bash
+# Checks repeat and watch: runs keep to their schedule, -d only prints a
+# changed output, the plan is reused, and Ctrl-C ends a watch with its
+# latency report. Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_repeat.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+# 20 runs 50 ms apart end 950 ms after the first one started, each run
+# sleeping 30 ms of it must not push the schedule back
+START=`date +%s%N`
+OUT=`printf 'repeat -n 20 -i 0.05 sleep 0.03\nquit\n' | $SMASH 2>&1 | sed 's/^\(smash> \)*//'`
+MS=$(( (`date +%s%N` - START) / 1000000 ))
+[ $MS -ge 950 ] && [ $MS -lt 1500 ] || fail "20 runs 50 ms apart took $MS ms"
+echo "$OUT" | grep -q "^repeat: 20 runs, latency min/avg/max [0-9.]*/[0-9.]*/[0-9.]* ms" ||
+    fail "no latency report"
+
+# a slow run skips the ticks it overlaps
+OUT=`printf 'repeat -n 3 -i 0.05 sleep 0.12\nquit\n' | $SMASH 2>&1`
+echo "$OUT" | grep -q "ms, [0-9]* skipped$" || fail "overlapped ticks are not reported"
+
+printf '1\n' > $DIR/value
+OUT=`printf '%s\n' "repeat -n 6 -d cat $DIR/value" "quit" | $SMASH 2>&1 | sed 's/^\(smash> \)*//'`
+[ "`echo "$OUT" | grep -c '^1$'`" = 1 ] || fail "-d printed an unchanged output"
+echo "$OUT" | grep -q "6 runs, .*, 5 unchanged$" || fail "-d does not count unchanged runs"
+
+# the command line is parsed once: a pipeline is repeated as a whole
+OUT=`printf '%s\n' "repeat -n 3 echo abc | wc -c" "quit" | $SMASH 2>&1 | sed 's/^\(smash> \)*//'`
+[ "`echo "$OUT" | grep -c '^4$'`" = 3 ] || fail "a repeated pipeline did not run 3 times"
+
+# Ctrl-C at the prompt ends a watch between runs
+(sleep 0.6; pkill -INT -f "^$SMASH$") &
+OUT=`(printf 'watch -i 0.2 echo tick\n'; sleep 1; printf 'quit\n') | $SMASH 2>&1 | sed 's/^\(smash> \)*//'`
+wait
+echo "$OUT" | grep -q "^smash: got ctrl-C$" || fail "Ctrl-C did not reach the smash"
+echo "$OUT" | grep -q "^watch: [0-9]* runs, latency" || fail "a watch ended by Ctrl-C did not report"
+[ "`echo "$OUT" | grep -c '^tick$'`" -ge 3 ] || fail "watch did not keep running"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "repeat test passed"
+else
+    echo "$OUT"
+fi
+exit $STATUS
@@ -0,0 +1,79 @@
+#! /bin/bash
+# Checks "rundag": independent targets run in parallel up to -j, a failure
+# skips its dependents only, and the summary reports the critical path.
+# Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_rundag.XXXXXX`
+# the touch builtin wants a timestamp
+TOUCH=`command -v touch`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+# eight independent 0.5s steps and a final one depending on all of them
+{
+    for i in 1 2 3 4 5 6 7 8; do
+        printf 'step%d:\n\tsleep 0.5\n' $i
+    done
+    printf 'final: step1 step2 step3 step4 step5 step6 step7 step8\n\t%s %s/final\n' $TOUCH $DIR
+} > $DIR/wide.dag
+for i in 1 2 3 4 5 6 7 8; do
+    echo "sleep 0.5"
+done > $DIR/serial.txt
+
+START=`date +%s%N`
+$SMASH < $DIR/serial.txt > /dev/null
+SERIAL=$(( (`date +%s%N` - START) / 1000000 ))
+START=`date +%s%N`
+OUT=`printf 'rundag -j 8 %s\njobs\n' $DIR/wide.dag | $SMASH`
+PARALLEL=$(( (`date +%s%N` - START) / 1000000 ))
+echo "$OUT" | grep -q "rundag: 9 done, 0 failed, 0 skipped" || fail "wide DAG did not complete"
+echo "$OUT" | grep -q "critical path .*: step[1-8] (.*) -> final" || fail "wrong critical path"
+echo "$OUT" | grep -q "^\[" && fail "finished targets are still listed as jobs"
+[ -f $DIR/final ] || fail "final target did not run"
+[ $(( SERIAL / PARALLEL )) -ge 3 ] || fail "no speedup: serial ${SERIAL}ms, rundag ${PARALLEL}ms"
+
+# -j 2 halves the parallelism
+START=`date +%s%N`
+printf 'rundag -j 2 %s\n' $DIR/wide.dag | $SMASH > /dev/null
+LIMITED=$(( (`date +%s%N` - START) / 1000000 ))
+[ $LIMITED -ge 1900 ] || fail "-j 2 ran more than 2 targets at once (${LIMITED}ms)"
+
+cat > $DIR/fail.dag <<DAG
+a:
+	sleep 0.2
+b: a
+	false
+c: b
+	$TOUCH $DIR/c
+d: c
+e: a
+	$TOUCH $DIR/e
+DAG
+OUT=`printf 'rundag %s\n' $DIR/fail.dag | $SMASH 2>&1`
+echo "$OUT" | grep -q "rundag: b failed after .*, exit status 1" || fail "failure not reported"
+echo "$OUT" | grep -q "rundag: c skipped, b failed" || fail "dependent was not skipped"
+echo "$OUT" | grep -q "rundag: d skipped, b failed" || fail "transitive dependent was not skipped"
+echo "$OUT" | grep -q "smash error: rundag: target b failed" || fail "no error for the failed target"
+[ -f $DIR/c ] && fail "skipped target ran"
+[ -f $DIR/e ] || fail "independent branch did not run"
+
+# a builtin target runs in the smash itself, and its status counts too
+cat > $DIR/builtin.dag <<DAG
+a:
+	pgrep no_such_process_name
+b: a
+	$TOUCH $DIR/b
+DAG
+OUT=`printf 'rundag %s\n' $DIR/builtin.dag | $SMASH 2>&1`
+echo "$OUT" | grep -q "rundag: a failed after .*, exit status 1" || fail "failed builtin not reported"
+[ -f $DIR/b ] && fail "target after a failed builtin ran"
+
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "rundag test passed (8 steps: serial ${SERIAL}ms, rundag -j 8 ${PARALLEL}ms)"
+fi
+exit $STATUS
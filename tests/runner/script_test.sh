@@ -0,0 +1,55 @@
+#! /bin/bash
+# Checks script mode: a script replays exactly like the same lines on stdin,
+# both when its plan is compiled and when a cached plan is mapped, and a plan
+# that no longer matches its script is rebuilt. Run from the repository root
+# after "make smash".
+SMASH=`pwd`/smash
+INPUTS=`pwd`/tests/inputs
+DIR=`mktemp -d /tmp/smash_script.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+cp -r tests/required_folder/. $DIR
+cd $DIR
+for test in test_text test_tail test_cd1 test_fileinfo_batch test_chprompt test_pwd; do
+    cp $INPUTS/$test.txt script.txt
+    EXPECTED=`$SMASH < script.txt 2>&1`
+    [ "`$SMASH --script script.txt 2>&1`" = "$EXPECTED" ] || fail "$test differs when compiled"
+    [ -f script.txt.plan ] || fail "$test left no plan next to the script"
+    [ "`$SMASH --script script.txt 2>&1`" = "$EXPECTED" ] || fail "$test differs from its plan"
+    rm -f script.txt.plan
+done
+
+# a changed script gets a new plan
+printf 'echo one\n' > script.txt
+$SMASH --script script.txt > /dev/null
+printf 'echo two\n' > script.txt
+$SMASH --script script.txt | grep -q "two" || fail "a stale plan was run"
+
+# a damaged plan is compiled again
+head -c 20 script.txt.plan > damaged && mv damaged script.txt.plan
+$SMASH --script script.txt | grep -q "two" || fail "a damaged plan was not rebuilt"
+[ `stat -c %s script.txt.plan` -gt 20 ] || fail "a damaged plan was not replaced"
+
+# with a cache dir the plan is named after the script's hash
+$SMASH --script script.txt --plan-cache $DIR/cache > /dev/null
+[ `ls $DIR/cache | grep -c '^[0-9a-f]\{16\}\.plan$'` = 1 ] || fail "no plan in the cache dir"
+
+# a plan that cannot be written is run from memory
+printf 'echo three\n' > script.txt
+$SMASH --script script.txt --plan-cache /proc/no_such_dir | grep -q "three" ||
+    fail "an unwritable plan stopped the script"
+
+$SMASH --script no_such_script.txt 2> err
+grep -q "smash error: open failed: No such file or directory" err || fail "a missing script is not reported"
+
+cd - > /dev/null
+rm -rf $DIR
+if [ $STATUS -eq 0 ]; then
+    echo "script test passed"
+fi
+exit $STATUS
@@ -0,0 +1,84 @@
+#! /bin/bash
+# Exercises "smash --serve" locally: two concurrent sessions must not block
+# each other, not even with a long builtin or a client that stops reading,
+# keep their own cwd and prompt, get their job events, and get any bytes of
+# output intact.
+# Run from the repository root after "make smash smashc".
+SMASH=`pwd`/smash
+CLIENT=`pwd`/smashc
+DIR=`mktemp -d /tmp/smash_serve.XXXXXX`
+SOCK=$DIR/smash.sock
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+(cd $DIR && exec $SMASH --serve $SOCK) &
+SERVER_PID=$!
+for ((i = 0; i < 50; i++)); do
+    [ -S $SOCK ] && break
+    sleep 0.1
+done
+
+printf 'chprompt slow\ncd /\nsleep 2\npwd\n' | $CLIENT $SOCK > $DIR/slow.out &
+SLOW_PID=$!
+sleep 0.3
+START=`date +%s%N`
+printf 'pwd\nsleep 0.2&\nsleep 0.5\n' | $CLIENT $SOCK > $DIR/fast.out
+ELAPSED=$(( (`date +%s%N` - START) / 1000000 ))
+wait $SLOW_PID
+
+[ $ELAPSED -lt 1500 ] || fail "a session waited ${ELAPSED}ms for another one"
+grep -q "smash> $DIR$" $DIR/fast.out || fail "cwd leaked between sessions"
+grep -q "slow> /$" $DIR/slow.out || fail "session lost its cwd or prompt"
+grep -q "smash: job \[1\] sleep 0.2& : exited with status 0" $DIR/fast.out ||
+    fail "job event was not delivered"
+
+# a builtin that runs for long goes to a child and holds up only its session
+printf 'repeat -n 3 -i 0.5 echo tick\npwd\n' | $CLIENT $SOCK > $DIR/repeat.out &
+REPEAT_PID=$!
+sleep 0.3
+START=`date +%s%N`
+printf 'pwd\n' | $CLIENT $SOCK > /dev/null
+ELAPSED=$(( (`date +%s%N` - START) / 1000000 ))
+wait $REPEAT_PID
+[ $ELAPSED -lt 500 ] || fail "a session waited ${ELAPSED}ms for another one's repeat"
+[ `grep -c tick $DIR/repeat.out` = 3 ] && grep -q "smash> $DIR$" $DIR/repeat.out ||
+    fail "the repeating session lost output"
+printf 'wait\ncapture on\nsleep 1&\njoblog %%1 -f\ncapture off\n' | $CLIENT $SOCK > $DIR/refused.out
+grep -q "smash error: wait: not available to a served session" $DIR/refused.out &&
+    grep -q "smash error: joblog: -f is not available to a served session" $DIR/refused.out ||
+    fail "wait or joblog -f was not refused"
+
+# output is framed, so a NUL in it is just data
+printf 'a\0b\nc\n' > $DIR/nul.bin
+printf 'cat nul.bin\necho after\n' | $CLIENT $SOCK > $DIR/nul.out
+printf 'smash> a\0b\nc\nsmash> after\nsmash> ' | cmp -s - $DIR/nul.out ||
+    fail "output with a NUL desynchronised the session"
+
+# a client that stops reading holds up only itself
+head -c 20000000 /dev/zero > $DIR/big
+python3 -c "
+import socket, time
+s = socket.socket(socket.AF_UNIX)
+s.connect('$SOCK')
+s.send(b'cat big\n')
+time.sleep(3)
+" &
+STALLED_PID=$!
+sleep 0.5
+START=`date +%s%N`
+printf 'echo hi\n' | timeout 5 $CLIENT $SOCK > $DIR/hi.out
+ELAPSED=$(( (`date +%s%N` - START) / 1000000 ))
+wait $STALLED_PID
+grep -q "smash> hi$" $DIR/hi.out && [ $ELAPSED -lt 1000 ] ||
+    fail "a session waited ${ELAPSED}ms for a client that does not read"
+
+kill $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+[ -e $SOCK ] && rm -f $SOCK
+[ $STATUS -eq 0 ] && echo "serve test passed"
+rm -rf $DIR
+exit $STATUS
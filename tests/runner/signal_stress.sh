@@ -0,0 +1,41 @@
+#! /bin/bash
+# Floods a running smash with Ctrl-C/Ctrl-Z while it waits on a foreground
+# job and while idle, then checks it still answers a command.
+SMASH=`pwd`/smash
+COUNT=${COUNT:-5000}
+FIFO=`mktemp -u /tmp/smash_stress.XXXXXX`
+
+mkfifo $FIFO
+$SMASH < $FIFO > $FIFO.out 2>&1 &
+SMASH_PID=$!
+exec 3>$FIFO
+
+echo "sleep 1000" >&3
+sleep 0.2
+for ((i = 0; i < COUNT; i++)); do
+    kill -INT $SMASH_PID 2>/dev/null
+    kill -TSTP $SMASH_PID 2>/dev/null
+done
+
+echo "chprompt alive" >&3
+echo "quit kill" >&3
+exec 3>&-
+
+for ((i = 0; i < 50; i++)); do
+    kill -0 $SMASH_PID 2>/dev/null || break
+    sleep 0.1
+done
+
+if kill -0 $SMASH_PID 2>/dev/null; then
+    kill -KILL $SMASH_PID
+    echo "smash stopped responding"
+    STATUS=1
+elif grep -q "^alive> " $FIFO.out; then
+    echo "smash survived $COUNT signal pairs"
+    STATUS=0
+else
+    echo "smash did not run commands after the signals"
+    STATUS=1
+fi
+rm -f $FIFO $FIFO.out
+exit $STATUS
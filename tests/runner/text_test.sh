@@ -0,0 +1,61 @@
+#! /bin/bash
+# Checks that the in-process cat, head, tail, wc and grep -F print exactly
+# what coreutils does, on every kernel version, for random text with lines and
+# words that straddle the builtins' read buffers and the SIMD blocks.
+# Run from the repository root after "make smash".
+SMASH=`pwd`/smash
+DIR=`mktemp -d /tmp/smash_text.XXXXXX`
+STATUS=0
+
+fail() {
+    echo "FAILED: $1"
+    STATUS=1
+}
+
+# short words and all the whitespace bytes, a few very long lines, and a last
+# line without a newline
+awk 'BEGIN {
+    srand(3);
+    split("ab abc needle x hay\tstack a\vb c\rd e\ff nee dle needleneedle", words, " ");
+    for (i = 0; i < 60000; i++) {
+        n = (i % 997 == 0) ? 40000 : int(rand() * 10);
+        line = "";
+        for (w = 0; w < n; w++) line = line words[int(rand() * 15) + 1] (rand() < 0.3 ? "  " : " ");
+        print line;
+    }
+    printf "tail needle";
+}' > $DIR/data
+printf 'one\ntwo needle\n' > $DIR/small
+
+COMMANDS=(
+    "cat $DIR/data"
+    "cat $DIR/small - $DIR/small"
+    "cat $DIR/data | head -n 7"
+    "head -n 25000 $DIR/data"
+    "head -3 $DIR/small $DIR/data"
+    "wc $DIR/data"
+    "wc -l $DIR/data"
+    "wc -w $DIR/small $DIR/data"
+    "cat $DIR/data | wc"
+    "grep -F needle $DIR/data"
+    "grep -F -c needle $DIR/data"
+    "grep -n needleneedle $DIR/data $DIR/small"
+    "grep -vn needle $DIR/data"
+    "grep -c x $DIR/small"
+    "cat $DIR/data | grep -F dle | wc -lw"
+    "cat $DIR/nosuch $DIR/small"
+    "wc $DIR/small $DIR/nosuch"
+    "tail -2 /proc/cpuinfo"
+)
+
+for kernel in avx2 sse2 scalar; do
+    for cmd in "${COMMANDS[@]}"; do
+        echo "$cmd" | SMASH_SIMD=$kernel $SMASH 2>&1 < <(echo "$cmd") | sed '1s/^smash> //;$s/smash> $//' > $DIR/smash.out
+        bash -c "$cmd" < /dev/null > $DIR/coreutils.out 2>&1
+        cmp -s $DIR/smash.out $DIR/coreutils.out || fail "$kernel: $cmd"
+    done
+done
+
+rm -rf $DIR
+[ $STATUS -eq 0 ] && echo "text builtins: all passed"
+exit $STATUS
@@ -0,0 +1,229 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include "textscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEXTSCAN_X86
+#endif
+
+using namespace std;
+
+/* -------------- scalar -------------- */
+
+static inline bool _isSpace(unsigned char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static size_t countByteScalar(const char *buf, size_t len, char byte) {
+    size_t count = 0;
+    for (size_t i = 0; i < len; ++i) {
+        count += buf[i] == byte;
+    }
+    return count;
+}
+
+static const char *findScalar(const char *buf, size_t len, const std::string& needle) {
+    return (const char *)memmem(buf, len, needle.data(), needle.length());
+}
+
+static size_t countWordsScalar(const char *buf, size_t len, bool& in_word) {
+    size_t count = 0;
+    bool in = in_word;
+    for (size_t i = 0; i < len; ++i) {
+        bool space = _isSpace(buf[i]);
+        count += !space && !in;
+        in = !space;
+    }
+    in_word = in;
+    return count;
+}
+
+#if defined(TEXTSCAN_X86)
+
+/* -------------- SSE2 -------------- */
+
+// Matches are accumulated as byte counters, which are folded into 64-bit sums
+// with psadbw before they can overflow.
+__attribute__((target("sse2")))
+static size_t countByteSse2(const char *buf, size_t len, char byte) {
+    const __m128i needle = _mm_set1_epi8(byte);
+    const __m128i zero = _mm_setzero_si128();
+    size_t count = 0, i = 0;
+    while (i + 16 <= len) {
+        size_t rounds = min<size_t>((len - i) / 16, 255);
+        __m128i acc = zero;
+        for (size_t r = 0; r < rounds; ++r, i += 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(chunk, needle));
+        }
+        uint64_t sums[2];
+        _mm_storeu_si128((__m128i *)sums, _mm_sad_epu8(acc, zero));
+        count += sums[0] + sums[1];
+    }
+    return count + countByteScalar(buf + i, len - i, byte);
+}
+
+// Compares the needle's first and last bytes against 16 positions at once and
+// only runs memcmp where both match.
+__attribute__((target("sse2")))
+static const char *findSse2(const char *buf, size_t len, const std::string& needle) {
+    size_t k = needle.length();
+    if (k < 2 || len < k) {
+        return findScalar(buf, len, needle);
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[k - 1]);
+    size_t i = 0;
+    for (; i + k - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(buf + i + k - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                        _mm_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (memcmp(buf + pos + 1, needle.data() + 1, k - 2) == 0) {
+                return buf + pos;
+            }
+        }
+    }
+    return findScalar(buf + i, len - i, needle);
+}
+
+// A word starts at every non-space byte that follows a space, so the count is
+// a popcount over the shifted whitespace mask.
+__attribute__((target("sse2")))
+static size_t countWordsSse2(const char *buf, size_t len, bool& in_word) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i span = _mm_set1_epi8('\r' - '\t');
+    size_t count = 0, i = 0;
+    unsigned prev = !in_word;
+    for (; i + 16 <= len; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i t = _mm_sub_epi8(c, tab);
+        __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(c, space),
+                                  _mm_cmpeq_epi8(_mm_min_epu8(t, span), t));
+        unsigned mask = _mm_movemask_epi8(ws);
+        count += __builtin_popcount(~mask & ((mask << 1) | prev) & 0xffff);
+        prev = mask >> 15;
+    }
+    in_word = !prev;
+    return count + countWordsScalar(buf + i, len - i, in_word);
+}
+
+/* -------------- AVX2 -------------- */
+
+__attribute__((target("avx2")))
+static size_t countByteAvx2(const char *buf, size_t len, char byte) {
+    const __m256i needle = _mm256_set1_epi8(byte);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t count = 0, i = 0;
+    while (i + 32 <= len) {
+        size_t rounds = min<size_t>((len - i) / 32, 255);
+        __m256i acc = zero;
+        for (size_t r = 0; r < rounds; ++r, i += 32) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i *)(buf + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(chunk, needle));
+        }
+        uint64_t sums[4];
+        _mm256_storeu_si256((__m256i *)sums, _mm256_sad_epu8(acc, zero));
+        count += sums[0] + sums[1] + sums[2] + sums[3];
+    }
+    return count + countByteSse2(buf + i, len - i, byte);
+}
+
+__attribute__((target("avx2")))
+static const char *findAvx2(const char *buf, size_t len, const std::string& needle) {
+    size_t k = needle.length();
+    if (k < 2 || len < k) {
+        return findScalar(buf, len, needle);
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+    size_t i = 0;
+    for (; i + k - 1 + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(buf + i + k - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                                                              _mm256_cmpeq_epi8(b, last)));
+        for (; mask; mask &= mask - 1) {
+            size_t pos = i + __builtin_ctz(mask);
+            if (memcmp(buf + pos + 1, needle.data() + 1, k - 2) == 0) {
+                return buf + pos;
+            }
+        }
+    }
+    return findSse2(buf + i, len - i, needle);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t countWordsAvx2(const char *buf, size_t len, bool& in_word) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i span = _mm256_set1_epi8('\r' - '\t');
+    size_t count = 0, i = 0;
+    unsigned prev = !in_word;
+    for (; i + 32 <= len; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i t = _mm256_sub_epi8(c, tab);
+        __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(c, space),
+                                     _mm256_cmpeq_epi8(_mm256_min_epu8(t, span), t));
+        unsigned mask = _mm256_movemask_epi8(ws);
+        count += __builtin_popcount(~mask & ((mask << 1) | prev));
+        prev = mask >> 31;
+    }
+    in_word = !prev;
+    return count + countWordsSse2(buf + i, len - i, in_word);
+}
+
+#endif
+
+/* -------------- dispatch -------------- */
+
+struct TextKernels {
+    size_t (*countByte)(const char *, size_t, char);
+    const char *(*find)(const char *, size_t, const std::string&);
+    size_t (*countWords)(const char *, size_t, bool&);
+    const char *name;
+};
+
+static TextKernels _selectKernels() {
+    const char *forced = getenv("SMASH_SIMD");
+    string want = forced ? forced : "";
+#if defined(TEXTSCAN_X86)
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    bool sse2 = __builtin_cpu_supports("sse2");
+    if (avx2 && (want.empty() || want == "avx2")) {
+        return {countByteAvx2, findAvx2, countWordsAvx2, "avx2"};
+    }
+    if (sse2 && (want.empty() || want == "avx2" || want == "sse2")) {
+        return {countByteSse2, findSse2, countWordsSse2, "sse2"};
+    }
+#endif
+    return {countByteScalar, findScalar, countWordsScalar, "scalar"};
+}
+
+static const TextKernels& _kernels() {
+    static const TextKernels kernels = _selectKernels();
+    return kernels;
+}
+
+size_t textCountByte(const char *buf, size_t len, char byte) {
+    return _kernels().countByte(buf, len, byte);
+}
+
+const char *textFind(const char *buf, size_t len, const std::string& needle) {
+    return _kernels().find(buf, len, needle);
+}
+
+size_t textCountWords(const char *buf, size_t len, bool& in_word) {
+    return _kernels().countWords(buf, len, in_word);
+}
+
+const char *textKernelName() {
+    return _kernels().name;
+}
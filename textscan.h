@@ -0,0 +1,23 @@
+#ifndef SMASH__TEXTSCAN_H_
+#define SMASH__TEXTSCAN_H_
+
+#include <string>
+#include <stddef.h>
+
+// Scanning kernels behind the in-process text builtins (cat, head, wc, grep).
+//
+// Each kernel has an AVX2, an SSE2 and a scalar version; the best one the CPU
+// supports is picked on first use. SMASH_SIMD=avx2|sse2|scalar in the
+// environment forces a version, which the tests use to compare them.
+
+// Number of occurrences of byte in buf.
+size_t textCountByte(const char *buf, size_t len, char byte);
+// First occurrence of needle in buf, or nullptr.
+const char *textFind(const char *buf, size_t len, const std::string& needle);
+// Number of words that start in buf. in_word carries whether the previous
+// buffer ended inside a word and is updated for the next one.
+size_t textCountWords(const char *buf, size_t len, bool& in_word);
+// Name of the selected kernel version.
+const char *textKernelName();
+
+#endif //SMASH__TEXTSCAN_H_